@@ -1,6 +0,0 @@
-import QtQuick 2.0
-
-Rectangle {
-    id: root
-    color: "#101020"
-}
@@ -1,7 +1,6 @@
 import QtQuick 2.0
-import QtQuick.Controls.Styles 1.4
-import QtQuick.Extras 1.4
 import QtQuick.Layouts 1.0
+import MeteoGauges 1.0
 
 ColumnLayout {
     id: root
@@ -21,7 +20,7 @@ ColumnLayout {
         text: label
     }
 
-    Gauge {
+    BarGauge {
         Layout.alignment: Qt.AlignHCenter
         Layout.fillHeight: true
         minimumValue: root.minimumValue
@@ -1,18 +1,38 @@
-QT += qml quick
+QT += network
 
 CONFIG += c++11
 
+# qmake CONFIG+=headless: CAN -> MQTT daemon without Qt GUI, QML and display
+headless {
+    QT -= gui
+    DEFINES += METEOHMI_HEADLESS
+} else {
+    QT += qml quick
+    SOURCES += meteobinding.cpp \
+        gaugenodes.cpp \
+        gaugescaleitem.cpp \
+        gaugedialitem.cpp \
+        gaugeneedleitem.cpp \
+        lineargaugeitem.cpp \
+        historymodel.cpp
+    HEADERS += meteobinding.h \
+        gaugenodes.h \
+        gaugescaleitem.h \
+        gaugedialitem.h \
+        gaugeneedleitem.h \
+        lineargaugeitem.h \
+        historymodel.h
+    RESOURCES += qml.qrc
+}
+
 SOURCES += main.cpp \
     canreceiver.cpp \
-    meteocollector.cpp \
-    n2kparser.cpp \
-    meteobinding.cpp \
-    mqttclient.cpp \
-    mqttsender.cpp
-
-RESOURCES += qml.qrc
+    canbatch.cpp \
+    canreaderthread.cpp \
+    canreplay.cpp \
+    metricsserver.cpp
 
-LIBS += -lmosquitto
+include(meteocore.pri)
 
 # Additional import path used to resolve QML modules in Qt Creator's code model
 QML_IMPORT_PATH =
@@ -38,8 +58,7 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 
 HEADERS += \
     canreceiver.h \
-    meteocollector.h \
-    n2kparser.h \
-    meteobinding.h \
-    mqttclient.h \
-    mqttsender.h
+    canreplay.h \
+    canbatch.h \
+    canreaderthread.h \
+    metricsserver.h
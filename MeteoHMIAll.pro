@@ -0,0 +1,7 @@
+# MeteoHMI and the MeteoBench microbenchmarks, both built from meteocore.pri
+TEMPLATE = subdirs
+
+SUBDIRS = app bench
+
+app.file = MeteoHMI.pro
+bench.file = bench/MeteoBench.pro
@@ -1,6 +1,5 @@
 import QtQuick 2.0
-import QtQuick.Controls.Styles 1.4
-import QtQuick.Extras 1.4
+import MeteoGauges 1.0
 
 Item {
     id: root
@@ -8,60 +7,50 @@ Item {
     property real peak: 0.0
     property real current: 0.0
 
-    CircularGauge {
-        id: peakGauge
+    GaugeDial {
+        id: dial
         anchors.fill: parent
 
-        value: peak
         minimumValue: 0.0
         maximumValue: 50.0
 
-        style: CircularGaugeStyle {
-            labelStepSize: 5.0
-            tickmarkStepSize : 5.0
+        color: "#101020"
+        tickmarkStepSize: 5.0
+        labelStepSize: 5.0
+        labelColor: "yellow"
+    }
 
-            tickmarkLabel: Text {
-                text: styleData.value
-                visible: styleData.value < 359.9
-                font.pixelSize: outerRadius * 0.12
-                color: "yellow"
-            }
+    GaugeNeedle {
+        anchors.fill: parent
 
-            needle: Rectangle {
-                y: -outerRadius * 0.9
-                implicitWidth: outerRadius * 0.03
-                implicitHeight: outerRadius * 0.1
-                antialiasing: true
-                color: "orangered"
-            }
+        minimumValue: 0.0
+        maximumValue: 50.0
 
-            background: GaugeBackground {
-                radius: outerRadius
-            }
+        value: peak
+        color: "orangered"
+        tapered: false
+        tipRadius: 1.0
+        tailRadius: 0.9
+        needleWidth: 0.03
+    }
+
+    GaugeText {
+        anchors.centerIn: parent
+        width: dial.outerRadius * 2
+        height: width
 
-            foreground: null
-        }
+        label: "Wind speed"
+        unit: "[knots]"
+        radius: dial.outerRadius
+        value: root.current
     }
 
-    CircularGauge {
-        id: currGauge
+    GaugeNeedle {
         anchors.fill: parent
 
-        value: current
         minimumValue: 0.0
         maximumValue: 50.0
 
-        style: CircularGaugeStyle {
-            tickmark: null
-            minorTickmark: null
-            tickmarkLabel: null
-
-            background: GaugeText {
-                label: "Wind speed"
-                unit: "[knots]"
-                radius: outerRadius
-                value: root.current
-            }
-        }
+        value: current
     }
 }
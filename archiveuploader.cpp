@@ -0,0 +1,209 @@
+#include "archiveuploader.h"
+
+#include <QTimerEvent>
+#include <QtEndian>
+
+#include <math.h>
+
+const QString ARCHIVE_WIND_TOPIC("meteo/archive/wind");
+const QString ARCHIVE_AIR_PRESS_TOPIC("meteo/archive/air/press");
+const QString ARCHIVE_AIR_TEMP_TOPIC("meteo/archive/air/temp");
+
+#define HEADER_LEN 23
+// 64 bit zigzag varint
+#define VARINT_MAX_LEN 10
+
+ArchiveUploader::ArchiveUploader(MqttClient *mqtt, MeteoCollector *collector, QObject *parent) : QObject(parent), mqtt(mqtt), collector(collector)
+{
+    connect(collector, SIGNAL(windUpdate()), this, SLOT(windUpdate()));
+    connect(collector, SIGNAL(airTempUpdate()), this, SLOT(airTempUpdate()));
+    connect(collector, SIGNAL(airPressUpdate()), this, SLOT(airPressUpdate()));
+
+    for (int i = 0; i < QuantityCount; i++) {
+        Stream &s = streams[i];
+        s.samples.resize(ARCHIVEUPLOADER_MAX_SAMPLES);
+        s.count = 0;
+        s.channels = 1;
+        s.sequence = 0;
+        s.topic = getTopicName((Quantity) i).toLocal8Bit();
+    }
+    streams[Wind].channels = 2;
+
+    // lets the consumer tell a restart (sequence starting over) from lost blocks
+    session = (quint32) collector->getClock()->wallTime();
+    flushTimer = 0;
+}
+
+const QString &ArchiveUploader::getTopicName(Quantity quantity)
+{
+    switch (quantity) {
+    case Wind:
+        return ARCHIVE_WIND_TOPIC;
+    case AirPress:
+        return ARCHIVE_AIR_PRESS_TOPIC;
+    default:
+        return ARCHIVE_AIR_TEMP_TOPIC;
+    }
+}
+
+void ArchiveUploader::setInterval(int seconds)
+{
+    if (flushTimer != 0) {
+        killTimer(flushTimer);
+        flushTimer = 0;
+    }
+
+    if (seconds > 0) {
+        flushTimer = startTimer(seconds * 1000);
+    }
+}
+
+void ArchiveUploader::registerMetrics(MetricsRegistry *metrics)
+{
+    for (int i = 0; i < QuantityCount; i++) {
+        QString labels = QString("topic=\"%1\"").arg(getTopicName((Quantity) i));
+        metrics->addCounter("meteo_archive_blocks_total", "Archive blocks published", labels, &streams[i].blocks);
+        metrics->addCounter("meteo_archive_samples_total", "Samples in published archive blocks", labels, &streams[i].sampleCount);
+        metrics->addCounter("meteo_archive_bytes_total", "Payload bytes of published archive blocks", labels, &streams[i].bytes);
+        metrics->addCounter("meteo_archive_publish_failures_total", "Archive blocks not accepted by the MQTT client, retried next interval", labels, &streams[i].failures);
+        metrics->addCounter("meteo_archive_dropped_samples_total", "Samples dropped because the block buffer was full", labels, &streams[i].droppedSamples);
+    }
+}
+
+void ArchiveUploader::add(Quantity quantity, qint64 timestamp, double v0, double v1)
+{
+    // not uploading
+    if (flushTimer == 0) {
+        return;
+    }
+
+    if (isnan(v0) || isnan(v1)) {
+        return;
+    }
+
+    Stream &s = streams[quantity];
+
+    // last block was not accepted, it is retried with the next interval
+    if (s.count == ARCHIVEUPLOADER_MAX_SAMPLES) {
+        s.droppedSamples.inc();
+        return;
+    }
+
+    Sample &sample = s.samples[s.count];
+    sample.timestamp = timestamp;
+    sample.values[0] = (qint32) lround(v0);
+    sample.values[1] = (qint32) lround(v1);
+
+    if (++s.count == ARCHIVEUPLOADER_MAX_SAMPLES) {
+        flushStream(quantity);
+    }
+}
+
+static inline quint64 zigzag(qint64 v)
+{
+    return ((quint64) v << 1) ^ (quint64) (v >> 63);
+}
+
+static inline uchar *putVarint(uchar *p, quint64 v)
+{
+    while (v >= 0x80) {
+        *p++ = (uchar) (v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uchar) v;
+    return p;
+}
+
+int ArchiveUploader::encodeBlock(Quantity quantity, QByteArray *out)
+{
+    Stream &s = streams[quantity];
+    if (s.count == 0) {
+        out->clear();
+        return 0;
+    }
+
+    body.resize(s.count * VARINT_MAX_LEN * (1 + s.channels));
+    uchar *start = (uchar *) body.data();
+    uchar *p = start;
+
+    qint64 lastTimestamp = s.samples[0].timestamp;
+    qint32 last[ARCHIVEUPLOADER_MAX_CHANNELS] = { 0, 0 };
+    for (int i = 0; i < s.count; i++) {
+        const Sample &sample = s.samples[i];
+        p = putVarint(p, zigzag(sample.timestamp - lastTimestamp));
+        lastTimestamp = sample.timestamp;
+        for (int c = 0; c < s.channels; c++) {
+            p = putVarint(p, zigzag((qint64) sample.values[c] - last[c]));
+            last[c] = sample.values[c];
+        }
+    }
+    body.resize(p - start);
+
+    // sample timestamps are monotonic, the consumer wants wall clock time
+    MeteoClock *clock = collector->getClock();
+    qint64 firstTimestamp = s.samples[0].timestamp + clock->wallTimeMsec() - clock->monotonic();
+
+    out->resize(HEADER_LEN);
+    uchar *h = (uchar *) out->data();
+    h[0] = ARCHIVEUPLOADER_VERSION;
+    h[1] = (uchar) quantity;
+    h[2] = (uchar) s.channels;
+    qToLittleEndian<quint32>(session, h + 3);
+    qToLittleEndian<quint32>(s.sequence, h + 7);
+    qToLittleEndian<qint64>(firstTimestamp, h + 11);
+    qToLittleEndian<quint32>((quint32) s.count, h + 19);
+    out->append(qCompress(body));
+
+    return s.count;
+}
+
+void ArchiveUploader::flushStream(Quantity quantity)
+{
+    Stream &s = streams[quantity];
+
+    // nothing received, no block and no gap in the sequence
+    int count = encodeBlock(quantity, &block);
+    if (count == 0) {
+        return;
+    }
+
+    // keep samples and sequence, the block is sent again next time
+    if (mqtt->publish(s.topic.constData(), block.constData(), block.size(), 1) != MOSQ_ERR_SUCCESS) {
+        s.failures.inc();
+        return;
+    }
+
+    s.sequence++;
+    s.count = 0;
+    s.blocks.inc();
+    s.sampleCount.inc(count);
+    s.bytes.inc(block.size());
+}
+
+void ArchiveUploader::flush()
+{
+    for (int i = 0; i < QuantityCount; i++) {
+        flushStream((Quantity) i);
+    }
+}
+
+void ArchiveUploader::timerEvent(QTimerEvent *event)
+{
+    Q_UNUSED(event);
+    flush();
+}
+
+void ArchiveUploader::windUpdate()
+{
+    add(Wind, collector->getWindTimestamp(), collector->getWindVelo() * 100.0, collector->getWindDir() * 10.0);
+}
+
+void ArchiveUploader::airPressUpdate()
+{
+    add(AirPress, collector->getAirPressTimestamp(), collector->getAirPress() * 1000.0);
+}
+
+void ArchiveUploader::airTempUpdate()
+{
+    add(AirTemp, collector->getAirTempTimestamp(), collector->getAirTemp() * 100.0);
+}
@@ -0,0 +1,94 @@
+#ifndef ARCHIVEUPLOADER_H
+#define ARCHIVEUPLOADER_H
+
+#include <QObject>
+#include <QVector>
+#include <QByteArray>
+
+#include "mqttclient.h"
+#include "meteocollector.h"
+#include "metricsregistry.h"
+
+// Block payload, little endian:
+//   u8 version, u8 quantity (0 wind, 1 air press, 2 air temp), u8 channels,
+//   u32 session (wall clock seconds at startup), u32 sequence (per quantity, +1 per block),
+//   i64 time of the first sample (msec since epoch), u32 sample count,
+//   body as produced by qCompress(): per sample the zigzag varint time delta (msec),
+//   then per channel the zigzag varint delta to the previous sample
+// channels: wind velo 0.01 kn and dir 0.1 deg, air press 0.001 hPa, air temp 0.01 degC
+#define ARCHIVEUPLOADER_VERSION 1
+
+// samples per block, a full buffer is sent before the interval ends
+#define ARCHIVEUPLOADER_MAX_SAMPLES 4096
+#define ARCHIVEUPLOADER_MAX_CHANNELS 2
+
+// Collects every sample used by the collector and publishes one delta encoded, compressed
+// block per quantity and interval to meteo/archive/... (QoS 1, spooled while offline).
+// A block the client does not accept is kept and sent with the next interval, samples
+// arriving while its buffer is full are dropped.
+class ArchiveUploader : public QObject
+{
+    Q_OBJECT
+public:
+    enum Quantity { Wind, AirPress, AirTemp, QuantityCount };
+
+    explicit ArchiveUploader(MqttClient *mqtt, MeteoCollector *collector, QObject *parent = 0);
+
+    // seconds between blocks, 0 stops uploading
+    void setInterval(int seconds);
+
+    static const QString &getTopicName(Quantity quantity);
+
+    void registerMetrics(MetricsRegistry *metrics);
+
+    // block of the buffered samples into out, returns the sample count
+    int encodeBlock(Quantity quantity, QByteArray *out);
+
+public slots:
+    // publish and clear the buffered samples of all quantities
+    void flush();
+
+private:
+    struct Sample {
+        qint64 timestamp;
+        qint32 values[ARCHIVEUPLOADER_MAX_CHANNELS];
+    };
+
+    struct Stream {
+        QVector<Sample> samples;
+        int count;
+        int channels;
+        quint32 sequence;
+        QByteArray topic;
+        MetricsCounter blocks;
+        MetricsCounter sampleCount;
+        MetricsCounter bytes;
+        MetricsCounter failures;
+        MetricsCounter droppedSamples;
+    };
+
+    MqttClient *mqtt;
+    MeteoCollector *collector;
+
+    Stream streams[QuantityCount];
+    quint32 session;
+    int flushTimer;
+
+    // reused for encoding
+    QByteArray body;
+    QByteArray block;
+
+    void add(Quantity quantity, qint64 timestamp, double v0, double v1 = 0.0);
+    void flushStream(Quantity quantity);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private slots:
+    void windUpdate();
+    void airTempUpdate();
+    void airPressUpdate();
+
+};
+
+#endif // ARCHIVEUPLOADER_H
@@ -0,0 +1,124 @@
+#include "arrivalstats.h"
+
+#include <algorithm>
+
+ArrivalStats::ArrivalStats()
+{
+    reset();
+}
+
+void ArrivalStats::reset() {
+    count = 0;
+    lastTimestamp = 0;
+
+    gapHead = 0;
+    gapCount = 0;
+    gapSum = 0;
+
+    lastSid = -1;
+    sidMissed = 0;
+    sidDuplicates = 0;
+}
+
+void ArrivalStats::record(qint64 timestamp, int sid) {
+    if (count > 0) {
+        qint64 gap = timestamp - lastTimestamp;
+        if (gap < 0) {
+            gap = 0;
+        }
+        if (gap > 0xffffffffLL) {
+            gap = 0xffffffffLL;
+        }
+
+        // replace the oldest gap once the ring is full
+        if (gapCount == ARRIVALSTATS_GAPS) {
+            gapSum -= gaps[gapHead];
+        } else {
+            gapCount++;
+        }
+        gaps[gapHead] = (quint32) gap;
+        gapSum += (quint32) gap;
+        gapHead = (gapHead + 1) % ARRIVALSTATS_GAPS;
+    }
+
+    count++;
+    lastTimestamp = timestamp;
+
+    if (sid < 0 || sid >= ARRIVALSTATS_SID_MODULO) {
+        return;
+    }
+
+    if (lastSid >= 0) {
+        int diff = (sid - lastSid + ARRIVALSTATS_SID_MODULO) % ARRIVALSTATS_SID_MODULO;
+        if (diff == 0) {
+            sidDuplicates++;
+        } else {
+            sidMissed += diff - 1;
+        }
+    }
+    lastSid = sid;
+}
+
+double ArrivalStats::getRate(qint64 now) const {
+    if (gapCount == 0) {
+        return 0.0;
+    }
+
+    // window from the oldest kept arrival until now
+    qint64 window = (qint64) gapSum + ((now > lastTimestamp) ? now - lastTimestamp : 0);
+    if (window <= 0) {
+        return 0.0;
+    }
+
+    return (double) gapCount * 1e6 / (double) window;
+}
+
+qint64 ArrivalStats::getGapMin() const {
+    if (gapCount == 0) {
+        return 0;
+    }
+
+    quint32 m = gaps[0];
+    for (int i = 1; i < gapCount; i++) {
+        if (gaps[i] < m) {
+            m = gaps[i];
+        }
+    }
+    return m;
+}
+
+qint64 ArrivalStats::getGapMax() const {
+    quint32 m = 0;
+    for (int i = 0; i < gapCount; i++) {
+        if (gaps[i] > m) {
+            m = gaps[i];
+        }
+    }
+    return m;
+}
+
+qint64 ArrivalStats::getGapPercentile(double quantile) const {
+    if (gapCount == 0) {
+        return 0;
+    }
+
+    // only done on export, the ring is small
+    quint32 sorted[ARRIVALSTATS_GAPS];
+    std::copy(gaps, gaps + gapCount, sorted);
+
+    int k = (int) (quantile * (double) (gapCount - 1) + 0.5);
+    std::nth_element(sorted, sorted + k, sorted + gapCount);
+    return sorted[k];
+}
+
+QVariantMap ArrivalStats::toVariantMap(qint64 now) const {
+    QVariantMap m;
+    m.insert("count", (double) count);
+    m.insert("rate", getRate(now));
+    m.insert("gapMin", getGapMin() / 1000.0);
+    m.insert("gapMax", getGapMax() / 1000.0);
+    m.insert("gapP99", getGapPercentile(0.99) / 1000.0);
+    m.insert("sidMissed", (double) sidMissed);
+    m.insert("sidDuplicates", (double) sidDuplicates);
+    return m;
+}
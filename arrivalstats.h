@@ -0,0 +1,58 @@
+#ifndef ARRIVALSTATS_H
+#define ARRIVALSTATS_H
+
+#include <QtGlobal>
+#include <QVariantMap>
+
+// number of recent inter-arrival gaps kept per stream
+#define ARRIVALSTATS_GAPS 128
+
+// NMEA 2000 sequence ids run from 0 to 252, 253-255 mean "not available"
+#define ARRIVALSTATS_SID_MODULO 253
+
+// Rolling arrival statistics of one message stream in fixed memory.
+// Timestamps are usec, CLOCK_MONOTONIC like the frame timestamps.
+class ArrivalStats
+{
+public:
+    ArrivalStats();
+
+    void reset();
+
+    // sid < 0 if the message has none
+    void record(qint64 timestamp, int sid = -1);
+
+    quint64 getCount() const { return count; }
+    qint64 getLastTimestamp() const { return lastTimestamp; }
+
+    // messages per second over the recent gaps, decays when the stream stops
+    double getRate(qint64 now) const;
+
+    // over the recent gaps, usec, 0 without data
+    qint64 getGapMin() const;
+    qint64 getGapMax() const;
+    qint64 getGapPercentile(double quantile) const;
+
+    // sequence ids skipped / repeated since reset
+    quint64 getSidMissed() const { return sidMissed; }
+    quint64 getSidDuplicates() const { return sidDuplicates; }
+
+    // summary for QML and MQTT, gaps in msec
+    QVariantMap toVariantMap(qint64 now) const;
+
+private:
+    quint64 count;
+    qint64 lastTimestamp;
+
+    quint32 gaps[ARRIVALSTATS_GAPS];
+    int gapHead;
+    int gapCount;
+    quint64 gapSum;
+
+    int lastSid;
+    quint64 sidMissed;
+    quint64 sidDuplicates;
+
+};
+
+#endif // ARRIVALSTATS_H
@@ -0,0 +1,21 @@
+QT += core quick
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = MeteoBench
+
+include(../meteocore.pri)
+
+SOURCES += meteobench.cpp \
+    ../canreplay.cpp \
+    ../meteobinding.cpp
+
+HEADERS += \
+    ../canreplay.h \
+    ../meteobinding.h
+
+# fixed frame log for the replay check
+DEFINES += METEOBENCH_REPLAY_LOG=\\\"$$PWD/replay-regress.log\\\"
+
+DEFINES += QT_DEPRECATED_WARNINGS
@@ -0,0 +1,475 @@
+#include <QCoreApplication>
+
+#include <functional>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "cansource.h"
+#include "canreplay.h"
+#include "n2kparser.h"
+#include "meteocollector.h"
+#include "meteobinding.h"
+#include "mqttclient.h"
+#include "mqttsender.h"
+#include "archiveuploader.h"
+#include "historypyramid.h"
+#include "meteostore.h"
+
+#include <QDir>
+#include <QEventLoop>
+
+// Hot path microbenchmarks with synthetic data, no CAN interface or broker needed.
+// Prints one JSON object per benchmark to stdout (or --json=<file>), a summary to stderr.
+// Before that a fixed candump log is replayed through parser and collector and the
+// results are checked, a mismatch exits with 1 (--check runs only this).
+
+#define OPS_PER_RUN 1024
+#define BATCH_SIZE 32
+#define WIND_PERIOD_MS 100
+
+// count heap allocations by wrapping the glibc allocator
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+static bool countAllocs = false;
+static quint64 allocCount = 0;
+
+void *malloc(size_t size) {
+    if (countAllocs) {
+        allocCount++;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    if (countAllocs) {
+        allocCount++;
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (countAllocs) {
+        allocCount++;
+    }
+    return __libc_realloc(ptr, size);
+}
+}
+
+static FILE *jsonOut = stdout;
+static qint64 minTimeNs = 200000000LL;
+
+static qint64 nowNs() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (qint64) tp.tv_sec * 1000000000LL + (qint64) tp.tv_nsec;
+}
+
+static void runBench(const char *name, int opsPerRun, std::function<void()> body) {
+    // warm up caches and lazily allocated state
+    body();
+
+    qint64 elapsed = 0;
+    quint64 ops = 0;
+    quint64 allocs = 0;
+    while (elapsed < minTimeNs) {
+        allocCount = 0;
+        countAllocs = true;
+        qint64 start = nowNs();
+        body();
+        qint64 end = nowNs();
+        countAllocs = false;
+
+        elapsed += end - start;
+        ops += opsPerRun;
+        allocs += allocCount;
+    }
+
+    double nsPerOp = (double) elapsed / (double) ops;
+    double allocsPerOp = (double) allocs / (double) ops;
+
+    fprintf(jsonOut, "{\"name\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.1f,\"ops_per_sec\":%.0f,\"allocs_per_op\":%.3f}\n",
+            name, (unsigned long long) ops, nsPerOp, 1e9 / nsPerOp, allocsPerOp);
+    fprintf(stderr, "%-28s %10.1f ns/op %12.0f op/s %8.3f allocs/op\n",
+            name, nsPerOp, 1e9 / nsPerOp, allocsPerOp);
+}
+
+// feeds prepared frames like CanReceiver does
+class BenchSource : public CanSource
+{
+public:
+    int setPgnFilter(const QVector<quint32> &pgns) {
+        Q_UNUSED(pgns);
+        return 0;
+    }
+
+    void feed(const CanFrame *frames, int count) {
+        for (int i = 0; i < count; i += BATCH_SIZE) {
+            emit receivedBatch(&frames[i], (count - i < BATCH_SIZE) ? count - i : BATCH_SIZE);
+        }
+    }
+};
+
+static void setFrame(CanFrame *frame, quint32 pgn, quint8 source, const quint8 *data, int len) {
+    frame->id = (2 << 26) | (pgn << 8) | source;
+    frame->flags = CAN_FRAME_FLAG_EFF;
+    frame->dlc = len;
+    memset(frame->data, 0xff, sizeof(frame->data));
+    memcpy(frame->data, data, len);
+    frame->timestamp = 0;
+}
+
+static void putShort(quint8 *d, quint16 v) {
+    d[0] = v & 0xff;
+    d[1] = v >> 8;
+}
+
+static void putLong(quint8 *d, quint32 v) {
+    putShort(d, v & 0xffff);
+    putShort(d + 2, v >> 16);
+}
+
+// single frame messages of one PGN with varying values
+static void makeFrames(QVector<CanFrame> &frames, quint32 pgn) {
+    frames.resize(OPS_PER_RUN);
+    for (int i = 0; i < OPS_PER_RUN; i++) {
+        quint8 d[8];
+        memset(d, 0xff, sizeof(d));
+        d[0] = i & 0xff;
+
+        switch (pgn) {
+        case 130306:
+            putShort(&d[1], 500 + (rand() % 1000));
+            putShort(&d[3], rand() % 62831);
+            d[5] = 0xfa;
+            break;
+        case 130311:
+            d[1] = 0x41;
+            putShort(&d[2], 29315 + (rand() % 500));
+            putShort(&d[4], 15000);
+            putShort(&d[6], 1013);
+            break;
+        case 130312:
+            d[1] = 0;
+            d[2] = 1;
+            putShort(&d[3], 29315 + (rand() % 500));
+            break;
+        case 130314:
+            d[1] = 0;
+            d[2] = 0;
+            putLong(&d[3], 1013250 + (rand() % 1000));
+            break;
+        default:
+            break;
+        }
+
+        setFrame(&frames[i], pgn, 0x23, d, 8);
+    }
+}
+
+// 130323 Meteorological Station Data split into fast-packet frames
+static void makeMeteoStationFrames(QVector<CanFrame> &frames) {
+    frames.resize(OPS_PER_RUN);
+
+    quint8 msg[40];
+    memset(msg, 0xff, sizeof(msg));
+    int len = 28;
+
+    int n = 0;
+    int seq = 0;
+    while (n < OPS_PER_RUN) {
+        msg[0] = 0xf0;
+        putShort(&msg[15], 500 + (rand() % 1000));
+        putShort(&msg[17], rand() % 62831);
+        msg[19] = 0xfa;
+
+        int sent = 0;
+        for (int frame = 0; sent < len && n < OPS_PER_RUN; frame++) {
+            quint8 d[8];
+            memset(d, 0xff, sizeof(d));
+            d[0] = (seq << 5) | frame;
+            if (frame == 0) {
+                d[1] = len;
+                memcpy(&d[2], msg, 6);
+                sent = 6;
+            } else {
+                int k = (len - sent < 7) ? len - sent : 7;
+                memcpy(&d[1], &msg[sent], k);
+                sent += k;
+            }
+            setFrame(&frames[n++], 130323, 0x23, d, 8);
+        }
+        seq = (seq + 1) & 7;
+    }
+}
+
+static bool checkValue(const char *name, double value, double expected, double tolerance) {
+    if (fabs(value - expected) <= tolerance) {
+        return true;
+    }
+    fprintf(stderr, "replay check failed: %s is %.6f, expected %.6f\n", name, value, expected);
+    return false;
+}
+
+// 400 s of wind at 1 Hz (velo 5.00 m/s, dir alternating 80/100 deg, gusts of 12.34 m/s
+// at 10-11 s and 9.87 m/s at 200-201 s) and pressure every 10 s rising by 0.04 hPa
+static bool checkReplay() {
+    CanReplay replay;
+    if (replay.open(METEOBENCH_REPLAY_LOG) != CANREPLAY_ERR_OK) {
+        fprintf(stderr, "unable to open %s\n", METEOBENCH_REPLAY_LOG);
+        return false;
+    }
+    replay.setSpeed(0.0);
+
+    N2kParser parser(&replay);
+    MeteoCollector collector(&parser, 0.0, 0.0);
+    collector.setClock(replay.getClock());
+
+    QEventLoop loop;
+    QObject::connect(&replay, SIGNAL(finished()), &loop, SLOT(quit()));
+    replay.start();
+    loop.exec();
+
+    bool ok = checkValue("frames", (double) replay.getFrameCount(), 440.0, 0.0);
+    // last sample, 5.00 m/s at 17453e-4 rad
+    ok &= checkValue("windVelo", collector.getWindVelo(), 9.7192225, 1e-6);
+    ok &= checkValue("windDir", collector.getWindDir(), 99.998324, 1e-5);
+    // 100-399 s in the window, pairs of equal velocity around 1.5708 rad
+    ok &= checkValue("windDirAvg", collector.getWindDirAvg(), 90.000210, 1e-5);
+    // first gust expired, second one is the peak
+    ok &= checkValue("windVeloPeak", collector.getWindVeloPeak(), 19.185745, 1e-5);
+    ok &= checkValue("airPress", collector.getAirPress(), 1011.560, 1e-6);
+    // 0.62 hPa within the 5 minute step
+    ok &= checkValue("airPressTrend", collector.getAirPressTrend(), MeteoCollector::Rising, 0.0);
+    ok &= checkValue("windArrivals", (double) collector.getWindArrivals().getCount(), 400.0, 0.0);
+
+    fprintf(stderr, "%-28s %s\n", "replay/check", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static void benchParser(BenchSource &source, const char *name, QVector<CanFrame> &frames, qint64 &timestamp) {
+    runBench(name, frames.size(), [&]() {
+        // keep time moving forward for the collector windows
+        for (int i = 0; i < frames.size(); i++) {
+            frames[i].timestamp = timestamp * 1000LL;
+            timestamp += WIND_PERIOD_MS;
+        }
+        source.feed(frames.constData(), frames.size());
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    bool checkOnly = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) {
+            jsonOut = fopen(argv[i] + 7, "w");
+            if (jsonOut == NULL) {
+                fprintf(stderr, "unable to open %s\n", argv[i] + 7);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+            minTimeNs = atoll(argv[i] + 11) * 1000000LL;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            checkOnly = true;
+        } else {
+            fprintf(stderr, "usage: MeteoBench [--json=<file>] [--min-time=<msec per benchmark>] [--check]\n");
+            return 1;
+        }
+    }
+
+    // numbers of a broken pipeline are worthless
+    if (!checkReplay()) {
+        return 1;
+    }
+    if (checkOnly) {
+        return 0;
+    }
+
+    srand(1);
+
+    ReplayClock clock;
+    BenchSource source;
+    N2kParser parser(&source);
+    MeteoCollector collector(&parser, 0.0, 0.0);
+    collector.setClock(&clock);
+    MeteoBinding binding(&collector, 0.0);
+    MqttClient mqtt("bench");
+    MqttSender sender(&mqtt, &collector);
+    ArchiveUploader archive(&mqtt, &collector);
+
+    // parser throughput per PGN, including the connected collector/binding/sender slots
+    qint64 timestamp = 1000000;
+    QVector<CanFrame> frames;
+
+    makeFrames(frames, 130306);
+    benchParser(source, "parser/130306", frames, timestamp);
+    makeFrames(frames, 130311);
+    benchParser(source, "parser/130311", frames, timestamp);
+    makeFrames(frames, 130312);
+    benchParser(source, "parser/130312", frames, timestamp);
+    makeFrames(frames, 130314);
+    benchParser(source, "parser/130314", frames, timestamp);
+    makeMeteoStationFrames(frames);
+    benchParser(source, "parser/130323-fast", frames, timestamp);
+    makeFrames(frames, 127488);
+    benchParser(source, "parser/unknown", frames, timestamp);
+
+    // wind window with 5 minutes of 10 Hz samples
+    for (int i = 0; i < 5 * 60 * 1000 / WIND_PERIOD_MS; i++) {
+        emit parser.receivedWindData(timestamp, 0, N2K_WIND_REF_APPARENT, 5.0 + (rand() % 100) * 0.1, (rand() % 62831) * 0.0001);
+        timestamp += WIND_PERIOD_MS;
+    }
+    runBench("collector/wind-5min", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            emit parser.receivedWindData(timestamp, 0, N2K_WIND_REF_APPARENT, 5.0 + (i % 100) * 0.1, (i % 628) * 0.01);
+            timestamp += WIND_PERIOD_MS;
+        }
+    });
+
+    // pressure trend over one hour in 5 minute steps
+    QQueue<MeteoAirPressTrendItem> trendQueue;
+    for (int i = 0; i < 12; i++) {
+        MeteoAirPressTrendItem item;
+        item.timestamp = i * 5LL * 60LL * 1000LL;
+        item.press = 1013.0 + sin(i * 0.5) * 0.8;
+        trendQueue.enqueue(item);
+    }
+    volatile int trendSink = 0;
+    runBench("collector/calculateTrend", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            trendSink += collector.calculateTrend(trendQueue);
+        }
+    });
+
+    // payload formatting, mqtt is never connected
+    emit parser.receivedTemperature(timestamp, 0, 0, N2K_TEMP_SRC_OUTSIDE, 21.5, 0.0);
+    emit parser.receivedActualPressure(timestamp, 0, 0, N2K_PRESS_SRC_ATMOSPHERIC, 1013.25);
+    volatile int payloadSink = 0;
+    runBench("sender/format-wind", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            payloadSink += sender.formatWind().size();
+        }
+    });
+    runBench("sender/format-press", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            payloadSink += sender.formatAirPress().size();
+        }
+    });
+    runBench("sender/format-temp", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            payloadSink += sender.formatAirTemp().size();
+        }
+    });
+    // what the publish path uses, into reused buffers
+    char jsonBuf[MQTTSENDER_JSON_SIZE];
+    quint8 binaryBuf[MQTTSENDER_BINARY_SIZE];
+    runBench("sender/format-wind-json", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            payloadSink += sender.formatJson(MqttSender::Wind, jsonBuf, sizeof(jsonBuf));
+        }
+    });
+    runBench("sender/format-wind-binary", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            payloadSink += sender.formatBinary(MqttSender::Wind, binaryBuf, sizeof(binaryBuf));
+        }
+    });
+
+    // archive block of one minute of 10 Hz wind
+    archive.setInterval(3600);
+    for (int i = 0; i < 600; i++) {
+        emit parser.receivedWindData(timestamp + i * 100, i % 253, N2K_WIND_REF_APPARENT, 5.0 + 0.01 * (i % 37), 1.0 + 0.001 * (i % 53));
+    }
+    QByteArray archiveBlock;
+    volatile int archiveSink = 0;
+    runBench("archive/encode-wind-600", 1, [&]() {
+        archiveSink += archive.encodeBlock(ArchiveUploader::Wind, &archiveBlock);
+    });
+    archive.setInterval(0);
+
+    // history of 24 h wind direction at 10 Hz, then a chart of the full day
+    HistoryPyramid history(true);
+    qint64 historyTime = 0;
+    runBench("history/add", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            history.add(historyTime, (double) ((historyTime / 100) % 360));
+            historyTime += WIND_PERIOD_MS;
+        }
+    });
+    while (historyTime < 24LL * 3600LL * 1000LL) {
+        history.add(historyTime, (double) ((historyTime / 100) % 360));
+        historyTime += WIND_PERIOD_MS;
+    }
+    QVector<HistoryPoint> historyPoints;
+    runBench("history/query-24h-500", 1, [&]() {
+        history.query(historyTime - 24LL * 3600LL * 1000LL, historyTime, 500, &historyPoints);
+    });
+
+    // binding filter step with valid wind data, new data whenever the filter has settled
+    timestamp += 60000;
+    clock.advance(timestamp);
+    int windFlip = 0;
+    quint64 frameSteps = 0;
+    quint64 notifyStart = binding.getNotifyCount();
+    runBench("binding/frame", OPS_PER_RUN, [&]() {
+        for (int i = 0; i < OPS_PER_RUN; i++) {
+            if (!binding.isFiltering()) {
+                windFlip ^= 1;
+                emit parser.receivedWindData(timestamp, 0, N2K_WIND_REF_APPARENT, 5.0 + windFlip, 1.0 + windFlip);
+            }
+            binding.frame();
+        }
+        frameSteps += OPS_PER_RUN;
+    });
+    // property notifications, i.e. QML binding updates, per filter step
+    fprintf(stderr, "%-28s %10.3f notify/op\n", "binding/frame",
+            (double) (binding.getNotifyCount() - notifyStart) / frameSteps);
+
+    // store with a month of 1 Hz wind, the chart of the month from the minute summaries
+    // and of one hour from the records; moves the clock, keep it last
+    char storeDir[] = "/tmp/meteobench-XXXXXX";
+    if (mkdtemp(storeDir) != NULL) {
+        qint64 storeEnd = 31LL * STORESEGMENT_DAY_MS;
+        clock.advance(storeEnd);
+        MeteoStore store(&mqtt, &collector);
+        store.open(storeDir);
+        for (qint64 day = 0; day < storeEnd; day += STORESEGMENT_DAY_MS) {
+            StoreSegment segment;
+            store.createSegment(MeteoStore::WindStream, day, &segment);
+            for (qint64 t = day; t < day + STORESEGMENT_DAY_MS; t += METEOSTORE_DEFAULT_INTERVAL) {
+                int i = (int) ((t - day) / METEOSTORE_DEFAULT_INTERVAL);
+                StoreRecord r;
+                r.timestamp = t;
+                r.values[0] = (float) (5.0 + (i % 97) * 0.1);
+                r.values[1] = (float) (i % 360);
+                segment.append(r);
+            }
+        }
+        // finds the new segments
+        store.open(storeDir);
+
+        QVector<HistoryPoint> storePoints;
+        runBench("store/query-31d-500", 1, [&]() {
+            store.query(MeteoStore::WindVelo, 0, storeEnd, 500, &storePoints);
+        });
+        runBench("store/query-1h-500", 1, [&]() {
+            store.query(MeteoStore::WindDir, storeEnd - 3600000LL, storeEnd, 500, &storePoints);
+        });
+
+        QDir(storeDir).removeRecursively();
+    }
+
+    if (jsonOut != stdout) {
+        fclose(jsonOut);
+    }
+
+    return 0;
+}
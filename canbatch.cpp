@@ -0,0 +1,147 @@
+#include "canbatch.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/can.h>
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+// room for SCM_TIMESTAMPNS and SO_RXQ_OVFL
+#define CONTROL_LEN (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(quint32)))
+
+#define NSEC_PER_SEC 1000000000LL
+
+static qint64 clockNsec(clockid_t clock) {
+    struct timespec tp;
+    clock_gettime(clock, &tp);
+    return (qint64) tp.tv_sec * NSEC_PER_SEC + (qint64) tp.tv_nsec;
+}
+
+CanBatch::CanBatch(int size) : size(size)
+{
+    rawFrames = new struct can_frame[size];
+    frames = new CanFrame[size];
+    msgs = new struct mmsghdr[size];
+    iovs = new struct iovec[size];
+    controls = new char[size * CONTROL_LEN];
+    batchHistogram = new std::atomic<quint64>[size + 1];
+
+    // the message headers always point to the same frame buffers
+    memset(msgs, 0, sizeof(struct mmsghdr) * size);
+    for (int i = 0; i < size; i++) {
+        iovs[i].iov_base = &rawFrames[i];
+        iovs[i].iov_len = sizeof(struct can_frame);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = &controls[i * CONTROL_LEN];
+    }
+
+    // drops are counted from socket creation, not from reset
+    lastDropCounter = 0;
+    dropCount.store(0, std::memory_order_relaxed);
+
+    resetStats();
+}
+
+CanBatch::~CanBatch()
+{
+    delete[] rawFrames;
+    delete[] frames;
+    delete[] msgs;
+    delete[] iovs;
+    delete[] controls;
+    delete[] batchHistogram;
+}
+
+void CanBatch::resetStats() {
+    wakeupCount.store(0, std::memory_order_relaxed);
+    frameCount.store(0, std::memory_order_relaxed);
+    maxFramesPerWakeup.store(0, std::memory_order_relaxed);
+    for (int i = 0; i <= size; i++) {
+        batchHistogram[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+quint64 CanBatch::getBatchHistogram(int count) {
+    if (count < 0 || count > size) {
+        return 0;
+    }
+    return batchHistogram[count].load(std::memory_order_relaxed);
+}
+
+int CanBatch::receive(int fd) {
+    // kernel shrinks the control length to what it used
+    for (int i = 0; i < size; i++) {
+        msgs[i].msg_hdr.msg_controllen = CONTROL_LEN;
+    }
+
+    int n = recvmmsg(fd, msgs, size, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+        return -1;
+    }
+
+    // kernel stamps are CLOCK_REALTIME, move them to CLOCK_MONOTONIC
+    qint64 monoNow = clockNsec(CLOCK_MONOTONIC);
+    qint64 realToMono = monoNow - clockNsec(CLOCK_REALTIME);
+
+    // drop short reads
+    int count = 0;
+    quint32 dropCounter = lastDropCounter;
+    for (int i = 0; i < n; i++) {
+        if (msgs[i].msg_len != sizeof(struct can_frame)) {
+            continue;
+        }
+
+        qint64 ts = monoNow;
+        struct cmsghdr *cmsg;
+        for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                struct timespec tp;
+                memcpy(&tp, CMSG_DATA(cmsg), sizeof(tp));
+                ts = (qint64) tp.tv_sec * NSEC_PER_SEC + (qint64) tp.tv_nsec + realToMono;
+            } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                memcpy(&dropCounter, CMSG_DATA(cmsg), sizeof(dropCounter));
+            }
+        }
+
+        const struct can_frame &raw = rawFrames[i];
+        CanFrame &frame = frames[count++];
+
+        frame.flags = 0;
+        if (raw.can_id & CAN_EFF_FLAG) {
+            frame.flags |= CAN_FRAME_FLAG_EFF;
+        }
+        if (raw.can_id & CAN_RTR_FLAG) {
+            frame.flags |= CAN_FRAME_FLAG_RTR;
+        }
+        if (raw.can_id & CAN_ERR_FLAG) {
+            frame.flags |= CAN_FRAME_FLAG_ERR;
+        }
+        frame.id = raw.can_id & ((raw.can_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+        frame.dlc = (raw.can_dlc > 8) ? 8 : raw.can_dlc;
+        memcpy(frame.data, raw.data, sizeof(frame.data));
+        frame.timestamp = ts / 1000LL;
+    }
+
+    // update statistics, only the receiving thread writes
+    wakeupCount.fetch_add(1, std::memory_order_relaxed);
+    frameCount.fetch_add(count, std::memory_order_relaxed);
+    if (count > maxFramesPerWakeup.load(std::memory_order_relaxed)) {
+        maxFramesPerWakeup.store(count, std::memory_order_relaxed);
+    }
+    batchHistogram[count].fetch_add(1, std::memory_order_relaxed);
+
+    // cumulative and wrapping, unsigned difference handles the wrap
+    if (dropCounter != lastDropCounter) {
+        dropCount.fetch_add((quint32) (dropCounter - lastDropCounter), std::memory_order_relaxed);
+        lastDropCounter = dropCounter;
+    }
+
+    return count;
+}
@@ -0,0 +1,56 @@
+#ifndef CANBATCH_H
+#define CANBATCH_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+#include "canframe.h"
+
+struct can_frame;
+struct mmsghdr;
+struct iovec;
+
+// Preallocated recvmmsg() buffers for one SocketCAN socket plus receive statistics.
+// Statistics may be read from other threads than the one calling receive().
+class CanBatch
+{
+public:
+    explicit CanBatch(int size);
+    ~CanBatch();
+
+    int getSize() { return size; }
+
+    // fetch up to getSize() frames without blocking, returns frame count or -1
+    int receive(int fd);
+    const CanFrame *getFrames() { return frames; }
+
+    quint64 getWakeupCount() { return wakeupCount.load(std::memory_order_relaxed); }
+    quint64 getFrameCount() { return frameCount.load(std::memory_order_relaxed); }
+    int getMaxFramesPerWakeup() { return maxFramesPerWakeup.load(std::memory_order_relaxed); }
+    quint64 getBatchHistogram(int count);
+    // frames dropped by the kernel (SO_RXQ_OVFL) since the socket was opened
+    quint64 getDropCount() { return dropCount.load(std::memory_order_relaxed); }
+    void resetStats();
+
+private:
+    Q_DISABLE_COPY(CanBatch)
+
+    int size;
+    struct can_frame *rawFrames;
+    CanFrame *frames;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    char *controls;
+
+    std::atomic<quint64> wakeupCount;
+    std::atomic<quint64> frameCount;
+    std::atomic<int> maxFramesPerWakeup;
+    std::atomic<quint64> *batchHistogram;
+
+    // last value of the kernel's 32 bit drop counter
+    quint32 lastDropCounter;
+    std::atomic<quint64> dropCount;
+};
+
+#endif // CANBATCH_H
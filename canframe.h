@@ -0,0 +1,20 @@
+#ifndef CANFRAME_H
+#define CANFRAME_H
+
+#include <QtGlobal>
+
+#define CAN_FRAME_FLAG_EFF 0x01     // extended frame format (29 bit id)
+#define CAN_FRAME_FLAG_RTR 0x02     // remote transmission request
+#define CAN_FRAME_FLAG_ERR 0x04     // error frame
+
+// Received CAN frame, trivially copyable so batches can be passed
+// around by pointer and stored in rings without allocations.
+struct CanFrame {
+    quint32 id;             // 11 or 29 bit identifier, without flags
+    quint8 flags;           // CAN_FRAME_FLAG_*
+    quint8 dlc;             // number of valid data bytes, 0..8
+    quint8 data[8];
+    qint64 timestamp;       // receive time, CLOCK_MONOTONIC, usec
+};
+
+#endif // CANFRAME_H
@@ -0,0 +1,106 @@
+#include "canreaderthread.h"
+
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+
+CanReaderThread::CanReaderThread(int fd, int batchSize, SpscRing<CanFrame> *ring, QObject *parent) :
+    QThread(parent), fd(fd), batch(batchSize), ring(ring), socketErrorCount(0)
+{
+    notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+CanReaderThread::~CanReaderThread()
+{
+    stop();
+
+    if (notifyFd >= 0) {
+        close(notifyFd);
+    }
+    if (stopFd >= 0) {
+        close(stopFd);
+    }
+}
+
+void CanReaderThread::stop() {
+    if (!isRunning()) {
+        return;
+    }
+
+    quint64 one = 1;
+    if (write(stopFd, &one, sizeof(one)) != sizeof(one)) {
+        return;
+    }
+    wait();
+}
+
+void CanReaderThread::run() {
+    struct pollfd pfd[2];
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = stopFd;
+    pfd[1].events = POLLIN;
+
+    while (true) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        // shutdown requested
+        if (pfd[1].revents) {
+            break;
+        }
+
+        // socket closed under us, nothing left to read
+        if (pfd[0].revents & POLLNVAL) {
+            qWarning("CAN reader thread stopped, socket is no longer valid");
+            break;
+        }
+
+        // interface down or bus-off, fetching the pending error clears it and
+        // reception continues once the interface is back
+        if (pfd[0].revents & (POLLERR | POLLHUP)) {
+            int err = 0;
+            socklen_t optlen = sizeof(err);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &optlen) < 0) {
+                err = errno;
+            }
+            socketErrorCount.store(socketErrorCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            qWarning("CAN socket error: %s", strerror(err));
+
+            // no error pending but still signalled, back off instead of spinning
+            if (err == 0 && !(pfd[0].revents & POLLIN)) {
+                if (poll(&pfd[1], 1, CANREADERTHREAD_ERROR_BACKOFF) > 0) {
+                    break;
+                }
+                continue;
+            }
+        }
+
+        if (!(pfd[0].revents & POLLIN)) {
+            continue;
+        }
+
+        int n = batch.receive(fd);
+        if (n <= 0) {
+            continue;
+        }
+
+        // frames that do not fit are counted as overflow by the ring
+        ring->push(batch.getFrames(), n);
+
+        // wake up consumer, eventfd accumulates pending wakeups
+        quint64 one = 1;
+        if (write(notifyFd, &one, sizeof(one)) != sizeof(one)) {
+            continue;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef CANREADERTHREAD_H
+#define CANREADERTHREAD_H
+
+#include <QThread>
+
+#include <atomic>
+
+#include "canbatch.h"
+#include "spscring.h"
+
+// msec to wait when the socket keeps signalling without a pending error
+#define CANREADERTHREAD_ERROR_BACKOFF 100
+
+// Reads a SocketCAN fd in its own thread and queues the frames into a ring.
+// The consumer is woken through an eventfd (see getNotifyFd()).
+class CanReaderThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit CanReaderThread(int fd, int batchSize, SpscRing<CanFrame> *ring, QObject *parent = 0);
+    virtual ~CanReaderThread();
+
+    bool isValid() { return notifyFd >= 0 && stopFd >= 0; }
+    int getNotifyFd() { return notifyFd; }
+    CanBatch *getBatch() { return &batch; }
+    // socket errors (interface down, bus-off) the thread recovered from
+    quint64 getSocketErrorCount() { return socketErrorCount.load(std::memory_order_relaxed); }
+
+    void stop();
+
+protected:
+    void run();
+
+private:
+    int fd;
+    int notifyFd;
+    int stopFd;
+
+    CanBatch batch;
+    SpscRing<CanFrame> *ring;
+
+    std::atomic<quint64> socketErrorCount;
+
+};
+
+#endif // CANREADERTHREAD_H
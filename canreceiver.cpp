@@ -1,6 +1,7 @@
 #include "canreceiver.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -13,15 +14,134 @@
 #include <linux/can/raw.h>
 #include <linux/types.h>
 #include <sys/eventfd.h>
+#include <sys/socket.h>
 
-CanReceiver::CanReceiver(QObject *parent) : QObject(parent)
+#include <QTimerEvent>
+#include <QtGlobal>
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+CanReceiver::CanReceiver(QObject *parent) : CanSource(parent)
 {
     fd = -1;
     sn = NULL;
+
+    batchSize = CANRECEIVER_DEFAULT_BATCH_SIZE;
+    threaded = false;
+    ringSize = CANRECEIVER_DEFAULT_RING_SIZE;
+
+    rcvBufRequest = 0;
+    rcvBufSize = 0;
+
+    batch = NULL;
+    reader = NULL;
+    ring = NULL;
+    ringFrames = NULL;
+
+    filterEnabled = false;
+
+    trace = NULL;
+
+    dropTimer = 0;
+    lastCheckFrames = 0;
+    lastCheckDrops = 0;
+    lastCheckOverflows = 0;
+}
+
+CanReceiver::~CanReceiver()
+{
+    shutdown();
+}
+
+void CanReceiver::setBatchSize(int size) {
+    if (size < 1) {
+        size = 1;
+    }
+    if (size > CANRECEIVER_MAX_BATCH_SIZE) {
+        size = CANRECEIVER_MAX_BATCH_SIZE;
+    }
+    batchSize = size;
+}
+
+void CanReceiver::setThreaded(bool threaded, int ringSize) {
+    this->threaded = threaded;
+    this->ringSize = (ringSize < batchSize) ? batchSize : ringSize;
+}
+
+double CanReceiver::getAvgFramesPerWakeup() {
+    quint64 wakeups = getWakeupCount();
+    return wakeups > 0 ? (double) getFrameCount() / (double) wakeups : 0.0;
+}
+
+void CanReceiver::resetStats() {
+    if (batch != NULL) {
+        batch->resetStats();
+    }
+    if (ring != NULL) {
+        ring->resetStats();
+    }
+}
+
+int CanReceiver::setPgnFilter(const QVector<quint32> &pgns) {
+    filterEnabled = true;
+    filterPgns = pgns;
+    return applyFilter();
+}
+
+int CanReceiver::clearPgnFilter() {
+    filterEnabled = false;
+    filterPgns.clear();
+    return applyFilter();
+}
+
+int CanReceiver::applyFilter() {
+    if (fd < 0) {
+        return CANRECEIVER_ERR_OK;
+    }
+
+    // no filter set: kernel default, receive everything
+    if (!filterEnabled) {
+        struct can_filter all;
+        all.can_id = 0;
+        all.can_mask = 0;
+        if (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, &all, sizeof(all)) < 0) {
+            return CANRECEIVER_ERR_SET_FILTER;
+        }
+        return CANRECEIVER_ERR_OK;
+    }
+
+    QVector<struct can_filter> filters(filterPgns.size());
+    for (int i = 0; i < filterPgns.size(); i++) {
+        quint32 pgn = filterPgns[i] & 0x3ffff;
+        quint32 mask = 0x3ffff;
+
+        // PDU1 format (PF < 240): PS field holds the destination address
+        if (((pgn >> 8) & 0xff) < 240) {
+            pgn &= 0x3ff00;
+            mask = 0x3ff00;
+        }
+
+        // only extended data frames, ignore priority and source address
+        filters[i].can_id = (pgn << 8) | CAN_EFF_FLAG;
+        filters[i].can_mask = (mask << 8) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    }
+
+    // an empty list disables reception completely
+    if (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER,
+                   filters.isEmpty() ? NULL : filters.constData(),
+                   sizeof(struct can_filter) * filters.size()) < 0) {
+        return CANRECEIVER_ERR_SET_FILTER;
+    }
+
+    return CANRECEIVER_ERR_OK;
 }
 
 int CanReceiver::startup(const QString &interface) {
     int err = CANRECEIVER_ERR_OK;
+    int enable = 1;
+    socklen_t optlen;
 
     if (fd >= 0) {
         err = CANRECEIVER_ERR_ALREADY_OPEN;
@@ -42,6 +162,37 @@ int CanReceiver::startup(const QString &interface) {
         goto fail1;
     }
 
+    // install kernel side filter
+    if (applyFilter() != CANRECEIVER_ERR_OK) {
+        err = CANRECEIVER_ERR_SET_FILTER;
+        goto fail1;
+    }
+
+    // request kernel receive timestamps, frames are stamped at
+    // delivery time if this is not supported
+    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+
+    // request the kernel drop counter with every frame
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+    // receive buffer, SO_RCVBUFFORCE may exceed rmem_max but needs CAP_NET_ADMIN
+    if (rcvBufRequest > 0) {
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvBufRequest, sizeof(rcvBufRequest)) < 0 &&
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBufRequest, sizeof(rcvBufRequest)) < 0) {
+            err = CANRECEIVER_ERR_SET_RCVBUF;
+            goto fail1;
+        }
+    }
+    // the kernel doubles the value for bookkeeping overhead, report what was granted
+    optlen = sizeof(rcvBufSize);
+    if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBufSize, &optlen) < 0) {
+        rcvBufSize = 0;
+    }
+    rcvBufSize /= 2;
+    if (rcvBufRequest > 0 && rcvBufSize < rcvBufRequest) {
+        qWarning("CAN receive buffer limited to %d bytes (requested %d), raise net.core.rmem_max", rcvBufSize, rcvBufRequest);
+    }
+
     // bind to socket
     struct sockaddr_can addr;
     addr.can_family = AF_CAN;
@@ -51,16 +202,50 @@ int CanReceiver::startup(const QString &interface) {
         goto fail1;
     }
 
-    // create Socket Notitication
-    sn = new QSocketNotifier(fd, QSocketNotifier::Read);
-    connect(sn, SIGNAL(activated(int)), this, SLOT(readyRead(int)));
+    if (threaded) {
+        // reader thread owns the socket, we get woken up through its eventfd
+        ring = new SpscRing<CanFrame>(ringSize);
+        ringFrames = new CanFrame[batchSize];
+        reader = new CanReaderThread(fd, batchSize, ring);
+        if (!reader->isValid()) {
+            err = CANRECEIVER_ERR_START_THREAD;
+            goto fail2;
+        }
+        batch = reader->getBatch();
+
+        sn = new QSocketNotifier(reader->getNotifyFd(), QSocketNotifier::Read);
+        connect(sn, SIGNAL(activated(int)), this, SLOT(ringReady(int)));
+
+        reader->start(QThread::TimeCriticalPriority);
+    } else {
+        // preallocate receive batch
+        batch = new CanBatch(batchSize);
+
+        // create Socket Notitication
+        sn = new QSocketNotifier(fd, QSocketNotifier::Read);
+        connect(sn, SIGNAL(activated(int)), this, SLOT(readyRead(int)));
+    }
+
+    // watch for dropped frames
+    lastCheckFrames = 0;
+    lastCheckDrops = 0;
+    lastCheckOverflows = 0;
+    dropTimer = startTimer(CANRECEIVER_DROP_CHECK_INTERVAL);
 
     // everything is fine
     return CANRECEIVER_ERR_OK;
 
     // error handling
+fail2:
+    delete(reader);
+    delete(ring);
+    delete[] ringFrames;
+    reader = NULL;
+    ring = NULL;
+    ringFrames = NULL;
 fail1:
     close(fd);
+    fd = -1;
 fail0:
     return err;
 }
@@ -72,30 +257,114 @@ void CanReceiver::shutdown() {
     }
 
     delete(sn);
+
+    killTimer(dropTimer);
+    dropTimer = 0;
+
+    if (reader != NULL) {
+        // stop thread before the socket is closed, batch belongs to it
+        reader->stop();
+        delete(reader);
+        delete(ring);
+        delete[] ringFrames;
+    } else {
+        delete(batch);
+    }
+
     close(fd);
 
     fd = -1;
     sn = NULL;
+    batch = NULL;
+    reader = NULL;
+    ring = NULL;
+    ringFrames = NULL;
 }
 
 void CanReceiver::readyRead(int socket) {
-    struct can_frame rcvd_frame;
-    ssize_t n = read(socket, &rcvd_frame, sizeof(rcvd_frame));
+    int count = batch->receive(socket);
+    if (count > 0) {
+        traceBatch(batch->getFrames(), count);
+        emit receivedBatch(batch->getFrames(), count);
+    }
+}
+
+void CanReceiver::ringReady(int notifyFd) {
+    // acknowledge wakeup(s)
+    quint64 val;
+    if (read(notifyFd, &val, sizeof(val)) != sizeof(val)) {
+        return;
+    }
+
+    // drain everything that is queued
+    while (true) {
+        int count = ring->pop(ringFrames, batchSize);
+        if (count <= 0) {
+            break;
+        }
+        traceBatch(ringFrames, count);
+        emit receivedBatch(ringFrames, count);
+    }
+}
+
+void CanReceiver::registerMetrics(MetricsRegistry *metrics) {
+    metrics->addCounter("meteo_can_wakeups_total", "Socket wakeups with at least one frame", QString(), &wakeupCounter);
+    metrics->addCounter("meteo_can_frames_total", "CAN frames read from the socket", QString(), &frameCounter);
+    metrics->addCounter("meteo_can_ring_overflow_total", "Frames dropped because the reader ring was full", QString(), &ringOverflowCounter);
+    metrics->addCounter("meteo_can_kernel_drops_total", "Frames dropped by the kernel, socket receive queue full", QString(), &dropCounter);
+    metrics->addCounter("meteo_can_socket_errors_total", "Socket errors (interface down, bus-off) in the reader thread", QString(), &socketErrorCounter);
+    metrics->addGauge("meteo_can_ring_high_water", "Max. frames queued in the reader ring", QString(), &ringHighWaterGauge);
+    metrics->addGauge("meteo_can_rcvbuf_bytes", "Socket receive buffer size granted by the kernel", QString(), &rcvBufGauge);
+
+    connect(metrics, &MetricsRegistry::collect, this, &CanReceiver::collectMetrics, Qt::DirectConnection);
+}
+
+void CanReceiver::collectMetrics() {
+    wakeupCounter.set(getWakeupCount());
+    frameCounter.set(getFrameCount());
+    ringOverflowCounter.set(getRingOverflowCount());
+    dropCounter.set(getDropCount());
+    socketErrorCounter.set(getSocketErrorCount());
+    ringHighWaterGauge.set(getRingHighWater());
+    rcvBufGauge.set(rcvBufSize);
+}
 
-    if (n != sizeof(struct can_frame)) {
+void CanReceiver::timerEvent(QTimerEvent *event) {
+    if (event->timerId() != dropTimer) {
         return;
     }
 
-    // get flags
-    bool isEff = (rcvd_frame.can_id & CAN_EFF_FLAG);
-    bool isRtr = (rcvd_frame.can_id & CAN_RTR_FLAG);
-    bool isErr = (rcvd_frame.can_id & CAN_ERR_FLAG);
+    quint64 frames = getFrameCount();
+    quint64 drops = getDropCount();
+    quint64 overflows = getRingOverflowCount();
+
+    // stats may have been reset in between
+    quint64 newFrames = (frames >= lastCheckFrames) ? frames - lastCheckFrames : frames;
+    quint64 newOverflows = (overflows >= lastCheckOverflows) ? overflows - lastCheckOverflows : overflows;
+    quint64 newDrops = drops - lastCheckDrops;
+
+    if (newDrops > 0 || newOverflows > 0) {
+        double seconds = CANRECEIVER_DROP_CHECK_INTERVAL / 1000.0;
+        qWarning("CAN frames lost in the last %.0f s: %llu by kernel, %llu by reader ring at %.0f frames/s (rcvbuf %d bytes, batch %d)",
+                 seconds,
+                 (unsigned long long) newDrops,
+                 (unsigned long long) newOverflows,
+                 (double) newFrames / seconds,
+                 rcvBufSize,
+                 batchSize);
+    }
 
-    // get can id
-    quint32 canId = rcvd_frame.can_id & (isEff ? CAN_EFF_MASK : CAN_SFF_MASK);
+    lastCheckFrames = frames;
+    lastCheckDrops = drops;
+    lastCheckOverflows = overflows;
+}
 
-    // get data
-    QByteArray data = QByteArray((const char *)rcvd_frame.data, rcvd_frame.can_dlc);
+void CanReceiver::traceBatch(const CanFrame *frames, int count) {
+    if (trace == NULL) {
+        return;
+    }
 
-    emit received(isEff, isRtr, isErr, canId, data);
+    for (int i = 0; i < count; i++) {
+        trace->record(LATENCY_STAGE_RECEIVE, frames[i].timestamp);
+    }
 }
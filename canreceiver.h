@@ -2,32 +2,135 @@
 #define CANRECEIVER_H
 
 #include <QObject>
+#include <QVector>
 #include <QSocketNotifier>
 
+#include "cansource.h"
+#include "canbatch.h"
+#include "canreaderthread.h"
+#include "spscring.h"
+#include "latencytrace.h"
+#include "metricsregistry.h"
+
 #define CANRECEIVER_ERR_OK             0
 #define CANRECEIVER_ERR_ALREADY_OPEN  -1
 #define CANRECEIVER_ERR_CREATE_SOCKET -2
 #define CANRECEIVER_ERR_SET_IFACE     -3
 #define CANRECEIVER_ERR_BIND          -4
+#define CANRECEIVER_ERR_SET_FILTER    -5
+#define CANRECEIVER_ERR_START_THREAD  -6
+#define CANRECEIVER_ERR_SET_RCVBUF    -7
+
+#define CANRECEIVER_DEFAULT_BATCH_SIZE 32
+#define CANRECEIVER_MAX_BATCH_SIZE     1024
+#define CANRECEIVER_DEFAULT_RING_SIZE  4096
+
+// msec between checks for dropped frames
+#define CANRECEIVER_DROP_CHECK_INTERVAL 5000
 
-class CanReceiver : public QObject
+class CanReceiver : public CanSource
 {
     Q_OBJECT
 public:
     explicit CanReceiver(QObject *parent = 0);
+    virtual ~CanReceiver();
 
     int startup(const QString &interface);
     void shutdown();
 
+    // max. number of frames fetched per socket activation, applied on next startup
+    void setBatchSize(int size);
+    int getBatchSize() { return batchSize; }
+
+    // read the socket in a separate thread and pass frames through a ring of the given size,
+    // applied on next startup
+    void setThreaded(bool threaded, int ringSize = CANRECEIVER_DEFAULT_RING_SIZE);
+    bool getIsThreaded() { return threaded; }
+
+    // socket receive buffer in bytes, 0 keeps the system default, applied on next startup
+    void setReceiveBufferSize(int bytes) { rcvBufRequest = bytes; }
+    // size granted, half of what the kernel reports (it doubles the value for overhead)
+    int getReceiveBufferSize() { return rcvBufSize; }
+
+    // receive statistics
+    quint64 getWakeupCount() { return batch != NULL ? batch->getWakeupCount() : 0; }
+    quint64 getFrameCount() { return batch != NULL ? batch->getFrameCount() : 0; }
+    int getMaxFramesPerWakeup() { return batch != NULL ? batch->getMaxFramesPerWakeup() : 0; }
+    double getAvgFramesPerWakeup();
+    // number of wakeups that received exactly count frames
+    quint64 getBatchHistogram(int count) { return batch != NULL ? batch->getBatchHistogram(count) : 0; }
+    // frames the kernel dropped because the socket receive queue was full
+    quint64 getDropCount() { return batch != NULL ? batch->getDropCount() : 0; }
+
+    // reader thread ring statistics
+    int getRingHighWater() { return ring != NULL ? ring->getHighWater() : 0; }
+    quint64 getRingOverflowCount() { return ring != NULL ? ring->getOverflowCount() : 0; }
+    // socket errors seen by the reader thread
+    quint64 getSocketErrorCount() { return reader != NULL ? reader->getSocketErrorCount() : 0; }
+
+    void resetStats();
+
+    bool getIsFiltered() { return filterEnabled; }
+    const QVector<quint32> &getPgnFilter() { return filterPgns; }
+
+    // applied immediately if already open
+    int setPgnFilter(const QVector<quint32> &pgns);
+    int clearPgnFilter();
+
+    // record receive latency of every frame, NULL disables
+    void setTrace(LatencyTrace *trace) { this->trace = trace; }
+
+    // export receive and reader thread statistics
+    void registerMetrics(MetricsRegistry *metrics);
+
 private:
     int fd;
     QSocketNotifier *sn;
 
-signals:
-    void received(bool isEff, bool isRtr, bool isErr, quint32 canId, const QByteArray &data);
+    int batchSize;
+    bool threaded;
+    int ringSize;
+
+    int rcvBufRequest;
+    int rcvBufSize;
+
+    // socket batch in direct mode, owned by reader thread otherwise
+    CanBatch *batch;
+
+    CanReaderThread *reader;
+    SpscRing<CanFrame> *ring;
+    CanFrame *ringFrames;
+
+    bool filterEnabled;
+    QVector<quint32> filterPgns;
+
+    LatencyTrace *trace;
+
+    // mirrored from batch and ring
+    MetricsCounter wakeupCounter;
+    MetricsCounter frameCounter;
+    MetricsCounter ringOverflowCounter;
+    MetricsCounter dropCounter;
+    MetricsCounter socketErrorCounter;
+    MetricsGauge ringHighWaterGauge;
+    MetricsGauge rcvBufGauge;
+
+    // totals at the last drop check
+    int dropTimer;
+    quint64 lastCheckFrames;
+    quint64 lastCheckDrops;
+    quint64 lastCheckOverflows;
+
+    int applyFilter();
+    void traceBatch(const CanFrame *frames, int count);
+
+protected:
+    void timerEvent(QTimerEvent *event);
 
 private slots:
     void readyRead(int socket);
+    void ringReady(int notifyFd);
+    void collectMetrics();
 
 };
 
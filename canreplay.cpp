@@ -0,0 +1,208 @@
+#include "canreplay.h"
+
+#include <stdlib.h>
+#include <ctype.h>
+
+#define LINE_LEN 256
+
+// CAN_ERR_FLAG as written into the 8 digit id by candump
+#define LOG_ERR_FLAG 0x20000000
+
+CanReplay::CanReplay(QObject *parent) : CanSource(parent)
+{
+    speed = 1.0;
+    firstTimestamp = -1;
+    frameCount = 0;
+    hasPending = false;
+    filterEnabled = false;
+
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(step()));
+}
+
+int CanReplay::open(const QString &fileName) {
+    close();
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return CANREPLAY_ERR_OPEN;
+    }
+
+    return CANREPLAY_ERR_OK;
+}
+
+void CanReplay::close() {
+    timer.stop();
+    file.close();
+
+    firstTimestamp = -1;
+    frameCount = 0;
+    hasPending = false;
+}
+
+void CanReplay::start() {
+    elapsed.start();
+    timer.start(0);
+}
+
+int CanReplay::setPgnFilter(const QVector<quint32> &pgns) {
+    filterEnabled = true;
+    filterPgns = pgns;
+    return CANREPLAY_ERR_OK;
+}
+
+// same semantics as the kernel filter installed by CanReceiver
+bool CanReplay::accept(const CanFrame &frame) {
+    if (!filterEnabled) {
+        return true;
+    }
+
+    if ((frame.flags & (CAN_FRAME_FLAG_EFF | CAN_FRAME_FLAG_RTR | CAN_FRAME_FLAG_ERR)) != CAN_FRAME_FLAG_EFF) {
+        return false;
+    }
+
+    quint32 pgn = (frame.id >> 8) & 0x3ffff;
+    for (int i = 0; i < filterPgns.size(); i++) {
+        quint32 filter = filterPgns[i] & 0x3ffff;
+        quint32 mask = 0x3ffff;
+        if (((filter >> 8) & 0xff) < 240) {
+            mask = 0x3ff00;
+        }
+        if ((pgn & mask) == (filter & mask)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// parse next line like "(1436509053.249713) can0 09FD0223#0A0B0C0D0E0F1011"
+bool CanReplay::readFrame(CanFrame *frame) {
+    char line[LINE_LEN];
+
+    while (true) {
+        if (file.readLine(line, sizeof(line)) <= 0) {
+            return false;
+        }
+
+        char *p = line;
+        if (*p++ != '(') {
+            continue;
+        }
+
+        // timestamp, fraction scaled to usec
+        qint64 sec = strtoll(p, &p, 10);
+        if (*p++ != '.') {
+            continue;
+        }
+        char *frac = p;
+        qint64 usec = strtoll(p, &p, 10);
+        for (int digits = p - frac; digits < 6; digits++) {
+            usec *= 10;
+        }
+        for (int digits = p - frac; digits > 6; digits--) {
+            usec /= 10;
+        }
+        if (*p++ != ')') {
+            continue;
+        }
+
+        // skip interface name
+        while (isspace(*p)) {
+            p++;
+        }
+        while (*p != 0 && !isspace(*p)) {
+            p++;
+        }
+        while (isspace(*p)) {
+            p++;
+        }
+
+        // id, 3 digits standard, 8 digits extended frame
+        char *idStart = p;
+        quint32 id = strtoul(p, &p, 16);
+        int idLen = p - idStart;
+        if (*p++ != '#' || idLen == 0) {
+            continue;
+        }
+
+        // CAN FD frames are not supported
+        if (*p == '#') {
+            continue;
+        }
+
+        frame->flags = 0;
+        if (idLen > 3) {
+            frame->flags |= CAN_FRAME_FLAG_EFF;
+            if (id & LOG_ERR_FLAG) {
+                frame->flags |= CAN_FRAME_FLAG_ERR;
+            }
+            frame->id = id & 0x1fffffff;
+        } else {
+            frame->id = id & 0x7ff;
+        }
+
+        frame->dlc = 0;
+        if (*p == 'R') {
+            frame->flags |= CAN_FRAME_FLAG_RTR;
+        } else {
+            while (frame->dlc < 8 && isxdigit(p[0]) && isxdigit(p[1])) {
+                char hex[3] = { p[0], p[1], 0 };
+                frame->data[frame->dlc++] = strtoul(hex, NULL, 16);
+                p += 2;
+            }
+        }
+
+        frame->timestamp = sec * 1000000LL + usec;
+        return true;
+    }
+}
+
+void CanReplay::step() {
+    int count = 0;
+    qint64 wait = 0;
+    bool eof = false;
+
+    while (count < CANREPLAY_BATCH_SIZE) {
+        if (!hasPending) {
+            if (!readFrame(&pending)) {
+                eof = true;
+                break;
+            }
+            hasPending = true;
+            if (firstTimestamp < 0) {
+                firstTimestamp = pending.timestamp;
+            }
+        }
+
+        // not due yet in timed replay
+        if (speed > 0.0) {
+            qint64 due = (qint64) ((double) (pending.timestamp - firstTimestamp) / (speed * 1000.0));
+            qint64 now = elapsed.elapsed();
+            if (due > now) {
+                wait = due - now;
+                break;
+            }
+        }
+
+        hasPending = false;
+        frameCount++;
+        if (accept(pending)) {
+            frames[count++] = pending;
+        }
+    }
+
+    if (count > 0) {
+        clock.advance(frames[count - 1].timestamp / 1000LL);
+        emit receivedBatch(frames, count);
+    }
+
+    if (eof) {
+        emit finished();
+        return;
+    }
+
+    // as fast as possible still returns to the event loop after each batch
+    timer.start(wait);
+}
@@ -0,0 +1,67 @@
+#ifndef CANREPLAY_H
+#define CANREPLAY_H
+
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "cansource.h"
+#include "meteoclock.h"
+
+#define CANREPLAY_ERR_OK    0
+#define CANREPLAY_ERR_OPEN -1
+
+#define CANREPLAY_BATCH_SIZE 64
+
+// Replays a candump log ("candump -l" format) in place of CanReceiver.
+// Frame timestamps are taken from the log and drive getClock(), so the
+// results only depend on the log, not on the replay speed.
+class CanReplay : public CanSource
+{
+    Q_OBJECT
+public:
+    explicit CanReplay(QObject *parent = 0);
+
+    int open(const QString &fileName);
+    void close();
+
+    // 1.0 is real time, N replays N times faster, 0 as fast as possible
+    void setSpeed(double speed) { this->speed = speed; }
+    double getSpeed() { return speed; }
+
+    void start();
+
+    MeteoClock *getClock() { return &clock; }
+    quint64 getFrameCount() { return frameCount; }
+
+    int setPgnFilter(const QVector<quint32> &pgns);
+
+signals:
+    void finished();
+
+private:
+    QFile file;
+    ReplayClock clock;
+    QTimer timer;
+    QElapsedTimer elapsed;
+
+    double speed;
+    qint64 firstTimestamp;
+    quint64 frameCount;
+
+    CanFrame frames[CANREPLAY_BATCH_SIZE];
+    CanFrame pending;
+    bool hasPending;
+
+    bool filterEnabled;
+    QVector<quint32> filterPgns;
+
+    bool readFrame(CanFrame *frame);
+    bool accept(const CanFrame &frame);
+
+private slots:
+    void step();
+
+};
+
+#endif // CANREPLAY_H
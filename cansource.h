@@ -0,0 +1,26 @@
+#ifndef CANSOURCE_H
+#define CANSOURCE_H
+
+#include <QObject>
+#include <QVector>
+
+#include "canframe.h"
+
+// Something that delivers CAN frames to N2kParser: the SocketCAN receiver or a log replay.
+class CanSource : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CanSource(QObject *parent = 0) : QObject(parent) {}
+
+public slots:
+    // only pass NMEA 2000 frames with these PGNs
+    virtual int setPgnFilter(const QVector<quint32> &pgns) = 0;
+
+signals:
+    // frames are only valid during signal delivery, use direct connections
+    void receivedBatch(const CanFrame *frames, int count);
+
+};
+
+#endif // CANSOURCE_H
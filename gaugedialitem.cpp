@@ -0,0 +1,206 @@
+#include "gaugedialitem.h"
+#include "gaugenodes.h"
+
+#include <QPainter>
+#include <QSGNode>
+#include <QSGGeometryNode>
+#include <QSGSimpleRectNode>
+
+#include <math.h>
+
+// in fractions of the outer radius, as CircularGaugeStyle
+#define TICKMARK_LENGTH 0.06
+#define TICKMARK_WIDTH 0.02
+#define MINOR_TICKMARK_LENGTH 0.03
+#define MINOR_TICKMARK_WIDTH 0.01
+#define LABEL_INSET 0.2
+#define LABEL_FONT_SIZE 0.12
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+GaugeDialItem::GaugeDialItem(QQuickItem *parent) : GaugeScaleItem(parent)
+{
+    color = Qt::transparent;
+    tickmarkColor = QColor("#e5e5e5");
+    labelColor = QColor("#e5e5e5");
+    tickmarkStepSize = 10.0;
+    minorTickmarkCount = 4;
+    labelStepSize = 10.0;
+    labelFormat = Number;
+}
+
+void GaugeDialItem::styleUpdate() {
+    setLayoutDirty();
+    emit styleChanged();
+}
+
+void GaugeDialItem::setColor(const QColor &color) {
+    if (color != this->color) {
+        this->color = color;
+        styleUpdate();
+    }
+}
+
+void GaugeDialItem::setTickmarkColor(const QColor &color) {
+    if (color != tickmarkColor) {
+        tickmarkColor = color;
+        styleUpdate();
+    }
+}
+
+void GaugeDialItem::setLabelColor(const QColor &color) {
+    if (color != labelColor) {
+        labelColor = color;
+        styleUpdate();
+    }
+}
+
+void GaugeDialItem::setTickmarkStepSize(double step) {
+    if (step != tickmarkStepSize) {
+        tickmarkStepSize = step;
+        styleUpdate();
+    }
+}
+
+void GaugeDialItem::setMinorTickmarkCount(int count) {
+    if (count != minorTickmarkCount) {
+        minorTickmarkCount = count;
+        styleUpdate();
+    }
+}
+
+void GaugeDialItem::setLabelStepSize(double step) {
+    if (step != labelStepSize) {
+        labelStepSize = step;
+        styleUpdate();
+    }
+}
+
+void GaugeDialItem::setLabelFormat(LabelFormat format) {
+    if (format != labelFormat) {
+        labelFormat = format;
+        styleUpdate();
+    }
+}
+
+// steps from minimum to maximum, the last one is left out on a full circle
+int GaugeDialItem::getStepCount(double step) {
+    if (step <= 0.0 || getMaximumValue() <= getMinimumValue()) {
+        return 0;
+    }
+
+    int count = (int) floor((getMaximumValue() - getMinimumValue()) / step + 1e-6) + 1;
+    if (isFullCircle() && getMinimumValue() + (count - 1) * step >= getMaximumValue() - 1e-6) {
+        count--;
+    }
+    return count;
+}
+
+QString GaugeDialItem::getLabel(double value) {
+    if (labelFormat == Number) {
+        return QString::number(value);
+    }
+
+    static const char *CARDINALS[] = { "N", "E", "S", "W" };
+    double a = fmod(value, 360.0);
+    if (a < 0.0) {
+        a += 360.0;
+    }
+    if (fabs(fmod(a, 90.0)) < 0.1) {
+        return CARDINALS[(int) lround(a / 90.0) % 4];
+    }
+    return QString("%1").arg((int) lround(a * 0.1), 2, 10, QChar('0'));
+}
+
+QPointF GaugeDialItem::polar(double angle, double radius) {
+    double a = DEG_TO_RAD * angle;
+    return QPointF(width() * 0.5 + radius * sin(a), height() * 0.5 - radius * cos(a));
+}
+
+// labels are text, draw them here in the GUI thread
+void GaugeDialItem::updatePolish() {
+    double r = getOuterRadius();
+    if (!layoutDirty || r <= 0.0) {
+        return;
+    }
+
+    int count = getStepCount(labelStepSize);
+    if (count == 0) {
+        labelImage = QImage();
+        return;
+    }
+
+    labelImage = createLabelImage(this);
+
+    QPainter painter(&labelImage);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    QFont font = painter.font();
+    font.setPixelSize(qMax(1, (int) lround(r * LABEL_FONT_SIZE)));
+    painter.setFont(font);
+    painter.setPen(labelColor);
+
+    // box around the label center, large enough for any label
+    double size = r * LABEL_FONT_SIZE * 4.0;
+    for (int i = 0; i < count; i++) {
+        double value = getMinimumValue() + i * labelStepSize;
+        QPointF c = polar(valueToAngle(value), r * (1.0 - LABEL_INSET));
+        QRectF box(c.x() - size * 0.5, c.y() - size * 0.5, size, size);
+        painter.drawText(box, Qt::AlignCenter, getLabel(value));
+    }
+}
+
+QSGNode *GaugeDialItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) {
+    Q_UNUSED(data);
+
+    double r = getOuterRadius();
+    if (r <= 0.0) {
+        delete oldNode;
+        return NULL;
+    }
+
+    if (oldNode != NULL && !layoutDirty) {
+        return oldNode;
+    }
+    delete oldNode;
+    layoutDirty = false;
+
+    QSGNode *node = new QSGNode();
+
+    if (color.alpha() > 0) {
+        QRectF square(width() * 0.5 - r, height() * 0.5 - r, r * 2.0, r * 2.0);
+        node->appendChildNode(new QSGSimpleRectNode(square, color));
+    }
+
+    int count = getStepCount(tickmarkStepSize);
+    if (count > 0) {
+        // minor tickmarks only between major ones
+        int minorCount = (count - (isFullCircle() ? 0 : 1)) * minorTickmarkCount;
+        QSGGeometryNode *ticks = createFlatNode((count + minorCount) * 6, tickmarkColor);
+        QSGGeometry::Point2D *v = ticks->geometry()->vertexDataAsPoint2D();
+
+        double minorStep = tickmarkStepSize / (minorTickmarkCount + 1);
+        for (int i = 0; i < count; i++) {
+            double value = getMinimumValue() + i * tickmarkStepSize;
+            double angle = valueToAngle(value);
+            v = putLine(v, polar(angle, r), polar(angle, r * (1.0 - TICKMARK_LENGTH)), r * TICKMARK_WIDTH);
+
+            if (i == count - 1 && !isFullCircle()) {
+                break;
+            }
+            for (int j = 1; j <= minorTickmarkCount; j++) {
+                angle = valueToAngle(value + j * minorStep);
+                v = putLine(v, polar(angle, r), polar(angle, r * (1.0 - MINOR_TICKMARK_LENGTH)), r * MINOR_TICKMARK_WIDTH);
+            }
+        }
+        node->appendChildNode(ticks);
+    }
+
+    QSGNode *labels = createImageNode(this, labelImage, boundingRect());
+    if (labels != NULL) {
+        node->appendChildNode(labels);
+    }
+    // the texture holds it now
+    labelImage = QImage();
+
+    return node;
+}
@@ -0,0 +1,71 @@
+#ifndef GAUGEDIALITEM_H
+#define GAUGEDIALITEM_H
+
+#include <QColor>
+#include <QImage>
+
+#include "gaugescaleitem.h"
+
+// Static part of a circular gauge: background, tickmarks and labels. Tickmarks are one
+// geometry node, the labels are drawn into a texture, both are only rebuilt when the size
+// or a property changes.
+class GaugeDialItem : public GaugeScaleItem
+{
+    Q_OBJECT
+    Q_PROPERTY(QColor color READ getColor WRITE setColor NOTIFY styleChanged)
+    Q_PROPERTY(QColor tickmarkColor READ getTickmarkColor WRITE setTickmarkColor NOTIFY styleChanged)
+    Q_PROPERTY(QColor labelColor READ getLabelColor WRITE setLabelColor NOTIFY styleChanged)
+    Q_PROPERTY(double tickmarkStepSize READ getTickmarkStepSize WRITE setTickmarkStepSize NOTIFY styleChanged)
+    Q_PROPERTY(int minorTickmarkCount READ getMinorTickmarkCount WRITE setMinorTickmarkCount NOTIFY styleChanged)
+    Q_PROPERTY(double labelStepSize READ getLabelStepSize WRITE setLabelStepSize NOTIFY styleChanged)
+    Q_PROPERTY(LabelFormat labelFormat READ getLabelFormat WRITE setLabelFormat NOTIFY styleChanged)
+public:
+    // Compass: N/E/S/W, else tens of degrees ("03" for 30)
+    enum LabelFormat { Number, Compass };
+    Q_ENUM(LabelFormat)
+
+    explicit GaugeDialItem(QQuickItem *parent = 0);
+
+    QColor getColor() { return color; }
+    QColor getTickmarkColor() { return tickmarkColor; }
+    QColor getLabelColor() { return labelColor; }
+    double getTickmarkStepSize() { return tickmarkStepSize; }
+    int getMinorTickmarkCount() { return minorTickmarkCount; }
+    double getLabelStepSize() { return labelStepSize; }
+    LabelFormat getLabelFormat() { return labelFormat; }
+
+    void setColor(const QColor &color);
+    void setTickmarkColor(const QColor &color);
+    void setLabelColor(const QColor &color);
+    void setTickmarkStepSize(double step);
+    void setMinorTickmarkCount(int count);
+    void setLabelStepSize(double step);
+    void setLabelFormat(LabelFormat format);
+
+signals:
+    void styleChanged();
+
+protected:
+    void updatePolish();
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data);
+
+private:
+    QColor color;
+    QColor tickmarkColor;
+    QColor labelColor;
+    double tickmarkStepSize;
+    int minorTickmarkCount;
+    double labelStepSize;
+    LabelFormat labelFormat;
+
+    // drawn in the GUI thread, turned into a texture by updatePaintNode()
+    QImage labelImage;
+
+    void styleUpdate();
+    int getStepCount(double step);
+    QString getLabel(double value);
+    QPointF polar(double angle, double radius);
+
+};
+
+#endif // GAUGEDIALITEM_H
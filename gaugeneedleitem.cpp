@@ -0,0 +1,143 @@
+#include "gaugeneedleitem.h"
+#include "gaugenodes.h"
+
+#include <QMatrix4x4>
+#include <QSGTransformNode>
+#include <QSGGeometryNode>
+
+#include <math.h>
+
+// rotated needle, pointing up from the center before rotation
+class GaugeNeedleNode : public QSGTransformNode
+{
+public:
+    GaugeNeedleNode() : needle(NULL), shown(false) {}
+    virtual ~GaugeNeedleNode() {
+        // not deleted with the parent while hidden
+        if (!shown) {
+            delete needle;
+        }
+    }
+
+    QSGGeometryNode *needle;
+    bool shown;
+};
+
+GaugeNeedleItem::GaugeNeedleItem(QQuickItem *parent) : GaugeScaleItem(parent)
+{
+    value = 0.0;
+    color = QColor("#e5e5e5");
+    tipRadius = 0.9;
+    tailRadius = 0.0;
+    needleWidth = 0.08;
+    tapered = true;
+}
+
+void GaugeNeedleItem::setValue(double value) {
+    if (value == this->value || (isnan(value) && isnan(this->value))) {
+        return;
+    }
+    this->value = value;
+    // only the transform changes
+    update();
+    emit valueChanged();
+}
+
+void GaugeNeedleItem::styleUpdate() {
+    setLayoutDirty();
+    emit styleChanged();
+}
+
+void GaugeNeedleItem::setColor(const QColor &color) {
+    if (color != this->color) {
+        this->color = color;
+        styleUpdate();
+    }
+}
+
+void GaugeNeedleItem::setTipRadius(double radius) {
+    if (radius != tipRadius) {
+        tipRadius = radius;
+        styleUpdate();
+    }
+}
+
+void GaugeNeedleItem::setTailRadius(double radius) {
+    if (radius != tailRadius) {
+        tailRadius = radius;
+        styleUpdate();
+    }
+}
+
+void GaugeNeedleItem::setNeedleWidth(double width) {
+    if (width != needleWidth) {
+        needleWidth = width;
+        styleUpdate();
+    }
+}
+
+void GaugeNeedleItem::setTapered(bool tapered) {
+    if (tapered != this->tapered) {
+        this->tapered = tapered;
+        styleUpdate();
+    }
+}
+
+QSGNode *GaugeNeedleItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) {
+    Q_UNUSED(data);
+
+    double r = getOuterRadius();
+    if (r <= 0.0) {
+        delete oldNode;
+        return NULL;
+    }
+
+    GaugeNeedleNode *node = static_cast<GaugeNeedleNode *>(oldNode);
+    if (node == NULL) {
+        node = new GaugeNeedleNode();
+        layoutDirty = true;
+    }
+
+    if (layoutDirty) {
+        layoutDirty = false;
+
+        if (node->shown) {
+            node->removeChildNode(node->needle);
+            node->shown = false;
+        }
+        delete node->needle;
+
+        QPointF tip(0.0, -r * tipRadius);
+        QPointF tail(0.0, -r * tailRadius);
+        double w = r * needleWidth;
+        if (tapered) {
+            node->needle = createFlatNode(3, color);
+            QSGGeometry::Point2D *v = node->needle->geometry()->vertexDataAsPoint2D();
+            v[0].set((float) (-w * 0.5), (float) tail.y());
+            v[1].set((float) (w * 0.5), (float) tail.y());
+            v[2].set(0.0f, (float) tip.y());
+        } else {
+            node->needle = createFlatNode(6, color);
+            putLine(node->needle->geometry()->vertexDataAsPoint2D(), tail, tip, w);
+        }
+    }
+
+    bool show = !isnan(value);
+    if (show != node->shown) {
+        if (show) {
+            node->appendChildNode(node->needle);
+        } else {
+            node->removeChildNode(node->needle);
+        }
+        node->shown = show;
+    }
+
+    if (show) {
+        QMatrix4x4 m;
+        m.translate((float) (width() * 0.5), (float) (height() * 0.5));
+        m.rotate((float) valueToAngle(value), 0.0f, 0.0f, 1.0f);
+        node->setMatrix(m);
+    }
+
+    return node;
+}
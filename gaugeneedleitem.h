@@ -0,0 +1,57 @@
+#ifndef GAUGENEEDLEITEM_H
+#define GAUGENEEDLEITEM_H
+
+#include <QColor>
+
+#include "gaugescaleitem.h"
+
+// Needle of a circular gauge. The geometry is built once per size, a new value only
+// changes the rotation of its transform node. Hidden while the value is NAN.
+class GaugeNeedleItem : public GaugeScaleItem
+{
+    Q_OBJECT
+    Q_PROPERTY(double value READ getValue WRITE setValue NOTIFY valueChanged)
+    Q_PROPERTY(QColor color READ getColor WRITE setColor NOTIFY styleChanged)
+    // in fractions of the outer radius, a negative tail reaches beyond the center
+    Q_PROPERTY(double tipRadius READ getTipRadius WRITE setTipRadius NOTIFY styleChanged)
+    Q_PROPERTY(double tailRadius READ getTailRadius WRITE setTailRadius NOTIFY styleChanged)
+    Q_PROPERTY(double needleWidth READ getNeedleWidth WRITE setNeedleWidth NOTIFY styleChanged)
+    // triangle instead of a bar
+    Q_PROPERTY(bool tapered READ isTapered WRITE setTapered NOTIFY styleChanged)
+public:
+    explicit GaugeNeedleItem(QQuickItem *parent = 0);
+
+    double getValue() { return value; }
+    QColor getColor() { return color; }
+    double getTipRadius() { return tipRadius; }
+    double getTailRadius() { return tailRadius; }
+    double getNeedleWidth() { return needleWidth; }
+    bool isTapered() { return tapered; }
+
+    void setValue(double value);
+    void setColor(const QColor &color);
+    void setTipRadius(double radius);
+    void setTailRadius(double radius);
+    void setNeedleWidth(double width);
+    void setTapered(bool tapered);
+
+signals:
+    void valueChanged();
+    void styleChanged();
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data);
+
+private:
+    double value;
+    QColor color;
+    double tipRadius;
+    double tailRadius;
+    double needleWidth;
+    bool tapered;
+
+    void styleUpdate();
+
+};
+
+#endif // GAUGENEEDLEITEM_H
@@ -0,0 +1,71 @@
+#include "gaugenodes.h"
+
+#include <QQuickItem>
+#include <QQuickWindow>
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <QSGSimpleTextureNode>
+
+#include <math.h>
+
+QSGGeometryNode *createFlatNode(int vertexCount, const QColor &color) {
+    QSGGeometry *geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), vertexCount);
+    geometry->setDrawingMode(QSGGeometry::DrawTriangles);
+
+    QSGFlatColorMaterial *material = new QSGFlatColorMaterial();
+    material->setColor(color);
+
+    QSGGeometryNode *node = new QSGGeometryNode();
+    node->setGeometry(geometry);
+    node->setFlag(QSGNode::OwnsGeometry);
+    node->setMaterial(material);
+    node->setFlag(QSGNode::OwnsMaterial);
+    return node;
+}
+
+QSGGeometry::Point2D *putLine(QSGGeometry::Point2D *v, const QPointF &p0, const QPointF &p1, double width) {
+    double dx = p1.x() - p0.x();
+    double dy = p1.y() - p0.y();
+    double len = sqrt(dx * dx + dy * dy);
+    if (len <= 0.0) {
+        len = 1.0;
+    }
+
+    // half width perpendicular to the line
+    float nx = (float) (-dy / len * width * 0.5);
+    float ny = (float) (dx / len * width * 0.5);
+
+    float x0 = (float) p0.x();
+    float y0 = (float) p0.y();
+    float x1 = (float) p1.x();
+    float y1 = (float) p1.y();
+
+    v[0].set(x0 + nx, y0 + ny);
+    v[1].set(x0 - nx, y0 - ny);
+    v[2].set(x1 + nx, y1 + ny);
+    v[3].set(x1 + nx, y1 + ny);
+    v[4].set(x0 - nx, y0 - ny);
+    v[5].set(x1 - nx, y1 - ny);
+    return v + 6;
+}
+
+QImage createLabelImage(QQuickItem *item) {
+    qreal ratio = (item->window() != NULL) ? item->window()->effectiveDevicePixelRatio() : 1.0;
+
+    QImage image((int) ceil(item->width() * ratio), (int) ceil(item->height() * ratio), QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(ratio);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+QSGNode *createImageNode(QQuickItem *item, const QImage &image, const QRectF &rect) {
+    if (image.isNull() || item->window() == NULL) {
+        return NULL;
+    }
+
+    QSGSimpleTextureNode *node = new QSGSimpleTextureNode();
+    node->setTexture(item->window()->createTextureFromImage(image));
+    node->setOwnsTexture(true);
+    node->setRect(rect);
+    return node;
+}
@@ -0,0 +1,29 @@
+#ifndef GAUGENODES_H
+#define GAUGENODES_H
+
+#include <QColor>
+#include <QImage>
+#include <QPointF>
+#include <QRectF>
+#include <QSGGeometry>
+
+class QQuickItem;
+class QSGNode;
+class QSGGeometryNode;
+
+// Scene graph helpers for the gauge items, all built nodes own their geometry,
+// material and texture.
+
+// flat colored triangles, the caller fills the vertexCount vertices
+QSGGeometryNode *createFlatNode(int vertexCount, const QColor &color);
+
+// line from p0 to p1 of the given width as two triangles (6 vertices), returns the next vertex
+QSGGeometry::Point2D *putLine(QSGGeometry::Point2D *v, const QPointF &p0, const QPointF &p1, double width);
+
+// transparent image covering item at the device pixel ratio, to draw labels into
+QImage createLabelImage(QQuickItem *item);
+
+// image drawn over rect, NULL if there is no image
+QSGNode *createImageNode(QQuickItem *item, const QImage &image, const QRectF &rect);
+
+#endif // GAUGENODES_H
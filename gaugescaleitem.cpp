@@ -0,0 +1,84 @@
+#include "gaugescaleitem.h"
+
+#include <math.h>
+
+GaugeScaleItem::GaugeScaleItem(QQuickItem *parent) : QQuickItem(parent)
+{
+    setFlag(ItemHasContents);
+
+    layoutDirty = true;
+
+    minimumValue = 0.0;
+    maximumValue = 100.0;
+    minimumValueAngle = -145.0;
+    maximumValueAngle = 145.0;
+}
+
+void GaugeScaleItem::setMinimumValue(double value) {
+    if (value == minimumValue) {
+        return;
+    }
+    minimumValue = value;
+    setLayoutDirty();
+    emit scaleChanged();
+}
+
+void GaugeScaleItem::setMaximumValue(double value) {
+    if (value == maximumValue) {
+        return;
+    }
+    maximumValue = value;
+    setLayoutDirty();
+    emit scaleChanged();
+}
+
+void GaugeScaleItem::setMinimumValueAngle(double angle) {
+    if (angle == minimumValueAngle) {
+        return;
+    }
+    minimumValueAngle = angle;
+    setLayoutDirty();
+    emit scaleChanged();
+}
+
+void GaugeScaleItem::setMaximumValueAngle(double angle) {
+    if (angle == maximumValueAngle) {
+        return;
+    }
+    maximumValueAngle = angle;
+    setLayoutDirty();
+    emit scaleChanged();
+}
+
+double GaugeScaleItem::valueToAngle(double value) {
+    if (maximumValue == minimumValue) {
+        return minimumValueAngle;
+    }
+
+    double f = (value - minimumValue) / (maximumValue - minimumValue);
+    if (f < 0.0) {
+        f = 0.0;
+    } else if (f > 1.0) {
+        f = 1.0;
+    }
+    return minimumValueAngle + f * (maximumValueAngle - minimumValueAngle);
+}
+
+bool GaugeScaleItem::isFullCircle() {
+    return fabs(maximumValueAngle - minimumValueAngle) >= 359.999;
+}
+
+void GaugeScaleItem::setLayoutDirty() {
+    layoutDirty = true;
+    polish();
+    update();
+}
+
+void GaugeScaleItem::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) {
+    QQuickItem::geometryChanged(newGeometry, oldGeometry);
+
+    if (newGeometry.size() != oldGeometry.size()) {
+        setLayoutDirty();
+        emit outerRadiusChanged();
+    }
+}
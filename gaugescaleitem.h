@@ -0,0 +1,55 @@
+#ifndef GAUGESCALEITEM_H
+#define GAUGESCALEITEM_H
+
+#include <QQuickItem>
+
+// Maps values to angles for the dial and the needles of a circular gauge. Angles are in
+// degrees clockwise from 12 o'clock, defaults as with CircularGaugeStyle. The gauge is the
+// centered circle of outerRadius.
+class GaugeScaleItem : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(double minimumValue READ getMinimumValue WRITE setMinimumValue NOTIFY scaleChanged)
+    Q_PROPERTY(double maximumValue READ getMaximumValue WRITE setMaximumValue NOTIFY scaleChanged)
+    Q_PROPERTY(double minimumValueAngle READ getMinimumValueAngle WRITE setMinimumValueAngle NOTIFY scaleChanged)
+    Q_PROPERTY(double maximumValueAngle READ getMaximumValueAngle WRITE setMaximumValueAngle NOTIFY scaleChanged)
+    Q_PROPERTY(double outerRadius READ getOuterRadius NOTIFY outerRadiusChanged)
+public:
+    explicit GaugeScaleItem(QQuickItem *parent = 0);
+
+    double getMinimumValue() { return minimumValue; }
+    double getMaximumValue() { return maximumValue; }
+    double getMinimumValueAngle() { return minimumValueAngle; }
+    double getMaximumValueAngle() { return maximumValueAngle; }
+    double getOuterRadius() { return qMin(width(), height()) * 0.5; }
+
+    void setMinimumValue(double value);
+    void setMaximumValue(double value);
+    void setMinimumValueAngle(double angle);
+    void setMaximumValueAngle(double angle);
+
+    // value clamped to the scale
+    double valueToAngle(double value);
+    // first and last tickmark coincide
+    bool isFullCircle();
+
+signals:
+    void scaleChanged();
+    void outerRadiusChanged();
+
+protected:
+    // the nodes are rebuilt with the next updatePaintNode()
+    bool layoutDirty;
+
+    void setLayoutDirty();
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry);
+
+private:
+    double minimumValue;
+    double maximumValue;
+    double minimumValueAngle;
+    double maximumValueAngle;
+
+};
+
+#endif // GAUGESCALEITEM_H
@@ -0,0 +1,99 @@
+#include "historymodel.h"
+
+#include <QVariantMap>
+#include <QTimerEvent>
+
+#define CHANGE_PERIOD_MS 1000
+
+static const char *QUANTITY_NAMES[] = { "windVelo", "windDir", "airPress", "airTemp" };
+
+HistoryModel::HistoryModel(MeteoCollector *collector, QObject *parent) : QObject(parent), collector(collector)
+{
+    connect(collector, SIGNAL(windUpdate()), this, SLOT(windUpdate()));
+    connect(collector, SIGNAL(airTempUpdate()), this, SLOT(airTempUpdate()));
+    connect(collector, SIGNAL(airPressUpdate()), this, SLOT(airPressUpdate()));
+
+    for (int i = 0; i < QuantityCount; i++) {
+        pyramids[i] = new HistoryPyramid(i == WindDir);
+    }
+
+    changed = false;
+    changeTimer = startTimer(CHANGE_PERIOD_MS);
+}
+
+HistoryModel::~HistoryModel()
+{
+    for (int i = 0; i < QuantityCount; i++) {
+        delete pyramids[i];
+    }
+}
+
+int HistoryModel::findQuantity(const QString &name) {
+    for (int i = 0; i < QuantityCount; i++) {
+        if (name == QUANTITY_NAMES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QVariantList HistoryModel::series(const QString &quantity, double span, int points) {
+    qint64 now = collector->getClock()->wallTimeMsec();
+    return seriesRange(quantity, (double) now - span * 1000.0, (double) now, points);
+}
+
+QVariantList HistoryModel::seriesRange(const QString &quantity, double from, double to, int points) {
+    QVariantList l;
+    int q = findQuantity(quantity);
+    if (q < 0) {
+        return l;
+    }
+
+    // samples are stored with monotonic timestamps
+    MeteoClock *clock = collector->getClock();
+    qint64 offset = clock->wallTimeMsec() - clock->monotonic();
+
+    int count = pyramids[q]->query((qint64) from - offset, (qint64) to - offset, points, &this->points);
+    l.reserve(count);
+    for (int i = 0; i < count; i++) {
+        const HistoryPoint &p = this->points[i];
+        QVariantMap m;
+        m.insert("t", (double) (p.timestamp + offset));
+        m.insert("min", p.min);
+        m.insert("max", p.max);
+        m.insert("mean", p.mean);
+        l.append(m);
+    }
+    return l;
+}
+
+void HistoryModel::sampleAdded() {
+    changed = true;
+}
+
+void HistoryModel::timerEvent(QTimerEvent *event) {
+    if (event->timerId() == changeTimer && changed) {
+        changed = false;
+        emit historyChanged();
+    }
+}
+
+void HistoryModel::windUpdate()
+{
+    qint64 timestamp = collector->getWindTimestamp();
+    pyramids[WindVelo]->add(timestamp, collector->getWindVelo());
+    pyramids[WindDir]->add(timestamp, collector->getWindDir());
+    sampleAdded();
+}
+
+void HistoryModel::airTempUpdate()
+{
+    pyramids[AirTemp]->add(collector->getAirTempTimestamp(), collector->getAirTemp());
+    sampleAdded();
+}
+
+void HistoryModel::airPressUpdate()
+{
+    pyramids[AirPress]->add(collector->getAirPressTimestamp(), collector->getAirPress());
+    sampleAdded();
+}
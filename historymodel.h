@@ -0,0 +1,58 @@
+#ifndef HISTORYMODEL_H
+#define HISTORYMODEL_H
+
+#include <QObject>
+#include <QVector>
+#include <QVariantList>
+
+#include "historypyramid.h"
+#include "meteocollector.h"
+
+// History of the collector values for trend charts. Series are decimated by the pyramid,
+// the cost of a query depends on the number of points, not on the span.
+class HistoryModel : public QObject
+{
+    Q_OBJECT
+public:
+    enum Quantity { WindVelo, WindDir, AirPress, AirTemp, QuantityCount };
+
+    explicit HistoryModel(MeteoCollector *collector, QObject *parent = 0);
+    virtual ~HistoryModel();
+
+    // quantity "windVelo", "windDir", "airPress" or "airTemp", the last span seconds as
+    // up to points maps { t: msec since epoch, min, max, mean }
+    Q_INVOKABLE QVariantList series(const QString &quantity, double span, int points);
+    // same for a range in msec since epoch
+    Q_INVOKABLE QVariantList seriesRange(const QString &quantity, double from, double to, int points);
+
+    HistoryPyramid *getPyramid(Quantity quantity) { return pyramids[quantity]; }
+
+private:
+    MeteoCollector *collector;
+
+    HistoryPyramid *pyramids[QuantityCount];
+
+    // reused for queries
+    QVector<HistoryPoint> points;
+
+    int changeTimer;
+    bool changed;
+
+    int findQuantity(const QString &name);
+    void sampleAdded();
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+signals:
+    // new samples, at most once a second
+    void historyChanged();
+
+private slots:
+    void windUpdate();
+    void airTempUpdate();
+    void airPressUpdate();
+
+};
+
+#endif // HISTORYMODEL_H
@@ -0,0 +1,247 @@
+#include "historypyramid.h"
+
+#include <math.h>
+
+#define DEG_TO_RAD (M_PI / 180.0)
+#define RAD_TO_DEG (180.0 / M_PI)
+
+static const qint64 LEVEL_DURATION[HISTORY_LEVELS] = { 0, 10000, 60000, 600000 };
+static const int LEVEL_CAPACITY[HISTORY_LEVELS] = {
+    HISTORY_RAW_CAPACITY, HISTORY_10S_CAPACITY, HISTORY_1M_CAPACITY, HISTORY_10M_CAPACITY
+};
+
+HistoryPyramid::HistoryPyramid(bool circular) : circular(circular)
+{
+    for (int i = 0; i < HISTORY_LEVELS; i++) {
+        Level &level = levels[i];
+        level.duration = LEVEL_DURATION[i];
+
+        quint32 cap = 1;
+        while (cap < (quint32) LEVEL_CAPACITY[i]) {
+            cap <<= 1;
+        }
+        level.mask = cap - 1;
+        level.items.resize(cap);
+    }
+
+    clear();
+}
+
+void HistoryPyramid::clear() {
+    for (int i = 0; i < HISTORY_LEVELS; i++) {
+        Level &level = levels[i];
+        level.first = 0;
+        level.next = 0;
+        level.dropped = false;
+        level.open.count = 0;
+    }
+}
+
+qint64 HistoryPyramid::getDuration(int level) {
+    return LEVEL_DURATION[level];
+}
+
+int HistoryPyramid::getCount(int level) {
+    const Level &l = levels[level];
+    return (int) (l.next - l.first) + ((l.open.count > 0) ? 1 : 0);
+}
+
+void HistoryPyramid::add(qint64 timestamp, double value) {
+    if (isnan(value)) {
+        return;
+    }
+
+    // rings are ordered by time, ignore a clock going back
+    Level &raw = levels[0];
+    if (raw.next != raw.first && timestamp < raw.items[(raw.next - 1) & raw.mask].timestamp) {
+        return;
+    }
+
+    HistoryBucket sample;
+    sampleBucket(timestamp, value, circular, &sample);
+    push(raw, sample);
+
+    for (int i = 1; i < HISTORY_LEVELS; i++) {
+        Level &level = levels[i];
+        qint64 start = timestamp - ((timestamp % level.duration) + level.duration) % level.duration;
+
+        // sample of a new interval, close the current bucket
+        if (level.open.count > 0 && level.open.timestamp != start) {
+            push(level, level.open);
+            level.open.count = 0;
+        }
+
+        if (level.open.count == 0) {
+            level.open = sample;
+            level.open.timestamp = start;
+        } else {
+            mergeBucket(&level.open, sample, circular);
+        }
+    }
+}
+
+void HistoryPyramid::push(Level &level, const HistoryBucket &bucket) {
+    // ring full, drop oldest
+    if (level.next - level.first > level.mask) {
+        level.first++;
+        level.dropped = true;
+    }
+
+    level.items[level.next & level.mask] = bucket;
+    level.next++;
+}
+
+void HistoryPyramid::sampleBucket(qint64 timestamp, double value, bool circular, HistoryBucket *bucket) {
+    bucket->timestamp = timestamp;
+    bucket->count = 1;
+    if (circular) {
+        double a = DEG_TO_RAD * value;
+        bucket->min = 0.0;
+        bucket->max = 0.0;
+        bucket->sum = 0.0;
+        bucket->sinSum = sin(a);
+        bucket->cosSum = cos(a);
+        bucket->ref = value;
+    } else {
+        bucket->min = value;
+        bucket->max = value;
+        bucket->sum = value;
+        bucket->sinSum = 0.0;
+        bucket->cosSum = 0.0;
+        bucket->ref = 0.0;
+    }
+}
+
+void HistoryPyramid::mergeBucket(HistoryBucket *to, const HistoryBucket &from, bool circular) {
+    to->count += from.count;
+    to->sum += from.sum;
+    to->sinSum += from.sinSum;
+    to->cosSum += from.cosSum;
+
+    if (circular) {
+        // min/max of from relative to the reference of to
+        double d = remainder(from.ref - to->ref, 360.0);
+        to->min = qMin(to->min, from.min + d);
+        to->max = qMax(to->max, from.max + d);
+    } else {
+        to->min = qMin(to->min, from.min);
+        to->max = qMax(to->max, from.max);
+    }
+}
+
+void HistoryPyramid::bucketToPoint(const HistoryBucket &bucket, bool circular, HistoryPoint *point) {
+    point->timestamp = bucket.timestamp;
+    point->count = bucket.count;
+
+    if (circular) {
+        double mean = RAD_TO_DEG * atan2(bucket.sinSum, bucket.cosSum);
+        if (mean < 0.0) {
+            mean += 360.0;
+        }
+        double d = remainder(bucket.ref - mean, 360.0);
+        point->mean = mean;
+        point->min = mean + d + bucket.min;
+        point->max = mean + d + bucket.max;
+    } else {
+        point->mean = bucket.sum / bucket.count;
+        point->min = bucket.min;
+        point->max = bucket.max;
+    }
+}
+
+// sequence number of the first item at or after timestamp
+quint64 HistoryPyramid::lowerBound(const Level &level, qint64 timestamp) {
+    quint64 lo = level.first;
+    quint64 hi = level.next;
+    while (lo < hi) {
+        quint64 mid = lo + (hi - lo) / 2;
+        if (level.items[mid & level.mask].timestamp < timestamp) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// items of [from, to), buckets count if they overlap
+int HistoryPyramid::countRange(const Level &level, qint64 from, qint64 to) {
+    if (level.duration > 0) {
+        from -= level.duration - 1;
+    }
+
+    int count = (int) (lowerBound(level, to) - lowerBound(level, from));
+    if (level.open.count > 0 && level.open.timestamp >= from && level.open.timestamp < to) {
+        count++;
+    }
+    return count;
+}
+
+bool HistoryPyramid::covers(const Level &level, qint64 from) {
+    if (!level.dropped) {
+        return true;
+    }
+    return level.next != level.first && level.items[level.first & level.mask].timestamp <= from;
+}
+
+int HistoryPyramid::query(qint64 from, qint64 to, int maxPoints, QVector<HistoryPoint> *out) {
+    out->resize(0);
+    if (to <= from || maxPoints <= 0) {
+        return 0;
+    }
+
+    // finest level going back far enough without too many items, else the coarsest
+    int l = HISTORY_LEVELS - 1;
+    for (int i = 0; i < HISTORY_LEVELS; i++) {
+        if (covers(levels[i], from) && countRange(levels[i], from, to) <= maxPoints * HISTORY_MAX_ITEMS_PER_POINT) {
+            l = i;
+            break;
+        }
+    }
+    const Level &level = levels[l];
+
+    qint64 start = from;
+    if (level.duration > 0) {
+        start -= level.duration - 1;
+    }
+    quint64 seq = lowerBound(level, start);
+    quint64 end = lowerBound(level, to);
+    bool open = level.open.count > 0 && level.open.timestamp >= start && level.open.timestamp < to;
+
+    // items falling into the same time bin are merged into one point
+    qint64 binWidth = (to - from + maxPoints - 1) / maxPoints;
+    HistoryBucket bin;
+    qint64 binIndex = -1;
+    HistoryPoint point;
+
+    while (seq != end || open) {
+        const HistoryBucket *bucket;
+        if (seq != end) {
+            bucket = &level.items[seq & level.mask];
+            seq++;
+        } else {
+            bucket = &level.open;
+            open = false;
+        }
+
+        qint64 index = (qMax(bucket->timestamp, from) - from) / binWidth;
+        if (index == binIndex) {
+            mergeBucket(&bin, *bucket, circular);
+            continue;
+        }
+
+        if (binIndex >= 0) {
+            bucketToPoint(bin, circular, &point);
+            out->append(point);
+        }
+        bin = *bucket;
+        binIndex = index;
+    }
+
+    if (binIndex >= 0) {
+        bucketToPoint(bin, circular, &point);
+        out->append(point);
+    }
+
+    return out->size();
+}
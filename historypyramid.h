@@ -0,0 +1,91 @@
+#ifndef HISTORYPYRAMID_H
+#define HISTORYPYRAMID_H
+
+#include <QtGlobal>
+#include <QVector>
+
+// levels: raw samples, then buckets of 10 s, 1 min and 10 min
+#define HISTORY_LEVELS 4
+
+// ring sizes, rounded up to a power of two
+#define HISTORY_RAW_CAPACITY  8192   // ~14 min at 10 Hz
+#define HISTORY_10S_CAPACITY  16384  // ~45 h
+#define HISTORY_1M_CAPACITY   8192   // ~5.7 days
+#define HISTORY_10M_CAPACITY  4096   // ~28 days
+
+// a level is used for a query if it has no more than this many items per point
+#define HISTORY_MAX_ITEMS_PER_POINT 4
+
+class HistoryBucket {
+public:
+    // msec, start of the bucket or time of the raw sample
+    qint64 timestamp;
+    int count;
+    double min;
+    double max;
+    double sum;
+    // circular: unit vector sums, min/max are offsets in deg to ref (first sample)
+    double sinSum;
+    double cosSum;
+    double ref;
+};
+
+class HistoryPoint {
+public:
+    qint64 timestamp;
+    double min;
+    double max;
+    // circular mean for direction, unwrapped min/max around it
+    double mean;
+    int count;
+};
+
+// Level-of-detail history of one quantity in fixed-size rings, updated incrementally per
+// sample. Each bucket level aggregates the samples of its interval, the current bucket is
+// part of the queries. Queries read the finest level that covers the span with a bounded
+// number of items and merge them into at most the requested number of points.
+class HistoryPyramid
+{
+public:
+    // circular: angle in deg, mean over unit vectors
+    explicit HistoryPyramid(bool circular = false);
+
+    void add(qint64 timestamp, double value);
+    void clear();
+
+    // points of [from, to) in time order, at most maxPoints
+    int query(qint64 from, qint64 to, int maxPoints, QVector<HistoryPoint> *out);
+
+    // items stored per level, including the current bucket
+    int getCount(int level);
+    // bucket length in msec, 0 for raw samples
+    static qint64 getDuration(int level);
+
+    // aggregation, also used for other stores of the same statistics
+    static void sampleBucket(qint64 timestamp, double value, bool circular, HistoryBucket *bucket);
+    static void mergeBucket(HistoryBucket *to, const HistoryBucket &from, bool circular);
+    static void bucketToPoint(const HistoryBucket &bucket, bool circular, HistoryPoint *point);
+
+private:
+    struct Level {
+        qint64 duration;
+        QVector<HistoryBucket> items;
+        quint32 mask;
+        quint64 first;
+        quint64 next;
+        // oldest items have been overwritten
+        bool dropped;
+        // current bucket, not yet in the ring
+        HistoryBucket open;
+    };
+
+    bool circular;
+    Level levels[HISTORY_LEVELS];
+
+    void push(Level &level, const HistoryBucket &bucket);
+    quint64 lowerBound(const Level &level, qint64 timestamp);
+    int countRange(const Level &level, qint64 from, qint64 to);
+    bool covers(const Level &level, qint64 from);
+};
+
+#endif // HISTORYPYRAMID_H
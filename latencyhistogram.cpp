@@ -0,0 +1,57 @@
+#include "latencyhistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::getMean() const {
+    quint64 n = getCount();
+    return n > 0 ? (double) sum.load(std::memory_order_relaxed) / (double) n : 0.0;
+}
+
+qint64 LatencyHistogram::bucketHigh(int index) {
+    if (index < (1 << LATENCYHISTOGRAM_SUB_BITS)) {
+        return index;
+    }
+    int shift = index / LATENCYHISTOGRAM_HALF - 1;
+    qint64 sub = index % LATENCYHISTOGRAM_HALF + LATENCYHISTOGRAM_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+qint64 LatencyHistogram::getPercentile(double quantile) const {
+    // sum up buckets instead of trusting count, they may be updated concurrently
+    quint64 total = 0;
+    for (int i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++) {
+        total += counts[i].load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    quint64 rank = (quint64) (quantile * (double) total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    quint64 acc = 0;
+    for (int i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++) {
+        acc += counts[i].load(std::memory_order_relaxed);
+        if (acc >= rank) {
+            qint64 high = bucketHigh(i);
+            qint64 m = getMax();
+            return (high > m) ? m : high;
+        }
+    }
+
+    return getMax();
+}
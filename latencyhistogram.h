@@ -0,0 +1,70 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+// log-linear buckets: values below 2^SUB_BITS are exact, above that every power of two
+// is split into 2^(SUB_BITS-1) buckets, so a bucket is at most 1/16 of its value wide
+#define LATENCYHISTOGRAM_SUB_BITS 5
+#define LATENCYHISTOGRAM_MAX_BITS 32
+#define LATENCYHISTOGRAM_HALF     (1 << (LATENCYHISTOGRAM_SUB_BITS - 1))
+#define LATENCYHISTOGRAM_BUCKETS  ((LATENCYHISTOGRAM_MAX_BITS - LATENCYHISTOGRAM_SUB_BITS + 2) * LATENCYHISTOGRAM_HALF)
+
+// HDR style histogram of non-negative values (usec). Recording is lock-free, reading
+// from another thread gives a slightly inconsistent but usable view.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    inline void record(qint64 value) {
+        if (value < 0) {
+            value = 0;
+        }
+        if (value >= (1LL << LATENCYHISTOGRAM_MAX_BITS)) {
+            value = (1LL << LATENCYHISTOGRAM_MAX_BITS) - 1;
+        }
+
+        counts[bucketIndex((quint64) value)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+
+        qint64 m = max.load(std::memory_order_relaxed);
+        while (value > m && !max.compare_exchange_weak(m, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void reset();
+
+    quint64 getCount() const { return count.load(std::memory_order_relaxed); }
+    qint64 getMax() const { return max.load(std::memory_order_relaxed); }
+    qint64 getSum() const { return sum.load(std::memory_order_relaxed); }
+    double getMean() const;
+
+    // upper bound of the bucket holding the given quantile (0.0 - 1.0)
+    qint64 getPercentile(double quantile) const;
+
+private:
+    Q_DISABLE_COPY(LatencyHistogram)
+
+    std::atomic<quint64> counts[LATENCYHISTOGRAM_BUCKETS];
+    std::atomic<quint64> count;
+    std::atomic<qint64> sum;
+    std::atomic<qint64> max;
+
+    static inline int bucketIndex(quint64 value) {
+        if (value < (1ULL << LATENCYHISTOGRAM_SUB_BITS)) {
+            return (int) value;
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - LATENCYHISTOGRAM_SUB_BITS + 1;
+        return (shift + 1) * LATENCYHISTOGRAM_HALF + (int) (value >> shift) - LATENCYHISTOGRAM_HALF;
+    }
+
+    static qint64 bucketHigh(int index);
+
+};
+
+#endif // LATENCYHISTOGRAM_H
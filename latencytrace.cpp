@@ -0,0 +1,179 @@
+#include "latencytrace.h"
+
+#include <QFile>
+#include <QDateTime>
+
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+int LatencyTrace::signalFds[2] = { -1, -1 };
+
+LatencyTrace::LatencyTrace(QObject *parent) : QObject(parent)
+{
+    origin = 0;
+    dumpTimer = 0;
+    sn = NULL;
+}
+
+LatencyTrace::~LatencyTrace()
+{
+    if (sn != NULL) {
+        signal(SIGUSR1, SIG_DFL);
+        delete(sn);
+        close(signalFds[0]);
+        close(signalFds[1]);
+        signalFds[0] = -1;
+        signalFds[1] = -1;
+    }
+}
+
+const char *LatencyTrace::getStageName(LatencyStage stage) {
+    switch (stage) {
+    case LATENCY_STAGE_RECEIVE:
+        return "receive";
+    case LATENCY_STAGE_DECODE:
+        return "decode";
+    case LATENCY_STAGE_COLLECT:
+        return "collect";
+    case LATENCY_STAGE_PUBLISH:
+        return "publish";
+    case LATENCY_STAGE_BIND:
+        return "bind";
+    default:
+        return "unknown";
+    }
+}
+
+void LatencyTrace::reset() {
+    for (int i = 0; i < _LATENCY_STAGE_EOL; i++) {
+        stages[i].reset();
+    }
+}
+
+void LatencyTrace::registerMetrics(MetricsRegistry *metrics) {
+    for (int i = 0; i < _LATENCY_STAGE_EOL; i++) {
+        QString labels = QString("stage=\"%1\"").arg(getStageName((LatencyStage) i));
+        metrics->addHistogram("meteo_latency_seconds", "Time since kernel receive per pipeline stage", labels, &stages[i], 1e-6);
+    }
+}
+
+QByteArray LatencyTrace::format() {
+    QByteArray out;
+    char line[160];
+
+    snprintf(line, sizeof(line), "# latency trace %s, usec since kernel receive\n",
+             QDateTime::currentDateTimeUtc().toString(Qt::ISODate).toLatin1().constData());
+    out.append(line);
+    snprintf(line, sizeof(line), "%-8s %10s %8s %8s %8s %8s %8s %8s\n",
+             "stage", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    out.append(line);
+
+    for (int i = 0; i < _LATENCY_STAGE_EOL; i++) {
+        const LatencyHistogram &h = stages[i];
+        snprintf(line, sizeof(line), "%-8s %10llu %8.0f %8lld %8lld %8lld %8lld %8lld\n",
+                 getStageName((LatencyStage) i),
+                 (unsigned long long) h.getCount(),
+                 h.getMean(),
+                 (long long) h.getPercentile(0.5),
+                 (long long) h.getPercentile(0.9),
+                 (long long) h.getPercentile(0.99),
+                 (long long) h.getPercentile(0.999),
+                 (long long) h.getMax());
+        out.append(line);
+    }
+
+    return out;
+}
+
+void LatencyTrace::setDumpInterval(int seconds) {
+    if (dumpTimer != 0) {
+        killTimer(dumpTimer);
+        dumpTimer = 0;
+    }
+
+    if (seconds > 0) {
+        dumpTimer = startTimer(seconds * 1000);
+    }
+}
+
+int LatencyTrace::dump() {
+    QByteArray data = format();
+
+    if (dumpFile.isEmpty()) {
+        fwrite(data.constData(), 1, data.size(), stderr);
+        return LATENCYTRACE_ERR_OK;
+    }
+
+    QFile file(dumpFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return LATENCYTRACE_ERR_OPEN_FILE;
+    }
+
+    if (file.write(data) != data.size()) {
+        return LATENCYTRACE_ERR_WRITE_FILE;
+    }
+
+    return LATENCYTRACE_ERR_OK;
+}
+
+// only async-signal-safe calls in here, the dump happens in the event loop
+void LatencyTrace::signalHandler(int sig) {
+    Q_UNUSED(sig);
+    char c = 1;
+    if (write(signalFds[1], &c, sizeof(c)) < 0) {
+        // nothing sensible to do here
+    }
+}
+
+int LatencyTrace::installSignalHandler() {
+    int err;
+    struct sigaction sa;
+
+    if (sn != NULL) {
+        return LATENCYTRACE_ERR_OK;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, signalFds) < 0) {
+        err = LATENCYTRACE_ERR_CREATE_PIPE;
+        goto fail0;
+    }
+
+    sa.sa_handler = signalHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &sa, NULL) < 0) {
+        err = LATENCYTRACE_ERR_SET_HANDLER;
+        goto fail1;
+    }
+
+    sn = new QSocketNotifier(signalFds[0], QSocketNotifier::Read, this);
+    connect(sn, SIGNAL(activated(int)), this, SLOT(signalReady(int)));
+
+    // everything is fine
+    return LATENCYTRACE_ERR_OK;
+
+    // error handling
+fail1:
+    close(signalFds[0]);
+    close(signalFds[1]);
+    signalFds[0] = -1;
+    signalFds[1] = -1;
+fail0:
+    return err;
+}
+
+void LatencyTrace::signalReady(int socket) {
+    // several signals may have been merged
+    char buf[16];
+    while (read(socket, buf, sizeof(buf)) > 0) {
+    }
+
+    dump();
+}
+
+void LatencyTrace::timerEvent(QTimerEvent *event) {
+    Q_UNUSED(event);
+    dump();
+}
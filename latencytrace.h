@@ -0,0 +1,97 @@
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QSocketNotifier>
+
+#include <time.h>
+
+#include "latencyhistogram.h"
+#include "metricsregistry.h"
+
+#define LATENCYTRACE_ERR_OK            0
+#define LATENCYTRACE_ERR_OPEN_FILE    -1
+#define LATENCYTRACE_ERR_WRITE_FILE   -2
+#define LATENCYTRACE_ERR_CREATE_PIPE  -3
+#define LATENCYTRACE_ERR_SET_HANDLER  -4
+
+// points along the pipeline, all measured from the kernel receive timestamp of the frame
+enum LatencyStage {
+    LATENCY_STAGE_RECEIVE = 0,  // CanReceiver hands the batch on
+    LATENCY_STAGE_DECODE,       // N2kParser starts decoding the message
+    LATENCY_STAGE_COLLECT,      // MeteoCollector has updated its values
+    LATENCY_STAGE_PUBLISH,      // MqttSender handed the payload to libmosquitto
+    LATENCY_STAGE_BIND,         // MeteoBinding emitted the changed property
+    _LATENCY_STAGE_EOL
+};
+
+// Optional end-to-end latency tracing. Stages run synchronously on the GUI thread, so the
+// receive timestamp of the frame being processed is kept as "origin" for the later stages.
+class LatencyTrace : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LatencyTrace(QObject *parent = 0);
+    virtual ~LatencyTrace();
+
+    // usec, CLOCK_MONOTONIC like CanFrame::timestamp
+    static inline qint64 now() {
+        struct timespec tp;
+        clock_gettime(CLOCK_MONOTONIC, &tp);
+        return (qint64) tp.tv_sec * 1000000LL + (qint64) (tp.tv_nsec / 1000L);
+    }
+
+    void setOrigin(qint64 origin) { this->origin = origin; }
+    qint64 getOrigin() { return origin; }
+
+    inline void record(LatencyStage stage) {
+        record(stage, origin);
+    }
+    inline void record(LatencyStage stage, qint64 origin) {
+        if (origin > 0) {
+            stages[stage].record(now() - origin);
+        }
+    }
+
+    const LatencyHistogram &getHistogram(LatencyStage stage) { return stages[stage]; }
+    static const char *getStageName(LatencyStage stage);
+
+    void reset();
+
+    // export the stage histograms in seconds
+    void registerMetrics(MetricsRegistry *metrics);
+
+    // human readable table of all stages
+    QByteArray format();
+
+    // appended to on dump(), SIGUSR1 and every interval seconds (0 = never)
+    void setDumpFile(const QString &fileName) { dumpFile = fileName; }
+    void setDumpInterval(int seconds);
+    int dump();
+
+    // dump on SIGUSR1, only one instance may do this
+    int installSignalHandler();
+
+private:
+    LatencyHistogram stages[_LATENCY_STAGE_EOL];
+    qint64 origin;
+
+    QString dumpFile;
+    int dumpTimer;
+
+    QSocketNotifier *sn;
+
+    static int signalFds[2];
+    static void signalHandler(int sig);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private slots:
+    void signalReady(int socket);
+
+};
+
+#endif // LATENCYTRACE_H
@@ -0,0 +1,254 @@
+#include "lineargaugeitem.h"
+#include "gaugenodes.h"
+
+#include <QPainter>
+#include <QSGNode>
+#include <QSGGeometryNode>
+#include <QSGSimpleRectNode>
+
+#include <math.h>
+
+// in fractions of the width
+#define LABEL_WIDTH 0.5
+#define TICKMARK_LENGTH 0.12
+#define MINOR_TICKMARK_LENGTH 0.06
+#define TRACK_X 0.68
+#define TRACK_WIDTH 0.32
+
+#define TICKMARK_WIDTH 2.0
+#define MINOR_TICKMARK_WIDTH 1.0
+
+// bar rectangle updated with the value
+class LinearGaugeNode : public QSGNode
+{
+public:
+    LinearGaugeNode() : bar(NULL) {}
+
+    QSGSimpleRectNode *bar;
+};
+
+LinearGaugeItem::LinearGaugeItem(QQuickItem *parent) : QQuickItem(parent)
+{
+    setFlag(ItemHasContents);
+    setImplicitWidth(80.0);
+    setImplicitHeight(200.0);
+
+    value = 0.0;
+    minimumValue = 0.0;
+    maximumValue = 100.0;
+    tickmarkStepSize = 10.0;
+    minorTickmarkCount = 4;
+    color = QColor("#5c9ad6");
+    trackColor = QColor("#101020");
+    tickmarkColor = QColor("#e5e5e5");
+    labelColor = QColor("#e5e5e5");
+    labelPixelSize = 14;
+
+    layoutDirty = true;
+}
+
+void LinearGaugeItem::setValue(double value) {
+    if (value == this->value || (isnan(value) && isnan(this->value))) {
+        return;
+    }
+    this->value = value;
+    // only the bar changes
+    update();
+    emit valueChanged();
+}
+
+void LinearGaugeItem::styleUpdate() {
+    layoutDirty = true;
+    polish();
+    update();
+    emit styleChanged();
+}
+
+void LinearGaugeItem::setMinimumValue(double value) {
+    if (value != minimumValue) {
+        minimumValue = value;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::setMaximumValue(double value) {
+    if (value != maximumValue) {
+        maximumValue = value;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::setTickmarkStepSize(double step) {
+    if (step != tickmarkStepSize) {
+        tickmarkStepSize = step;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::setMinorTickmarkCount(int count) {
+    if (count != minorTickmarkCount) {
+        minorTickmarkCount = count;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::setColor(const QColor &color) {
+    if (color != this->color) {
+        this->color = color;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::setTrackColor(const QColor &color) {
+    if (color != trackColor) {
+        trackColor = color;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::setTickmarkColor(const QColor &color) {
+    if (color != tickmarkColor) {
+        tickmarkColor = color;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::setLabelColor(const QColor &color) {
+    if (color != labelColor) {
+        labelColor = color;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::setLabelPixelSize(int size) {
+    if (size != labelPixelSize) {
+        labelPixelSize = size;
+        styleUpdate();
+    }
+}
+
+void LinearGaugeItem::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) {
+    QQuickItem::geometryChanged(newGeometry, oldGeometry);
+
+    if (newGeometry.size() != oldGeometry.size()) {
+        layoutDirty = true;
+        polish();
+        update();
+    }
+}
+
+int LinearGaugeItem::getStepCount() {
+    if (tickmarkStepSize <= 0.0 || maximumValue <= minimumValue) {
+        return 0;
+    }
+    return (int) floor((maximumValue - minimumValue) / tickmarkStepSize + 1e-6) + 1;
+}
+
+// half a label above and below, the end labels fit
+QRectF LinearGaugeItem::getTrackRect() {
+    double margin = labelPixelSize * 0.6;
+    return QRectF(width() * TRACK_X, margin, width() * TRACK_WIDTH, qMax(0.0, height() - 2.0 * margin));
+}
+
+double LinearGaugeItem::valueToY(double value) {
+    QRectF track = getTrackRect();
+    if (maximumValue == minimumValue) {
+        return track.bottom();
+    }
+
+    double f = (value - minimumValue) / (maximumValue - minimumValue);
+    if (f < 0.0) {
+        f = 0.0;
+    } else if (f > 1.0) {
+        f = 1.0;
+    }
+    return track.bottom() - f * track.height();
+}
+
+// labels are text, draw them here in the GUI thread
+void LinearGaugeItem::updatePolish() {
+    if (!layoutDirty || width() <= 0.0 || height() <= 0.0) {
+        return;
+    }
+
+    int count = getStepCount();
+    if (count == 0) {
+        labelImage = QImage();
+        return;
+    }
+
+    labelImage = createLabelImage(this);
+
+    QPainter painter(&labelImage);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    QFont font = painter.font();
+    font.setPixelSize(labelPixelSize);
+    painter.setFont(font);
+    painter.setPen(labelColor);
+
+    double w = width() * LABEL_WIDTH;
+    for (int i = 0; i < count; i++) {
+        double v = minimumValue + i * tickmarkStepSize;
+        QRectF box(0.0, valueToY(v) - labelPixelSize, w, labelPixelSize * 2.0);
+        painter.drawText(box, Qt::AlignRight | Qt::AlignVCenter, QString::number(v));
+    }
+}
+
+QSGNode *LinearGaugeItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) {
+    Q_UNUSED(data);
+
+    if (width() <= 0.0 || height() <= 0.0) {
+        delete oldNode;
+        return NULL;
+    }
+
+    LinearGaugeNode *node = static_cast<LinearGaugeNode *>(oldNode);
+    QRectF track = getTrackRect();
+
+    if (node == NULL || layoutDirty) {
+        delete node;
+        layoutDirty = false;
+
+        node = new LinearGaugeNode();
+        node->appendChildNode(new QSGSimpleRectNode(track, trackColor));
+        node->bar = new QSGSimpleRectNode(QRectF(), color);
+        node->appendChildNode(node->bar);
+
+        int count = getStepCount();
+        if (count > 0) {
+            int minorCount = (count - 1) * minorTickmarkCount;
+            QSGGeometryNode *ticks = createFlatNode((count + minorCount) * 6, tickmarkColor);
+            QSGGeometry::Point2D *v = ticks->geometry()->vertexDataAsPoint2D();
+
+            double x1 = track.left() - width() * 0.04;
+            double minorStep = tickmarkStepSize / (minorTickmarkCount + 1);
+            for (int i = 0; i < count; i++) {
+                double value = minimumValue + i * tickmarkStepSize;
+                double y = valueToY(value);
+                v = putLine(v, QPointF(x1 - width() * TICKMARK_LENGTH, y), QPointF(x1, y), TICKMARK_WIDTH);
+
+                if (i == count - 1) {
+                    break;
+                }
+                for (int j = 1; j <= minorTickmarkCount; j++) {
+                    y = valueToY(value + j * minorStep);
+                    v = putLine(v, QPointF(x1 - width() * MINOR_TICKMARK_LENGTH, y), QPointF(x1, y), MINOR_TICKMARK_WIDTH);
+                }
+            }
+            node->appendChildNode(ticks);
+        }
+
+        QSGNode *labels = createImageNode(this, labelImage, boundingRect());
+        if (labels != NULL) {
+            node->appendChildNode(labels);
+        }
+        // the texture holds it now
+        labelImage = QImage();
+    }
+
+    // empty bar while there is no value
+    double top = isnan(value) ? track.bottom() : valueToY(value);
+    node->bar->setRect(QRectF(track.left(), top, track.width(), track.bottom() - top));
+
+    return node;
+}
@@ -0,0 +1,81 @@
+#ifndef LINEARGAUGEITEM_H
+#define LINEARGAUGEITEM_H
+
+#include <QQuickItem>
+#include <QColor>
+#include <QImage>
+
+// Vertical bar gauge: labels left, tickmarks, then the bar. Tickmarks and labels are
+// built once per size or property change, a new value only moves the bar rectangle.
+class LinearGaugeItem : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(double value READ getValue WRITE setValue NOTIFY valueChanged)
+    Q_PROPERTY(double minimumValue READ getMinimumValue WRITE setMinimumValue NOTIFY styleChanged)
+    Q_PROPERTY(double maximumValue READ getMaximumValue WRITE setMaximumValue NOTIFY styleChanged)
+    Q_PROPERTY(double tickmarkStepSize READ getTickmarkStepSize WRITE setTickmarkStepSize NOTIFY styleChanged)
+    Q_PROPERTY(int minorTickmarkCount READ getMinorTickmarkCount WRITE setMinorTickmarkCount NOTIFY styleChanged)
+    Q_PROPERTY(QColor color READ getColor WRITE setColor NOTIFY styleChanged)
+    Q_PROPERTY(QColor trackColor READ getTrackColor WRITE setTrackColor NOTIFY styleChanged)
+    Q_PROPERTY(QColor tickmarkColor READ getTickmarkColor WRITE setTickmarkColor NOTIFY styleChanged)
+    Q_PROPERTY(QColor labelColor READ getLabelColor WRITE setLabelColor NOTIFY styleChanged)
+    Q_PROPERTY(int labelPixelSize READ getLabelPixelSize WRITE setLabelPixelSize NOTIFY styleChanged)
+public:
+    explicit LinearGaugeItem(QQuickItem *parent = 0);
+
+    double getValue() { return value; }
+    double getMinimumValue() { return minimumValue; }
+    double getMaximumValue() { return maximumValue; }
+    double getTickmarkStepSize() { return tickmarkStepSize; }
+    int getMinorTickmarkCount() { return minorTickmarkCount; }
+    QColor getColor() { return color; }
+    QColor getTrackColor() { return trackColor; }
+    QColor getTickmarkColor() { return tickmarkColor; }
+    QColor getLabelColor() { return labelColor; }
+    int getLabelPixelSize() { return labelPixelSize; }
+
+    void setValue(double value);
+    void setMinimumValue(double value);
+    void setMaximumValue(double value);
+    void setTickmarkStepSize(double step);
+    void setMinorTickmarkCount(int count);
+    void setColor(const QColor &color);
+    void setTrackColor(const QColor &color);
+    void setTickmarkColor(const QColor &color);
+    void setLabelColor(const QColor &color);
+    void setLabelPixelSize(int size);
+
+signals:
+    void valueChanged();
+    void styleChanged();
+
+protected:
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry);
+    void updatePolish();
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data);
+
+private:
+    double value;
+    double minimumValue;
+    double maximumValue;
+    double tickmarkStepSize;
+    int minorTickmarkCount;
+    QColor color;
+    QColor trackColor;
+    QColor tickmarkColor;
+    QColor labelColor;
+    int labelPixelSize;
+
+    // the nodes are rebuilt with the next updatePaintNode()
+    bool layoutDirty;
+    // drawn in the GUI thread, turned into a texture by updatePaintNode()
+    QImage labelImage;
+
+    void styleUpdate();
+    int getStepCount();
+    QRectF getTrackRect();
+    double valueToY(double value);
+
+};
+
+#endif // LINEARGAUGEITEM_H
@@ -1,55 +1,354 @@
-#include <QGuiApplication>
-#include <QQmlApplicationEngine>
-#include <QQmlContext>
+#include <QCoreApplication>
+#include <QMap>
+#include <QSettings>
+#include <QScopedPointer>
 
 #include "canreceiver.h"
+#include "canreplay.h"
 #include "n2kparser.h"
 #include "meteocollector.h"
-#include "meteobinding.h"
 #include "mqttclient.h"
 #include "mqttsender.h"
+#include "archiveuploader.h"
+#include "meteostore.h"
+#include "latencytrace.h"
+#include "metricsregistry.h"
+#include "metricsserver.h"
+
+#include <locale.h>
+#include <string.h>
+
+#ifndef METEOHMI_HEADLESS
+#include <QGuiApplication>
+#include <QQmlApplicationEngine>
+#include <QQmlContext>
+#include <QQuickWindow>
+#include <QtQml>
+
+#include "meteobinding.h"
+#include "historymodel.h"
+#include "gaugedialitem.h"
+#include "gaugeneedleitem.h"
+#include "lineargaugeitem.h"
+#endif
+
+// "--<group>-<key>" on the command line wins over "<key>" in section [<group>] of the config file
+static QString configValue(QSettings *config, const QMap<QString, QString> &opts, const QString &group, const QString &key, const QString &def)
+{
+    QString opt = group + "-" + key;
+    if (opts.contains(opt)) {
+        return opts.value(opt);
+    }
+    if (config != NULL) {
+        return config->value(group + "/" + key, def).toString();
+    }
+    return def;
+}
+
+// MQTT v5 message expiry for the JSON and binary topic
+static void loadMessageExpiry(MqttClient *mqtt, MqttSender::Topic topic, QSettings *config, const QMap<QString, QString> &opts, const QString &group, const QString &def)
+{
+    int seconds = configValue(config, opts, group, "expiry", def).toInt();
+    mqtt->setMessageExpiry(MqttSender::getTopicName(topic), seconds);
+    mqtt->setMessageExpiry(MqttSender::getBinaryTopicName(topic), seconds);
+}
+
+// "deadband-<value>" for one value of the topic, "deadband" for the values in the unit of the first one
+static void loadPublishPolicy(PublishPolicy *policy, MqttSender::Topic topic, QSettings *config, const QMap<QString, QString> &opts, const QString &group)
+{
+    policy->setMaxRate(configValue(config, opts, group, "max-rate", "0").toDouble());
+    policy->setHeartbeat((qint64) (configValue(config, opts, group, "heartbeat", "0").toDouble() * 1000.0));
+
+    QString first(MqttSender::getValueName(topic, 0));
+    const char *name;
+    for (int i = 0; (name = MqttSender::getValueName(topic, i)) != NULL; i++) {
+        QString value(name);
+        QString absolute = (value == first) ? configValue(config, opts, group, "deadband", "0") : QString("0");
+        QString relative = (value == first) ? configValue(config, opts, group, "deadband-rel", "0") : QString("0");
+        policy->setDeadband(i, configValue(config, opts, group, "deadband-" + value, absolute).toDouble(),
+                            configValue(config, opts, group, "deadband-rel-" + value, relative).toDouble());
+    }
+}
 
 int main(int argc, char *argv[])
 {
-    QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
-    QGuiApplication app(argc, argv);
+    // CAN -> MQTT only, no display needed; always so without GUI support compiled in
+    bool headless = true;
+#ifndef METEOHMI_HEADLESS
+    headless = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }
+    }
+#endif
 
-    if (argc < 7) {
-        printf("usage: MeteoHMI <mqttClientId> <mqttHost> <mqttPort> <runwayAngle> <windDirOffset> <airPressOffset> [<mqttUser> <mqttPasswd>]\n");
+    QScopedPointer<QCoreApplication> app;
+#ifndef METEOHMI_HEADLESS
+    if (!headless) {
+        QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
+        app.reset(new QGuiApplication(argc, argv));
+    }
+#endif
+    if (headless) {
+        app.reset(new QCoreApplication(argc, argv));
+    }
+
+    // Qt sets the C locale from the environment, payloads and metrics are formatted
+    // with printf and need a '.' as decimal point
+    setlocale(LC_NUMERIC, "C");
+
+    // split "--name[=value]" options from positional arguments
+    // (single dash is left alone, offsets may be negative)
+    QStringList args;
+    QMap<QString, QString> opts;
+    for (int i = 1; i < argc; i++) {
+        QString arg = QString::fromLocal8Bit(argv[i]);
+        if (arg.startsWith("--")) {
+            int eq = arg.indexOf('=');
+            if (eq < 0) {
+                opts.insert(arg.mid(2), QString(""));
+            } else {
+                opts.insert(arg.mid(2, eq - 2), arg.mid(eq + 1));
+            }
+        } else {
+            args.append(arg);
+        }
+    }
+
+    if (args.size() < 6) {
+        printf("usage: MeteoHMI [options] <mqttClientId> <mqttHost> <mqttPort> <runwayAngle> <windDirOffset> <airPressOffset> [<mqttUser> <mqttPasswd>]\n");
+        printf("options:\n");
+#ifndef METEOHMI_HEADLESS
+        printf("  --headless            no display, only CAN -> MQTT\n");
+#endif
+        printf("  --can-batch-size=<n>  max. number of CAN frames fetched per wakeup (default %d)\n", CANRECEIVER_DEFAULT_BATCH_SIZE);
+        printf("  --can-thread          read CAN socket in a separate thread\n");
+        printf("  --can-ring-size=<n>   frames buffered between reader thread and parser (default %d)\n", CANRECEIVER_DEFAULT_RING_SIZE);
+        printf("  --can-rcvbuf=<bytes>  CAN socket receive buffer size (default system setting)\n");
+        printf("  --replay=<file>       replay candump log instead of reading can0\n");
+        printf("  --replay-speed=<x>    replay speed factor, 0 is as fast as possible (default 1)\n");
+        printf("  --replay-exit         quit when the replay is finished\n");
+        printf("  --trace[=<file>]      trace frame latencies, dumped to file (default stderr) on SIGUSR1\n");
+        printf("  --trace-interval=<s>  also dump the latency trace every s seconds\n");
+        printf("  --metrics-port=<n>    serve Prometheus metrics on http://<host>:<n>/metrics\n");
+        printf("  --metrics-topic=<t>   publish metrics as JSON to MQTT topic t\n");
+        printf("  --metrics-interval=<s> metrics publish interval (default 60)\n");
+        printf("  --config=<file>       ini file with the settings below, command line wins\n");
+        printf("  --metrics-bind=<addr> address the metrics port listens on (default 127.0.0.1, 0.0.0.0 for all)\n");
+        printf("  --archive-interval=<s> publish all samples to meteo/archive/... every s seconds (default 0, off)\n");
+        printf("  --store-dir=<dir>     keep all values in daily segment files in dir\n");
+        printf("  --store-interval=<ms> min. time between stored values per quantity (default %d)\n", METEOSTORE_DEFAULT_INTERVAL);
+        printf("  --store-flush=<s>     write the stored values every s seconds (default %d)\n", METEOSTORE_DEFAULT_FLUSH_INTERVAL);
+        printf("  --store-days=<n>      delete segments older than n days (default 0, keep all)\n");
+        printf("  --store-topic=<t>     answer range queries on MQTT topic t (default %s)\n", METEOSTORE_DEFAULT_QUERY_TOPIC);
+        printf("  --mqtt-format=<f>     json, binary (topics meteo/bin/...) or both (default json)\n");
+        printf("  --mqtt-queue-size=<n> messages buffered for the MQTT thread (default %d)\n", MQTTLOOPTHREAD_DEFAULT_QUEUE_SIZE);
+        printf("  --mqtt-spool=<dir>    keep messages in dir while the broker is offline\n");
+        printf("  --mqtt-spool-size=<MB> max. size of the spool (default 64)\n");
+        printf("  --mqtt-replay-rate=<n> spooled messages per second after reconnect (default %d)\n", MQTTLOOPTHREAD_DEFAULT_REPLAY_RATE);
+        printf("  --mqtt-version=<v>    3 (3.1.1, default) or 5 (topic aliases, message expiry)\n");
+        printf("  --mqtt-<t>-max-rate=<hz>   max. messages per second, later values are coalesced\n");
+        printf("  --mqtt-<t>-heartbeat=<s>   resend unchanged values after s seconds\n");
+        printf("  --mqtt-<t>-deadband=<x>    only send if velo (kn), press (hPa) or temp (degC) changed by more than x\n");
+        printf("  --mqtt-<t>-deadband-rel=<f> ... or by more than f * value\n");
+        printf("  --mqtt-<t>-deadband[-rel]-<v>=<x> the same for value v, dir (deg) of wind only this way;\n");
+        printf("                             a changed pressure trend is always sent\n");
+        printf("  --mqtt-<t>-expiry=<s>      MQTT v5 message expiry (default 10 for wind)\n");
+        printf("                        <t> is wind, air-press or air-temp, all 0 (off) by default\n");
         return 1;
     }
 
-    QString mqttClientId(argv[1]);
-    QString mqttHost(argv[2]);
-    int mqttPort = atoi(argv[3]);
-    double runwayAngle = atof(argv[4]);
-    double windDirOffset = atof(argv[5]);
-    double airPressOffset = atof(argv[6]);
+    QString mqttClientId(args[0]);
+    QString mqttHost(args[1]);
+    int mqttPort = args[2].toInt();
+    double runwayAngle = args[3].toDouble();
+    double windDirOffset = args[4].toDouble();
+    double airPressOffset = args[5].toDouble();
 
     QString mqttUser, mqttPasswd;
-    if (argc >= 9) {
-        mqttUser = QString(argv[7]);
-        mqttPasswd = QString(argv[8]);
+    if (args.size() >= 8) {
+        mqttUser = args[6];
+        mqttPasswd = args[7];
     }
 
+    // declared first, the registered metrics live in the objects below
+    MetricsRegistry metrics;
+
     CanReceiver receiver;
-    N2kParser parser(&receiver);
+    receiver.setBatchSize(opts.value("can-batch-size", QString::number(CANRECEIVER_DEFAULT_BATCH_SIZE)).toInt());
+    receiver.setReceiveBufferSize(opts.value("can-rcvbuf", "0").toInt());
+    receiver.setThreaded(opts.contains("can-thread"), opts.value("can-ring-size", QString::number(CANRECEIVER_DEFAULT_RING_SIZE)).toInt());
+
+    CanReplay replay;
+    QString replayFile = opts.value("replay");
+    if (!replayFile.isEmpty()) {
+        if (replay.open(replayFile) != CANREPLAY_ERR_OK) {
+            printf("unable to open replay file %s\n", replayFile.toLocal8Bit().constData());
+            return 1;
+        }
+        replay.setSpeed(opts.value("replay-speed", "1").toDouble());
+        if (opts.contains("replay-exit")) {
+            QObject::connect(&replay, SIGNAL(finished()), app.data(), SLOT(quit()));
+        }
+    }
+
+    CanSource *source = replayFile.isEmpty() ? (CanSource *) &receiver : (CanSource *) &replay;
+    N2kParser parser(source);
     MeteoCollector collector(&parser, windDirOffset, airPressOffset);
-    MeteoBinding meteo(&collector, runwayAngle);
+    if (!replayFile.isEmpty()) {
+        collector.setClock(replay.getClock());
+    }
+
+    QScopedPointer<QSettings> config;
+    if (opts.contains("config")) {
+        config.reset(new QSettings(opts.value("config"), QSettings::IniFormat));
+    }
 
     MqttClient mqtt(mqttClientId);
     if (!mqttUser.isNull()) {
         mqtt.setUsernamePassword(mqttUser, mqttPasswd);
     }
+    mqtt.setQueueSize(configValue(config.data(), opts, "mqtt", "queue-size", QString::number(MQTTLOOPTHREAD_DEFAULT_QUEUE_SIZE)).toInt());
+    mqtt.setReplayRate(configValue(config.data(), opts, "mqtt", "replay-rate", QString::number(MQTTLOOPTHREAD_DEFAULT_REPLAY_RATE)).toInt());
+    QString spoolDir = configValue(config.data(), opts, "mqtt", "spool", QString());
+    if (!spoolDir.isEmpty()) {
+        qint64 spoolSize = (qint64) (configValue(config.data(), opts, "mqtt", "spool-size", "64").toDouble() * 1024.0 * 1024.0);
+        if (mqtt.setSpool(spoolDir, spoolSize) != MQTTSPOOL_ERR_OK) {
+            printf("unable to open MQTT spool %s\n", spoolDir.toLocal8Bit().constData());
+        }
+    }
+    QString mqttFormat = configValue(config.data(), opts, "mqtt", "format", "json");
+    if (configValue(config.data(), opts, "mqtt", "version", "3") == "5") {
+        if (mqtt.setProtocolVersion(5) != MOSQ_ERR_SUCCESS) {
+            printf("MQTT v5 is not supported by libmosquitto, using 3.1.1\n");
+        }
+        // wind is the high rate topic, old values are useless
+        loadMessageExpiry(&mqtt, MqttSender::Wind, config.data(), opts, "mqtt-wind", "10");
+        loadMessageExpiry(&mqtt, MqttSender::AirPress, config.data(), opts, "mqtt-air-press", "0");
+        loadMessageExpiry(&mqtt, MqttSender::AirTemp, config.data(), opts, "mqtt-air-temp", "0");
+        // aliases only for the topics published all the time, wind first
+        for (int i = 0; i < MqttSender::TopicCount; i++) {
+            if (mqttFormat != "binary") {
+                mqtt.setTopicAlias(MqttSender::getTopicName((MqttSender::Topic) i));
+            }
+            if (mqttFormat == "binary" || mqttFormat == "both") {
+                mqtt.setTopicAlias(MqttSender::getBinaryTopicName((MqttSender::Topic) i));
+            }
+        }
+    }
     mqtt.connectBroker(mqttHost, mqttPort, 60, 5);
 
     MqttSender sender(&mqtt, &collector);
+    if (mqttFormat == "binary") {
+        sender.setFormat(MqttSender::Binary);
+    } else if (mqttFormat == "both") {
+        sender.setFormat(MqttSender::JsonAndBinary);
+    } else if (mqttFormat != "json") {
+        printf("unknown MQTT format %s, using json\n", mqttFormat.toLocal8Bit().constData());
+    }
+    loadPublishPolicy(sender.getPolicy(MqttSender::Wind), MqttSender::Wind, config.data(), opts, "mqtt-wind");
+    loadPublishPolicy(sender.getPolicy(MqttSender::AirPress), MqttSender::AirPress, config.data(), opts, "mqtt-air-press");
+    loadPublishPolicy(sender.getPolicy(MqttSender::AirTemp), MqttSender::AirTemp, config.data(), opts, "mqtt-air-temp");
+
+    // raw samples for the archive, the last partial block is sent on exit
+    ArchiveUploader archive(&mqtt, &collector);
+    archive.setInterval(configValue(config.data(), opts, "archive", "interval", "0").toInt());
+    QObject::connect(app.data(), SIGNAL(aboutToQuit()), &archive, SLOT(flush()));
+
+    // local history on disk, batched values are written on exit
+    MeteoStore store(&mqtt, &collector);
+    QString storeDir = configValue(config.data(), opts, "store", "dir", QString());
+    if (!storeDir.isEmpty()) {
+        store.setInterval(configValue(config.data(), opts, "store", "interval", QString::number(METEOSTORE_DEFAULT_INTERVAL)).toInt());
+        store.setFlushInterval(configValue(config.data(), opts, "store", "flush", QString::number(METEOSTORE_DEFAULT_FLUSH_INTERVAL)).toInt());
+        store.setRetention(configValue(config.data(), opts, "store", "days", "0").toInt());
+        if (store.open(storeDir) != METEOSTORE_ERR_OK) {
+            printf("unable to open store %s\n", storeDir.toLocal8Bit().constData());
+        } else {
+            store.setQueryTopic(configValue(config.data(), opts, "store", "topic", METEOSTORE_DEFAULT_QUERY_TOPIC));
+        }
+        QObject::connect(app.data(), SIGNAL(aboutToQuit()), &store, SLOT(flush()));
+    }
+
+    // latencies are measured from kernel receive timestamps, meaningless for a replay
+    LatencyTrace trace;
+    if (opts.contains("trace")) {
+        if (!replayFile.isEmpty()) {
+            printf("latency trace is not available with --replay\n");
+        } else {
+            trace.setDumpFile(opts.value("trace"));
+            trace.setDumpInterval(opts.value("trace-interval", "0").toInt());
+            if (trace.installSignalHandler() != LATENCYTRACE_ERR_OK) {
+                printf("unable to install SIGUSR1 handler for latency trace\n");
+            }
+            receiver.setTrace(&trace);
+            parser.setTrace(&trace);
+            collector.setTrace(&trace);
+        }
+    }
+
+    MetricsServer metricsServer(&metrics);
+    bool metricsEnabled = opts.contains("metrics-port") || opts.contains("metrics-topic");
+    if (metricsEnabled) {
+        receiver.registerMetrics(&metrics);
+        parser.registerMetrics(&metrics);
+        collector.registerMetrics(&metrics);
+        mqtt.registerMetrics(&metrics);
+        sender.registerMetrics(&metrics);
+        archive.registerMetrics(&metrics);
+        store.registerMetrics(&metrics);
+        if (collector.getTrace() != NULL) {
+            trace.registerMetrics(&metrics);
+        }
+        metrics.startLagMonitor(100);
+
+        if (opts.contains("metrics-port")) {
+            quint16 port = opts.value("metrics-port").toUShort();
+            QString bind = configValue(config.data(), opts, "metrics", "bind", "127.0.0.1");
+            QHostAddress address;
+            if (!address.setAddress(bind)) {
+                printf("invalid metrics bind address %s, using 127.0.0.1\n", bind.toLocal8Bit().constData());
+                address = QHostAddress(QHostAddress::LocalHost);
+            }
+            if (metricsServer.startup(port, address) != METRICSSERVER_ERR_OK) {
+                printf("unable to listen for metrics on %s:%d\n", address.toString().toLocal8Bit().constData(), port);
+            }
+        }
+        if (opts.contains("metrics-topic")) {
+            metrics.setMqttStats(&mqtt, opts.value("metrics-topic"), opts.value("metrics-interval", "60").toInt());
+        }
+    }
 
-    QQmlApplicationEngine engine;
-    engine.rootContext()->setContextProperty("meteo", &meteo);
-    engine.load(QUrl(QLatin1String("qrc:/main.qml")));
+#ifndef METEOHMI_HEADLESS
+    QScopedPointer<MeteoBinding> meteo;
+    QScopedPointer<HistoryModel> history;
+    QScopedPointer<QQmlApplicationEngine> engine;
+    if (!headless) {
+        meteo.reset(new MeteoBinding(&collector, runwayAngle));
+        history.reset(new HistoryModel(&collector));
+        qmlRegisterType<GaugeDialItem>("MeteoGauges", 1, 0, "GaugeDial");
+        qmlRegisterType<GaugeNeedleItem>("MeteoGauges", 1, 0, "GaugeNeedle");
+        qmlRegisterType<LinearGaugeItem>("MeteoGauges", 1, 0, "BarGauge");
+        engine.reset(new QQmlApplicationEngine());
+        engine->rootContext()->setContextProperty("meteo", meteo.data());
+        engine->rootContext()->setContextProperty("history", history.data());
+        engine->rootContext()->setContextProperty("store", &store);
+        engine->load(QUrl(QLatin1String("qrc:/main.qml")));
+        // filter steps follow the frames of the main window
+        if (!engine->rootObjects().isEmpty()) {
+            meteo->setWindow(qobject_cast<QQuickWindow *>(engine->rootObjects().first()));
+        }
+    }
+#else
+    Q_UNUSED(runwayAngle);
+#endif
 
-    receiver.startup("can0");
+    if (replayFile.isEmpty()) {
+        receiver.startup("can0");
+    } else {
+        replay.start();
+    }
 
-    return app.exec();
+    return app->exec();
 }
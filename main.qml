@@ -1,8 +1,6 @@
 import QtQuick 2.0
 import QtQuick.Controls 1.4
 import QtQuick.Layouts 1.0
-import QtQuick.Controls.Styles 1.4
-import QtQuick.Extras 1.4
 import QtQuick.Window 2.2
 
 ApplicationWindow {
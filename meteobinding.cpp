@@ -1,15 +1,32 @@
 #include "meteobinding.h"
 
+#include <QTimerEvent>
+#include <QQuickWindow>
+
 #include <math.h>
 
 #define RECEIVE_TIMEOUT 5000
 
+#define STATS_PERIOD_MS 1000
+
+// shortly after the full second, the clock shown should not lag
+#define TICK_PERIOD_MS 1000
+#define TICK_DELAY_MS 20
+
+// step period, frames of the window add steps while it renders
 #define FILTER_PERIOD_MS 30
+// time constants in seconds
 #define FILTER_DIR_DT 0.8
 #define FILTER_VELO_DT 0.5
+// longest step, e.g. after a stalled frame
+#define FILTER_MAX_STEP 0.25
 
-#define FILTER_DIR_FACTOR ((FILTER_PERIOD_MS * 0.001) / FILTER_DIR_DT)
-#define FILTER_VELO_FACTOR ((FILTER_PERIOD_MS * 0.001) / FILTER_VELO_DT)
+// display resolution, a property is only notified if it changes by a step,
+// the filter stops once wind dir and velo are shown as their target
+#define SHOWN_DIR_RESOLUTION 0.1
+#define SHOWN_VELO_RESOLUTION 0.01
+#define SHOWN_AIR_TEMP_RESOLUTION 0.1
+#define SHOWN_AIR_PRESS_RESOLUTION 0.1
 
 #define DEG_TO_RAD (M_PI / 180.0)
 #define RAD_TO_DEG (180.0 / M_PI)
@@ -32,7 +49,23 @@ MeteoBinding::MeteoBinding(MeteoCollector *collector, double runway, QObject *pa
     airTempOk = false;
     airPressOk = false;
 
-    startTimer(FILTER_PERIOD_MS);
+    windTraceOrigin = 0;
+
+    shownWindDir = NAN;
+    shownWindDirAvg = NAN;
+    shownWindVelo = NAN;
+    shownWindVeloPeak = NAN;
+    shownAirTemp = NAN;
+    shownAirPress = NAN;
+    notifyCount = 0;
+
+    window = NULL;
+    filterTimer = 0;
+    filterRunning = false;
+
+    tickTimer = 0;
+    startTick();
+    statsTimer = startTimer(STATS_PERIOD_MS);
 
     emit runwayChanged();
 }
@@ -46,15 +79,142 @@ double MeteoBinding::posAngle(double a) {
     return a;
 }
 
+// true if value is shown different from *shown at the given resolution
+bool MeteoBinding::updateValue(double *shown, double value, double resolution) {
+    if (isnan(value) || isnan(*shown)) {
+        if (isnan(value) && isnan(*shown)) {
+            return false;
+        }
+    } else if (lround(value / resolution) == lround(*shown / resolution)) {
+        return false;
+    }
+
+    *shown = value;
+    notifyCount++;
+    return true;
+}
+
+// filtered current values, for every filter step, true if one is shown different
+bool MeteoBinding::updateWind() {
+    bool changed = false;
+    if (updateValue(&shownWindDir, windDataOk ? posAngle(windDir) : NAN, SHOWN_DIR_RESOLUTION)) {
+        changed = true;
+        emit windDirChanged();
+    }
+    if (updateValue(&shownWindVelo, windDataOk ? windVelo : NAN, SHOWN_VELO_RESOLUTION)) {
+        changed = true;
+        emit windVeloChanged();
+    }
+    return changed;
+}
+
+// average and peak, only change with new data
+void MeteoBinding::updateWindStats() {
+    double avg = windDataOk ? posAngle(collector->getWindDirAvg()) : NAN;
+    if (updateValue(&shownWindDirAvg, avg, SHOWN_DIR_RESOLUTION)) {
+        emit windDirAvgChanged();
+    }
+    double peak = windDataOk ? collector->getWindVeloPeak() : NAN;
+    if (updateValue(&shownWindVeloPeak, peak, SHOWN_VELO_RESOLUTION)) {
+        emit windVeloPeakChanged();
+    }
+}
+
+void MeteoBinding::updateAirTemp() {
+    double temp = airTempOk ? collector->getAirTemp() : NAN;
+    if (updateValue(&shownAirTemp, temp, SHOWN_AIR_TEMP_RESOLUTION)) {
+        emit airTempChanged();
+    }
+}
+
+void MeteoBinding::updateAirPress() {
+    double press = airPressOk ? collector->getAirPress() : NAN;
+    if (updateValue(&shownAirPress, press, SHOWN_AIR_PRESS_RESOLUTION)) {
+        emit airPressChanged();
+    }
+
+    QString trend;
+    if (airPressOk) {
+        switch (collector->getAirPressTrend()) {
+        case MeteoCollector::Rising:
+            trend = "+";
+            break;
+        case MeteoCollector::Falling:
+            trend = "-";
+            break;
+        case MeteoCollector::Unsteady:
+            trend = "~";
+            break;
+        default:
+            trend = " ";
+            break;
+        }
+    }
+    if (trend != shownAirPressTrend) {
+        shownAirPressTrend = trend;
+        notifyCount++;
+        emit airPressTrendChanged();
+    }
+}
+
+void MeteoBinding::updateTime() {
+    struct tm tm;
+    gmtime_r(&last_ti, &tm);
+    shownTime.sprintf("%02d:%02d:%02d UTC %02d.%02d.%04d",
+                    tm.tm_hour, tm.tm_min, tm.tm_sec,
+                    tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900);
+    notifyCount++;
+    emit timeChanged();
+}
+
+void MeteoBinding::setWindow(QQuickWindow *window) {
+    if (this->window != NULL) {
+        disconnect(this->window, &QQuickWindow::afterAnimating, this, &MeteoBinding::frame);
+    }
+
+    this->window = window;
+    if (window != NULL) {
+        connect(window, &QQuickWindow::afterAnimating, this, &MeteoBinding::frame);
+    }
+
+    // continue with the new step source
+    if (filterRunning) {
+        stopFilter();
+        startFilter();
+    }
+}
+
+void MeteoBinding::startTick() {
+    qint64 ms = collector->getClock()->wallTimeMsec() % TICK_PERIOD_MS;
+    tickTimer = startTimer(TICK_PERIOD_MS - ms + TICK_DELAY_MS, Qt::PreciseTimer);
+}
+
 void MeteoBinding::timerEvent(QTimerEvent *event) {
-    Q_UNUSED(event);
+    if (event->timerId() == statsTimer) {
+        emit statsChanged();
+        return;
+    }
+
+    if (event->timerId() == filterTimer) {
+        frame();
+        return;
+    }
+
+    if (event->timerId() == tickTimer) {
+        // restarted every time to stay aligned with the full second
+        killTimer(tickTimer);
+        startTick();
+        tick();
+    }
+}
 
+// clock and receive timeouts, once a second
+void MeteoBinding::tick() {
     // update time
-    time_t ti;
-    time(&ti);
+    time_t ti = collector->getClock()->wallTime();
     if (ti != last_ti) {
         last_ti = ti;
-        emit timeChanged();
+        updateTime();
     }
 
     // check timeouts
@@ -62,35 +222,110 @@ void MeteoBinding::timerEvent(QTimerEvent *event) {
     if (collector->getAirTempTimestamp() < timeout) {
         if (airTempOk) {
             airTempOk = false;
-            emit airTempChanged();
+            updateAirTemp();
         }
     }
     if (collector->getAirPressTimestamp() < timeout) {
         if (airPressOk) {
             airPressOk = false;
-            emit airPressChanged();
+            updateAirPress();
         }
     }
     if (collector->getWindTimestamp() < timeout) {
         if (windDataOk) {
             windDataOk = false;
-            emit windChanged();
+            windTraceOrigin = 0;
+            stopFilter();
+            updateWind();
+            updateWindStats();
         }
     }
+}
 
-    // filter wind data
-    if (windDataOk) {
-        double dir = DEG_TO_RAD * collector->getWindDir();
-        double velo = collector->getWindVelo();
+void MeteoBinding::startFilter() {
+    if (!filterRunning) {
+        filterRunning = true;
+        // the first step only covers the time from now on
+        frameClock.start();
+    }
+
+    // a step does not need a render, frames are only requested for changed values
+    if (filterTimer == 0) {
+        filterTimer = startTimer(FILTER_PERIOD_MS, Qt::PreciseTimer);
+    }
+}
+
+void MeteoBinding::stopFilter() {
+    filterRunning = false;
+
+    if (filterTimer != 0) {
+        killTimer(filterTimer);
+        filterTimer = 0;
+    }
+}
+
+// low pass over the real elapsed time dt (seconds), true once converged
+bool MeteoBinding::filterStep(double dt) {
+    double dir = DEG_TO_RAD * collector->getWindDir();
+    double velo = collector->getWindVelo();
+
+    if (dt > FILTER_MAX_STEP) {
+        dt = FILTER_MAX_STEP;
+    }
+    double dirFactor = 1.0 - exp(-dt / FILTER_DIR_DT);
+    double veloFactor = 1.0 - exp(-dt / FILTER_VELO_DT);
+
+    // filter current values
+    windDirSin = windDirSin + (sin(dir) - windDirSin) * dirFactor;
+    windDirCos = windDirCos + (cos(dir) - windDirCos) * dirFactor;
+    windVelo = windVelo + (velo - windVelo) * veloFactor;
+
+    windDir = RAD_TO_DEG * atan2(windDirSin, windDirCos);
+
+    // the remaining steps move within the shown value, 360 deg is shown as 0
+    long dirSteps = lround(360.0 / SHOWN_DIR_RESOLUTION);
+    long dirShown = lround(posAngle(windDir) / SHOWN_DIR_RESOLUTION) % dirSteps;
+    long dirTarget = lround(posAngle(collector->getWindDir()) / SHOWN_DIR_RESOLUTION) % dirSteps;
+    if (dirShown != dirTarget || lround(windVelo / SHOWN_VELO_RESOLUTION) != lround(velo / SHOWN_VELO_RESOLUTION)) {
+        return false;
+    }
+
+    // snap to the target, nothing visible is left
+    windDirSin = sin(dir);
+    windDirCos = cos(dir);
+    windDir = collector->getWindDir();
+    windVelo = velo;
+    return true;
+}
 
-        // filter current values
-        windDirSin = windDirSin + (sin(dir) - windDirSin) * FILTER_DIR_FACTOR;
-        windDirCos = windDirCos + (cos(dir) - windDirCos) * FILTER_DIR_FACTOR;
-        windVelo = windVelo + (velo - windVelo) * FILTER_VELO_FACTOR;
+void MeteoBinding::frame() {
+    if (!filterRunning) {
+        return;
+    }
 
-        windDir = RAD_TO_DEG * atan2(windDirSin, windDirCos);
+    double dt = frameClock.nsecsElapsed() * 1e-9;
+    frameClock.restart();
 
-        emit windChanged();
+    if (!windDataOk) {
+        stopFilter();
+        return;
+    }
+
+    bool converged = filterStep(dt);
+    bool changed = updateWind();
+
+    // only the first emit after new data counts
+    LatencyTrace *trace = collector->getTrace();
+    if (trace != NULL && windTraceOrigin > 0) {
+        trace->record(LATENCY_STAGE_BIND, windTraceOrigin);
+        windTraceOrigin = 0;
+    }
+
+    // no more steps needed until new data arrive, a render only if the gauges move
+    if (converged) {
+        stopFilter();
+    } else if (changed && window != NULL) {
+        window->update();
     }
 }
 
@@ -106,45 +341,62 @@ void MeteoBinding::windUpdate()
 
     // just set flag, change event is triggered by filter
     windDataOk = true;
+    updateWindStats();
+    startFilter();
+
+    LatencyTrace *trace = collector->getTrace();
+    if (trace != NULL && windTraceOrigin <= 0) {
+        windTraceOrigin = trace->getOrigin();
+    }
 }
 
 void MeteoBinding::airTempUpdate()
 {
     airTempOk = true;
-    emit airTempChanged();
+    updateAirTemp();
+    traceBind();
 }
 
 void MeteoBinding::airPressUpdate()
 {
     airPressOk = true;
-    emit airPressChanged();
+    updateAirPress();
+    traceBind();
 }
 
-QString MeteoBinding::getAirPressTrend()
+void MeteoBinding::traceBind()
 {
-    if (!airPressOk) {
-        return "";
+    LatencyTrace *trace = collector->getTrace();
+    if (trace != NULL) {
+        trace->record(LATENCY_STAGE_BIND);
     }
+}
 
-    switch (collector->getAirPressTrend()) {
-    case MeteoCollector::Rising:
-        return "+";
-    case MeteoCollector::Falling:
-        return "-";
-    case MeteoCollector::Unsteady:
-        return "~";
-    default:
-        return " ";
-    }
+double MeteoBinding::getWindRate() {
+    return collector->getWindArrivals().getRate(collector->currentTimestampUsec());
 }
 
-QString MeteoBinding::getTimeStr() {
-    struct tm tm;
-    gmtime_r(&last_ti, &tm);
-    QString s;
-    s.sprintf("%02d:%02d:%02d UTC %02d.%02d.%04d",
-                    tm.tm_hour, tm.tm_min, tm.tm_sec,
-                    tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900);
-    return s;
+QVariantMap MeteoBinding::getStreamStats() {
+    qint64 now = collector->currentTimestampUsec();
+
+    QVariantMap m;
+    m.insert("wind", collector->getWindArrivals().toVariantMap(now));
+    m.insert("airTemp", collector->getAirTempArrivals().toVariantMap(now));
+    m.insert("airPress", collector->getAirPressArrivals().toVariantMap(now));
+    return m;
 }
 
+QVariantList MeteoBinding::getPgnStats() {
+    qint64 now = collector->currentTimestampUsec();
+    const N2kArrivalTable &arrivals = collector->getParser()->getArrivals();
+
+    QVariantList l;
+    for (int i = 0; i < arrivals.getSize(); i++) {
+        const N2kArrivalTable::Entry &e = arrivals.getEntry(i);
+        QVariantMap m = e.stats.toVariantMap(now);
+        m.insert("pgn", (int) e.pgn);
+        m.insert("source", (int) e.source);
+        l.append(m);
+    }
+    return l;
+}
@@ -3,39 +3,63 @@
 
 #include <QObject>
 #include <QQueue>
+#include <QVariantMap>
+#include <QVariantList>
+#include <QElapsedTimer>
 
 #include <time.h>
 #include <math.h>
 
 #include "meteocollector.h"
 
+class QQuickWindow;
+
 class MeteoBinding : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(double runway READ getRunway NOTIFY runwayChanged)
-    Q_PROPERTY(double windDir READ getWindDir NOTIFY windChanged)
-    Q_PROPERTY(double windDirAvg READ getWindDirAvg NOTIFY windChanged)
-    Q_PROPERTY(double windVelo READ getWindVelo NOTIFY windChanged)
-    Q_PROPERTY(double windVeloPeak READ getWindVeloPeak NOTIFY windChanged)
+    Q_PROPERTY(double windDir READ getWindDir NOTIFY windDirChanged)
+    Q_PROPERTY(double windDirAvg READ getWindDirAvg NOTIFY windDirAvgChanged)
+    Q_PROPERTY(double windVelo READ getWindVelo NOTIFY windVeloChanged)
+    Q_PROPERTY(double windVeloPeak READ getWindVeloPeak NOTIFY windVeloPeakChanged)
     Q_PROPERTY(double airTemp READ getAirTemp NOTIFY airTempChanged)
     Q_PROPERTY(double airPress READ getAirPress NOTIFY airPressChanged)
-    Q_PROPERTY(QString airPressTrend READ getAirPressTrend NOTIFY airPressChanged)
+    Q_PROPERTY(QString airPressTrend READ getAirPressTrend NOTIFY airPressTrendChanged)
     Q_PROPERTY(QString time READ getTimeStr NOTIFY timeChanged)
+    Q_PROPERTY(double windRate READ getWindRate NOTIFY statsChanged)
+    Q_PROPERTY(QVariantMap streamStats READ getStreamStats NOTIFY statsChanged)
+    Q_PROPERTY(QVariantList pgnStats READ getPgnStats NOTIFY statsChanged)
 public:
     explicit MeteoBinding(MeteoCollector *collector, double runway, QObject *parent = 0);
 
+    // the wind filter steps on a timer while the values move, and with the frames of window;
+    // window is only asked for a frame when a shown value changed
+    void setWindow(QQuickWindow *window);
+    bool isFiltering() { return filterRunning; }
+
     double getRunway() { return runway; }
 
-    double getWindDir() { return windDataOk ? posAngle(windDir) : NAN; }
-    double getWindDirAvg() { return windDataOk ? posAngle(collector->getWindDirAvg()) : NAN; }
-    double getWindVelo() { return windDataOk ? windVelo : NAN; }
-    double getWindVeloPeak() { return windDataOk ? collector->getWindVeloPeak() : NAN; }
+    // values as last notified, NAN while not received
+    double getWindDir() { return shownWindDir; }
+    double getWindDirAvg() { return shownWindDirAvg; }
+    double getWindVelo() { return shownWindVelo; }
+    double getWindVeloPeak() { return shownWindVeloPeak; }
+
+    double getAirTemp() { return shownAirTemp; }
+    double getAirPress() { return shownAirPress; }
 
-    double getAirTemp() { return airTempOk ? collector->getAirTemp() : NAN; }
-    double getAirPress() { return airPressOk ? collector->getAirPress() : NAN; }
+    QString getAirPressTrend() { return shownAirPressTrend; }
+    QString getTimeStr() { return shownTime; }
 
-    QString getAirPressTrend();
-    QString getTimeStr();
+    // property change signals emitted so far
+    quint64 getNotifyCount() { return notifyCount; }
+
+    // arrival statistics, refreshed every second
+    double getWindRate();
+    // wind/airTemp/airPress as used by the collector
+    QVariantMap getStreamStats();
+    // every (PGN, source) seen by the parser
+    QVariantList getPgnStats();
 
 private:
     MeteoCollector *collector;
@@ -44,6 +68,15 @@ private:
 
     time_t last_ti;
 
+    QQuickWindow *window;
+    int filterTimer;
+    int tickTimer;
+    int statsTimer;
+
+    // real time since the last filter step
+    bool filterRunning;
+    QElapsedTimer frameClock;
+
     bool windDataOk;
     double windDirSin;
     double windDirCos;
@@ -53,7 +86,33 @@ private:
     bool airTempOk;
     bool airPressOk;
 
+    // trace origin of wind data not yet shown
+    qint64 windTraceOrigin;
+
+    // cached property values, a signal is only emitted if the display changes
+    double shownWindDir;
+    double shownWindDirAvg;
+    double shownWindVelo;
+    double shownWindVeloPeak;
+    double shownAirTemp;
+    double shownAirPress;
+    QString shownAirPressTrend;
+    QString shownTime;
+    quint64 notifyCount;
+
     double posAngle(double a);
+    bool updateValue(double *shown, double value, double resolution);
+    bool updateWind();
+    void updateWindStats();
+    void updateAirTemp();
+    void updateAirPress();
+    void updateTime();
+    void traceBind();
+    void startTick();
+    void tick();
+    void startFilter();
+    void stopFilter();
+    bool filterStep(double dt);
 
 protected:
     void timerEvent(QTimerEvent *event);
@@ -61,9 +120,18 @@ protected:
 signals:
     void timeChanged();
     void runwayChanged();
-    void windChanged();
+    void windDirChanged();
+    void windDirAvgChanged();
+    void windVeloChanged();
+    void windVeloPeakChanged();
     void airTempChanged();
     void airPressChanged();
+    void airPressTrendChanged();
+    void statsChanged();
+
+public slots:
+    // one filter step, called for every frame of the window
+    void frame();
 
 private slots:
     void windUpdate();
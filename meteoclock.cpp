@@ -0,0 +1,30 @@
+#include "meteoclock.h"
+
+qint64 MeteoClock::monotonic() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (qint64) tp.tv_sec * 1000LL + ((qint64) tp.tv_nsec / 1000000LL);
+}
+
+qint64 MeteoClock::monotonicUsec() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (qint64) tp.tv_sec * 1000000LL + ((qint64) tp.tv_nsec / 1000LL);
+}
+
+time_t MeteoClock::wallTime() {
+    time_t ti;
+    time(&ti);
+    return ti;
+}
+
+qint64 MeteoClock::wallTimeMsec() {
+    struct timespec tp;
+    clock_gettime(CLOCK_REALTIME, &tp);
+    return (qint64) tp.tv_sec * 1000LL + ((qint64) tp.tv_nsec / 1000000LL);
+}
+
+MeteoClock *MeteoClock::system() {
+    static MeteoClock clock;
+    return &clock;
+}
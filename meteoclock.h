@@ -0,0 +1,45 @@
+#ifndef METEOCLOCK_H
+#define METEOCLOCK_H
+
+#include <QtGlobal>
+
+#include <time.h>
+
+// Time source for the data pipeline, replaced by a ReplayClock when a log is replayed.
+class MeteoClock
+{
+public:
+    virtual ~MeteoClock() {}
+
+    // msec, CLOCK_MONOTONIC base like the frame timestamps
+    virtual qint64 monotonic();
+    // usec, same base
+    virtual qint64 monotonicUsec();
+    // seconds since epoch
+    virtual time_t wallTime();
+    // msec since epoch
+    virtual qint64 wallTimeMsec();
+
+    // shared instance reading the system clocks
+    static MeteoClock *system();
+};
+
+// Clock that only moves when the replay advances it.
+class ReplayClock : public MeteoClock
+{
+public:
+    ReplayClock() : now(0) {}
+
+    qint64 monotonic() { return now; }
+    qint64 monotonicUsec() { return now * 1000LL; }
+    time_t wallTime() { return (time_t) (now / 1000LL); }
+    qint64 wallTimeMsec() { return now; }
+
+    // msec since epoch of the replayed frame, also used as monotonic time
+    void advance(qint64 msec) { if (msec > now) now = msec; }
+
+private:
+    qint64 now;
+};
+
+#endif // METEOCLOCK_H
@@ -1,7 +1,6 @@
 #include "meteocollector.h"
 
 #include <math.h>
-#include <time.h>
 
 #define AVG_WINDOW (5L * 60L * 1000L)
 
@@ -14,12 +13,15 @@
 #define DEG_TO_RAD (M_PI / 180.0)
 #define RAD_TO_DEG (180.0 / M_PI)
 
-MeteoCollector::MeteoCollector(const QObject *parser, double windDirOffset, double airPressOffset, QObject *parent)
-    : QObject(parent), windDirOffset(windDirOffset * DEG_TO_RAD), airPressOffset(airPressOffset)
+MeteoCollector::MeteoCollector(N2kParser *parser, double windDirOffset, double airPressOffset, QObject *parent)
+    : QObject(parent), parser(parser), windDirOffset(windDirOffset * DEG_TO_RAD), airPressOffset(airPressOffset), windAvg(AVG_WINDOW)
 {
-    connect(parser, SIGNAL(receivedWindData(int, N2K_WIND_REF_T, double, double)), this, SLOT(receivedWindData(int, N2K_WIND_REF_T, double, double)));
-    connect(parser, SIGNAL(receivedTemperature(int, int, N2K_TEMP_SRC_T, double, double)), this, SLOT(receivedTemperature(int, int, N2K_TEMP_SRC_T, double, double)));
-    connect(parser, SIGNAL(receivedActualPressure(int, int, N2K_PRESS_SRC_T, double)), this, SLOT(receivedActualPressure(int, int, N2K_PRESS_SRC_T, double)));
+    connect(parser, &N2kParser::receivedWindData, this, &MeteoCollector::receivedWindData, Qt::DirectConnection);
+    connect(parser, &N2kParser::receivedTemperature, this, &MeteoCollector::receivedTemperature, Qt::DirectConnection);
+    connect(parser, &N2kParser::receivedActualPressure, this, &MeteoCollector::receivedActualPressure, Qt::DirectConnection);
+
+    clock = MeteoClock::system();
+    trace = NULL;
 
     windVelo = 0.0;
     windVeloPeak = 0.0;
@@ -37,65 +39,52 @@ MeteoCollector::MeteoCollector(const QObject *parser, double windDirOffset, doub
     airPressTimestamp = 0;
 }
 
-qint64 MeteoCollector::currentTimestamp() {
-    struct timespec tp;
-    clock_gettime(CLOCK_MONOTONIC, &tp);
-    return (qint64) tp.tv_sec * 1000LL + ((qint64) tp.tv_nsec / 1000000LL);
+void MeteoCollector::registerMetrics(MetricsRegistry *metrics) {
+    metrics->addCounter("meteo_collector_updates_total", "Collector updates per quantity", "quantity=\"wind\"", &windUpdates);
+    metrics->addCounter("meteo_collector_updates_total", "Collector updates per quantity", "quantity=\"air_temp\"", &airTempUpdates);
+    metrics->addCounter("meteo_collector_updates_total", "Collector updates per quantity", "quantity=\"air_press\"", &airPressUpdates);
+    metrics->addCounter("meteo_collector_wind_window_overflow_total", "Wind samples dropped early from the average window", QString(), &windAvgOverflows);
 }
 
 double MeteoCollector::normalizeAngle(double a) {
     return atan2(sin(a), cos(a));
 }
 
-void MeteoCollector::receivedWindData(int sid, N2K_WIND_REF_T ref, double velo, double dir) {
-    Q_UNUSED(sid);
+void MeteoCollector::receivedWindData(qint64 timestamp, int sid, N2K_WIND_REF_T ref, double velo, double dir) {
     Q_UNUSED(ref);
 
+    windArrivals.record(parser->getFrameTimestamp(), sid);
+
     dir += windDirOffset;
 
     MeteoWindAvgItem last;
-    last.timestamp = currentTimestamp();
+    last.timestamp = timestamp;
     last.dirSin = sin(dir);
     last.dirCos = cos(dir);
     last.velo = velo;
 
-    // remove old items
-    qint64 timeout = last.timestamp - AVG_WINDOW;
-    while(!windAvgQueue.isEmpty()) {
-        const MeteoWindAvgItem &item = windAvgQueue.head();
-        if (item.timestamp > timeout) {
-            break;
-        }
-        windAvgQueue.dequeue();
-    }
-
-    // add new item to avg queue
-    windAvgQueue.enqueue(last);
-
-    // build avg/max values
-    double dirSinSum = 0.0;
-    double dirCosSum = 0.0;
-    double veloPeak = 0.0;
-    QListIterator<MeteoWindAvgItem> iter(windAvgQueue);
-    while (iter.hasNext()) {
-        const MeteoWindAvgItem &item = iter.next();
-        dirSinSum += item.dirSin * item.velo;
-        dirCosSum += item.dirCos * item.velo;
-        if (item.velo > veloPeak) {
-            veloPeak = item.velo;
+    // add new item to avg window, expires old ones
+    windAvg.add(last);
+    if (windAvg.getOverflowCount() != windAvgOverflows.get()) {
+        if (windAvgOverflows.get() == 0) {
+            qWarning("wind above %d Hz, the average window holds only %d samples", WIND_AVG_MAX_RATE, windAvg.getCapacity());
         }
+        windAvgOverflows.set(windAvg.getOverflowCount());
     }
 
     windDir = RAD_TO_DEG * atan2(last.dirSin, last.dirCos);
-    windDirAvg = RAD_TO_DEG * atan2(dirSinSum, dirCosSum);
+    windDirAvg = RAD_TO_DEG * atan2(windAvg.getDirSinSum(), windAvg.getDirCosSum());
     windVelo = MTRPERSEC_TO_KNOTS * last.velo;
-    windVeloPeak = MTRPERSEC_TO_KNOTS * veloPeak;
+    windVeloPeak = MTRPERSEC_TO_KNOTS * windAvg.getVeloPeak();
     windTimestamp = last.timestamp;
+    windUpdates.inc();
+    if (trace != NULL) {
+        trace->record(LATENCY_STAGE_COLLECT);
+    }
     emit windUpdate();
 }
 
-void MeteoCollector::receivedTemperature(int sid, int inst, N2K_TEMP_SRC_T source, double temp, double setp) {
-    Q_UNUSED(sid);
+void MeteoCollector::receivedTemperature(qint64 timestamp, int sid, int inst, N2K_TEMP_SRC_T source, double temp, double setp) {
     Q_UNUSED(inst);
     Q_UNUSED(setp);
 
@@ -103,20 +92,26 @@ void MeteoCollector::receivedTemperature(int sid, int inst, N2K_TEMP_SRC_T sourc
         return;
     }
 
+    airTempArrivals.record(parser->getFrameTimestamp(), sid);
+
     airTemp = temp;
-    airTempTimestamp = currentTimestamp();
+    airTempTimestamp = timestamp;
+    airTempUpdates.inc();
+    if (trace != NULL) {
+        trace->record(LATENCY_STAGE_COLLECT);
+    }
     emit airTempUpdate();
 }
 
-void MeteoCollector::receivedActualPressure(int sid, int inst, N2K_PRESS_SRC_T source, double press) {
-    Q_UNUSED(sid);
+void MeteoCollector::receivedActualPressure(qint64 timestamp, int sid, int inst, N2K_PRESS_SRC_T source, double press) {
     Q_UNUSED(inst);
 
     if (source != N2K_PRESS_SRC_ATMOSPHERIC) {
         return;
     }
 
-    qint64 timestamp = currentTimestamp();
+    airPressArrivals.record(parser->getFrameTimestamp(), sid);
+
     press += airPressOffset;
 
     qint64 timeout = timestamp - TREND_INTERVAL;
@@ -155,6 +150,10 @@ void MeteoCollector::receivedActualPressure(int sid, int inst, N2K_PRESS_SRC_T s
 
     airPress = press;
     airPressTimestamp = timestamp;
+    airPressUpdates.inc();
+    if (trace != NULL) {
+        trace->record(LATENCY_STAGE_COLLECT);
+    }
     emit airPressUpdate();
 }
 
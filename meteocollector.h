@@ -5,14 +5,11 @@
 #include <QQueue>
 
 #include "n2kparser.h"
-
-class MeteoWindAvgItem {
-public:
-    qint64 timestamp;
-    double dirSin;
-    double dirCos;
-    double velo;
-};
+#include "windavgwindow.h"
+#include "meteoclock.h"
+#include "latencytrace.h"
+#include "metricsregistry.h"
+#include "arrivalstats.h"
 
 class MeteoAirPressTrendItem {
 public:
@@ -26,7 +23,7 @@ class MeteoCollector : public QObject
 public:
     enum AirPressTrend { Steady, Unsteady, Rising, Falling };
 
-    explicit MeteoCollector(const QObject *parser, double windDirOffset, double airPressOffset, QObject *parent = 0);
+    explicit MeteoCollector(N2kParser *parser, double windDirOffset, double airPressOffset, QObject *parent = 0);
 
     double getWindVelo() { return windVelo; }
     double getWindVeloPeak() { return windVeloPeak; }
@@ -36,7 +33,28 @@ public:
     double getAirPress() { return airPress; }
     enum AirPressTrend getAirPressTrend() { return airPressTrend; }
 
-    qint64 currentTimestamp();
+    // time source, defaults to the system clocks
+    void setClock(MeteoClock *clock) { this->clock = clock; }
+    MeteoClock *getClock() { return clock; }
+
+    // latency tracing for the collector and its consumers, NULL disables
+    void setTrace(LatencyTrace *trace) { this->trace = trace; }
+    LatencyTrace *getTrace() { return trace; }
+
+    // export update counters
+    void registerMetrics(MetricsRegistry *metrics);
+
+    N2kParser *getParser() { return parser; }
+
+    // arrival statistics of the messages actually used, per quantity
+    const ArrivalStats &getWindArrivals() { return windArrivals; }
+    const ArrivalStats &getAirTempArrivals() { return airTempArrivals; }
+    const ArrivalStats &getAirPressArrivals() { return airPressArrivals; }
+
+    // msec, CLOCK_MONOTONIC, same base as the frame timestamps
+    qint64 currentTimestamp() { return clock->monotonic(); }
+    // usec, same base as the arrival statistics
+    qint64 currentTimestampUsec() { return clock->monotonicUsec(); }
 
     qint64 getWindTimestamp() { return windTimestamp; }
     qint64 getAirTempTimestamp() { return airTempTimestamp; }
@@ -47,6 +65,10 @@ public:
 private:
     double normalizeAngle(double a);
 
+    N2kParser *parser;
+    MeteoClock *clock;
+    LatencyTrace *trace;
+
     double windDirOffset;
     double airPressOffset;
 
@@ -54,7 +76,7 @@ private:
     double windDirAvg;
     double windVelo;
     double windVeloPeak;
-    QQueue<MeteoWindAvgItem> windAvgQueue;
+    WindAvgWindow windAvg;
 
     double airTemp;
     double airPress;
@@ -67,15 +89,25 @@ private:
     qint64 airTempTimestamp;
     qint64 airPressTimestamp;
 
+    MetricsCounter windUpdates;
+    MetricsCounter airTempUpdates;
+    MetricsCounter airPressUpdates;
+    // mirrored from windAvg
+    MetricsCounter windAvgOverflows;
+
+    ArrivalStats windArrivals;
+    ArrivalStats airTempArrivals;
+    ArrivalStats airPressArrivals;
+
 signals:
     void windUpdate();
     void airTempUpdate();
     void airPressUpdate();
 
 private slots:
-    void receivedWindData(int sid, N2K_WIND_REF_T ref, double velo, double dir);
-    void receivedTemperature(int sid, int inst, N2K_TEMP_SRC_T source, double temp, double setp);
-    void receivedActualPressure(int sid, int inst, N2K_PRESS_SRC_T source, double press);
+    void receivedWindData(qint64 timestamp, int sid, N2K_WIND_REF_T ref, double velo, double dir);
+    void receivedTemperature(qint64 timestamp, int sid, int inst, N2K_TEMP_SRC_T source, double temp, double setp);
+    void receivedActualPressure(qint64 timestamp, int sid, int inst, N2K_PRESS_SRC_T source, double press);
 };
 
 #endif // METEOCOLLECTOR_H
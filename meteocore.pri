@@ -0,0 +1,52 @@
+# Data pipeline shared by MeteoHMI and MeteoBench
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/n2kparser.cpp \
+    $$PWD/n2kfastpacket.cpp \
+    $$PWD/n2karrivaltable.cpp \
+    $$PWD/arrivalstats.cpp \
+    $$PWD/meteocollector.cpp \
+    $$PWD/meteoclock.cpp \
+    $$PWD/latencyhistogram.cpp \
+    $$PWD/latencytrace.cpp \
+    $$PWD/metricsregistry.cpp \
+    $$PWD/windavgwindow.cpp \
+    $$PWD/mqttclient.cpp \
+    $$PWD/mqttsender.cpp \
+    $$PWD/archiveuploader.cpp \
+    $$PWD/mqttloopthread.cpp \
+    $$PWD/mqttspool.cpp \
+    $$PWD/publishpolicy.cpp \
+    $$PWD/historypyramid.cpp \
+    $$PWD/storesegment.cpp \
+    $$PWD/meteostore.cpp
+
+HEADERS += \
+    $$PWD/cansource.h \
+    $$PWD/canframe.h \
+    $$PWD/spscring.h \
+    $$PWD/n2kparser.h \
+    $$PWD/n2kfield.h \
+    $$PWD/n2kpgns.h \
+    $$PWD/n2kfastpacket.h \
+    $$PWD/n2karrivaltable.h \
+    $$PWD/arrivalstats.h \
+    $$PWD/meteocollector.h \
+    $$PWD/meteoclock.h \
+    $$PWD/latencyhistogram.h \
+    $$PWD/latencytrace.h \
+    $$PWD/metricsregistry.h \
+    $$PWD/windavgwindow.h \
+    $$PWD/mqttclient.h \
+    $$PWD/mqttsender.h \
+    $$PWD/archiveuploader.h \
+    $$PWD/mqttloopthread.h \
+    $$PWD/mqttspool.h \
+    $$PWD/publishpolicy.h \
+    $$PWD/historypyramid.h \
+    $$PWD/storesegment.h \
+    $$PWD/meteostore.h
+
+LIBS += -lmosquitto
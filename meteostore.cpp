@@ -0,0 +1,506 @@
+#include "meteostore.h"
+
+#include <QDir>
+#include <QStringList>
+#include <QVariantMap>
+#include <QJsonDocument>
+#include <QTimerEvent>
+#include <QtNumeric>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// records per segment on top of one per interval, e.g. a leap second or a clock step
+#define SEGMENT_SLACK 1024
+#define DEFAULT_QUERY_POINTS 500
+
+static const char *QUANTITY_NAMES[] = { "windVelo", "windDir", "airPress", "airTemp" };
+
+// stream and channel of a quantity
+static const MeteoStore::Stream QUANTITY_STREAM[] = {
+    MeteoStore::WindStream, MeteoStore::WindStream, MeteoStore::AirPressStream, MeteoStore::AirTempStream
+};
+static const int QUANTITY_CHANNEL[] = { 0, 1, 0, 0 };
+
+// merges items falling into the same time bin into one point
+class StoreBinner
+{
+public:
+    StoreBinner(qint64 from, qint64 width, bool circular, QVector<HistoryPoint> *out) :
+        from(from), width(width), circular(circular), out(out), binIndex(-1) {}
+
+    void add(const HistoryBucket &bucket) {
+        qint64 index = (qMax(bucket.timestamp, from) - from) / width;
+        if (index == binIndex) {
+            HistoryPyramid::mergeBucket(&bin, bucket, circular);
+            return;
+        }
+        finish();
+        bin = bucket;
+        binIndex = index;
+    }
+
+    void finish() {
+        if (binIndex >= 0) {
+            HistoryPoint point;
+            HistoryPyramid::bucketToPoint(bin, circular, &point);
+            out->append(point);
+            binIndex = -1;
+        }
+    }
+
+private:
+    qint64 from;
+    qint64 width;
+    bool circular;
+    QVector<HistoryPoint> *out;
+    HistoryBucket bin;
+    qint64 binIndex;
+};
+
+MeteoStore::MeteoStore(MqttClient *mqtt, MeteoCollector *collector, QObject *parent) : QObject(parent), mqtt(mqtt), collector(collector)
+{
+    connect(collector, SIGNAL(windUpdate()), this, SLOT(windUpdate()));
+    connect(collector, SIGNAL(airTempUpdate()), this, SLOT(airTempUpdate()));
+    connect(collector, SIGNAL(airPressUpdate()), this, SLOT(airPressUpdate()));
+
+    interval = METEOSTORE_DEFAULT_INTERVAL;
+    flushInterval = METEOSTORE_DEFAULT_FLUSH_INTERVAL;
+    retention = 0;
+    flushTimer = 0;
+
+    static const char *STREAM_NAMES[] = { "wind", "airpress", "airtemp" };
+    for (int i = 0; i < StreamCount; i++) {
+        StreamState &s = streams[i];
+        s.name = STREAM_NAMES[i];
+        s.channels = 1;
+        s.circularMask = 0;
+        s.batch.resize(METEOSTORE_BATCH_SIZE);
+        s.batchCount = 0;
+        s.lastTimestamp = 0;
+    }
+    // velo and dir
+    streams[WindStream].channels = 2;
+    streams[WindStream].circularMask = 1U << 1;
+}
+
+MeteoStore::~MeteoStore()
+{
+    flush();
+}
+
+int MeteoStore::open(const QString &dir) {
+    QDir d(dir);
+    if (!d.mkpath(".")) {
+        return METEOSTORE_ERR_CREATE_DIR;
+    }
+    this->dir = dir;
+
+    qint64 now = collector->getClock()->wallTimeMsec();
+    scanSegments(now - now % STORESEGMENT_DAY_MS);
+
+    if (flushTimer == 0) {
+        flushTimer = startTimer(flushInterval * 1000);
+    }
+    return METEOSTORE_ERR_OK;
+}
+
+QString MeteoStore::segmentPath(Stream stream, qint64 day) {
+    time_t t = (time_t) (day / 1000);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/%04d%02d%02d-%s.seg", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, streams[stream].name);
+    return dir + name;
+}
+
+// drop segments beyond the retention, list the days on disk per stream for queries
+void MeteoStore::scanSegments(qint64 today) {
+    QDir d(dir);
+    QStringList names = d.entryList(QStringList() << "*.seg", QDir::Files, QDir::Name);
+
+    for (int i = 0; i < StreamCount; i++) {
+        streams[i].days.resize(0);
+    }
+
+    for (int i = 0; i < names.size(); i++) {
+        struct tm tm;
+        char name[16];
+        memset(&tm, 0, sizeof(tm));
+        if (sscanf(names[i].toLocal8Bit().constData(), "%4d%2d%2d-%15[a-z].seg", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, name) != 4) {
+            continue;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        qint64 day = (qint64) timegm(&tm) * 1000LL;
+
+        if (retention > 0 && day < today - retention * STORESEGMENT_DAY_MS) {
+            d.remove(names[i]);
+            continue;
+        }
+
+        // names sort by day
+        for (int j = 0; j < StreamCount; j++) {
+            if (strcmp(name, streams[j].name) == 0) {
+                streams[j].days.append(day);
+                break;
+            }
+        }
+    }
+}
+
+// queries never look past the current day
+qint64 MeteoStore::endOfToday() {
+    qint64 now = collector->getClock()->wallTimeMsec();
+    return now - now % STORESEGMENT_DAY_MS + STORESEGMENT_DAY_MS;
+}
+
+// the requester picks the reply topic, keep it below the response topic
+bool MeteoStore::isReplyTopic(const QString &topic) {
+    static const QString prefix = QString(METEOSTORE_DEFAULT_RESPONSE_TOPIC) + "/";
+
+    if (topic.contains('+') || topic.contains('#')) {
+        return false;
+    }
+    return topic == METEOSTORE_DEFAULT_RESPONSE_TOPIC || (topic.startsWith(prefix) && topic.size() > prefix.size());
+}
+
+void MeteoStore::registerMetrics(MetricsRegistry *metrics) {
+    for (int i = 0; i < StreamCount; i++) {
+        QString labels = QString("stream=\"%1\"").arg(streams[i].name);
+        metrics->addCounter("meteo_store_records_total", "Records written to the store", labels, &streams[i].records);
+        metrics->addCounter("meteo_store_dropped_total", "Records lost, segment full or not writable", labels, &streams[i].dropped);
+    }
+    metrics->addCounter("meteo_store_flushes_total", "Batched writes to the store", QString(), &flushes);
+    metrics->addCounter("meteo_store_queries_total", "Range queries served by the store", QString(), &queries);
+}
+
+void MeteoStore::add(Stream stream, qint64 timestamp, double v0, double v1) {
+    if (!isOpen() || isnan(v0) || isnan(v1)) {
+        return;
+    }
+
+    // samples carry monotonic timestamps, the segments are by calendar day
+    MeteoClock *clock = collector->getClock();
+    qint64 wall = timestamp + clock->wallTimeMsec() - clock->monotonic();
+
+    StreamState &s = streams[stream];
+    if (wall - s.lastTimestamp < interval) {
+        return;
+    }
+    s.lastTimestamp = wall;
+
+    if (s.batchCount == METEOSTORE_BATCH_SIZE) {
+        flushStream(stream);
+    }
+
+    StoreRecord &r = s.batch[s.batchCount++];
+    r.timestamp = wall;
+    r.values[0] = (float) v0;
+    r.values[1] = (float) v1;
+}
+
+int MeteoStore::createSegment(Stream stream, qint64 day, StoreSegment *segment) {
+    StreamState &s = streams[stream];
+    quint32 capacity = (quint32) (STORESEGMENT_DAY_MS / interval) + SEGMENT_SLACK;
+    return segment->create(segmentPath(stream, day), day, capacity, s.channels, s.circularMask);
+}
+
+int MeteoStore::openSegment(Stream stream, qint64 day) {
+    StreamState &s = streams[stream];
+    s.segment.close();
+
+    int err = createSegment(stream, day, &s.segment);
+    if (err == STORESEGMENT_ERR_OK) {
+        scanSegments(day);
+    }
+    return err;
+}
+
+void MeteoStore::flushStream(Stream stream) {
+    StreamState &s = streams[stream];
+    if (s.batchCount == 0) {
+        return;
+    }
+
+    for (int i = 0; i < s.batchCount; i++) {
+        const StoreRecord &r = s.batch[i];
+
+        // new day, new segment
+        qint64 day = r.timestamp - r.timestamp % STORESEGMENT_DAY_MS;
+        if (!s.segment.isOpen() || s.segment.getDayStart() != day) {
+            if (openSegment(stream, day) != STORESEGMENT_ERR_OK) {
+                printf("unable to open store segment %s\n", segmentPath(stream, day).toLocal8Bit().constData());
+                s.dropped.inc(s.batchCount - i);
+                break;
+            }
+        }
+
+        if (s.segment.append(r) != STORESEGMENT_ERR_OK) {
+            s.dropped.inc();
+            continue;
+        }
+        s.records.inc();
+    }
+    s.batchCount = 0;
+
+    s.segment.sync();
+    flushes.inc();
+}
+
+void MeteoStore::flush() {
+    for (int i = 0; i < StreamCount; i++) {
+        flushStream((Stream) i);
+    }
+}
+
+void MeteoStore::timerEvent(QTimerEvent *event) {
+    if (event->timerId() == flushTimer) {
+        flush();
+    }
+}
+
+int MeteoStore::findQuantity(const QString &name) {
+    for (int i = 0; i < QuantityCount; i++) {
+        if (name == QUANTITY_NAMES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// a summary per minute, converted back to statistics that merge like samples
+void MeteoStore::queryMinutes(StoreSegment *segment, int channel, bool circular, qint64 from, qint64 to, StoreBinner *binner) {
+    qint64 day = segment->getDayStart();
+    qint64 first = (from - day) / STORESEGMENT_MINUTE_MS;
+    qint64 last = (to - 1 - day) / STORESEGMENT_MINUTE_MS;
+    first = qMax(first, (qint64) 0);
+    last = qMin(last, (qint64) (STORESEGMENT_MINUTES - 1));
+
+    for (int m = first; m <= last; m++) {
+        const StoreMinute &minute = segment->getMinute(m);
+        if (minute.count == 0) {
+            continue;
+        }
+
+        double mean = minute.mean[channel];
+        HistoryBucket bucket;
+        bucket.timestamp = day + m * STORESEGMENT_MINUTE_MS;
+        bucket.count = minute.count;
+        if (circular) {
+            double a = mean * M_PI / 180.0;
+            bucket.ref = mean;
+            bucket.min = minute.min[channel] - mean;
+            bucket.max = minute.max[channel] - mean;
+            bucket.sum = 0.0;
+            bucket.sinSum = sin(a) * minute.count;
+            bucket.cosSum = cos(a) * minute.count;
+        } else {
+            bucket.ref = 0.0;
+            bucket.min = minute.min[channel];
+            bucket.max = minute.max[channel];
+            bucket.sum = mean * minute.count;
+            bucket.sinSum = 0.0;
+            bucket.cosSum = 0.0;
+        }
+        binner->add(bucket);
+    }
+}
+
+void MeteoStore::queryRecords(StoreSegment *segment, int channel, bool circular, qint64 from, qint64 to, StoreBinner *binner) {
+    quint32 count = segment->getCount();
+    for (quint32 i = segment->findFirst(from); i < count; i++) {
+        const StoreRecord &record = segment->getRecord(i);
+        if (record.timestamp >= to) {
+            break;
+        }
+
+        HistoryBucket sample;
+        HistoryPyramid::sampleBucket(record.timestamp, record.values[channel], circular, &sample);
+        binner->add(sample);
+    }
+}
+
+int MeteoStore::query(Quantity quantity, qint64 from, qint64 to, int points, QVector<HistoryPoint> *out) {
+    out->resize(0);
+    if (!isOpen() || quantity < 0 || quantity >= QuantityCount) {
+        return 0;
+    }
+
+    Stream stream = QUANTITY_STREAM[quantity];
+    int channel = QUANTITY_CHANNEL[quantity];
+    StreamState &s = streams[stream];
+    bool circular = (s.circularMask & (1U << channel)) != 0;
+
+    // nothing stored before the oldest segment or after today
+    if (s.days.isEmpty()) {
+        return 0;
+    }
+    from = qMax(from, s.days.first());
+    to = qMin(to, endOfToday());
+    points = qMin(points, METEOSTORE_MAX_POINTS);
+    if (to <= from || points <= 0) {
+        return 0;
+    }
+    queries.inc();
+
+    qint64 width = (to - from + points - 1) / points;
+    StoreBinner binner(from, width, circular, out);
+
+    // only the segments that exist
+    qint64 firstDay = from - from % STORESEGMENT_DAY_MS;
+    for (int i = 0; i < s.days.size(); i++) {
+        qint64 day = s.days[i];
+        if (day < firstDay) {
+            continue;
+        }
+        if (day >= to) {
+            break;
+        }
+
+        // the segment being written is already mapped
+        StoreSegment reader;
+        StoreSegment *segment = &reader;
+        if (s.segment.isOpen() && s.segment.getDayStart() == day) {
+            segment = &s.segment;
+        } else if (reader.open(segmentPath(stream, day)) != STORESEGMENT_ERR_OK) {
+            continue;
+        }
+
+        if (width >= STORESEGMENT_MINUTE_MS) {
+            queryMinutes(segment, channel, circular, qMax(from, day), to, &binner);
+        } else {
+            queryRecords(segment, channel, circular, qMax(from, day), to, &binner);
+        }
+    }
+    binner.finish();
+
+    return out->size();
+}
+
+QVariantList MeteoStore::series(const QString &quantity, double span, int points) {
+    qint64 now = collector->getClock()->wallTimeMsec();
+    return seriesRange(quantity, (double) now - span * 1000.0, (double) now, points);
+}
+
+QVariantList MeteoStore::seriesRange(const QString &quantity, double from, double to, int points) {
+    QVariantList l;
+    int q = findQuantity(quantity);
+    if (q < 0 || !qIsFinite(from) || !qIsFinite(to)) {
+        return l;
+    }
+
+    // in range of qint64 before the conversion, query() clamps further
+    double end = (double) endOfToday();
+    int count = query((Quantity) q, (qint64) qBound(0.0, from, end), (qint64) qBound(0.0, to, end), points, &this->points);
+    l.reserve(count);
+    for (int i = 0; i < count; i++) {
+        const HistoryPoint &p = this->points[i];
+        QVariantMap m;
+        m.insert("t", (double) p.timestamp);
+        m.insert("min", p.min);
+        m.insert("max", p.max);
+        m.insert("mean", p.mean);
+        l.append(m);
+    }
+    return l;
+}
+
+void MeteoStore::setQueryTopic(const QString &topic) {
+    if (queryTopic.isEmpty() && !topic.isEmpty()) {
+        // signals come from the MQTT thread
+        connect(mqtt, SIGNAL(onConnect(int)), this, SLOT(mqttConnect(int)), Qt::QueuedConnection);
+        connect(mqtt, SIGNAL(onMessage(int, QString, QByteArray, int, bool)), this, SLOT(mqttMessage(int, QString, QByteArray, int, bool)), Qt::QueuedConnection);
+    }
+    queryTopic = topic;
+
+    if (!queryTopic.isEmpty() && mqtt->getIsOnline()) {
+        mqtt->subscribe(queryTopic, 0);
+    }
+}
+
+// clean session, subscribe again with every connect
+void MeteoStore::mqttConnect(int rc) {
+    if (rc == 0 && !queryTopic.isEmpty()) {
+        mqtt->subscribe(queryTopic, 0);
+    }
+}
+
+void MeteoStore::mqttMessage(int mid, const QString &topic, const QByteArray &payload, int qos, bool retain) {
+    Q_UNUSED(mid);
+    Q_UNUSED(qos);
+    Q_UNUSED(retain);
+
+    if (queryTopic.isEmpty() || topic != queryTopic) {
+        return;
+    }
+
+    QVariantMap request = QJsonDocument::fromJson(payload).toVariant().toMap();
+    QString reply = request.value("reply", METEOSTORE_DEFAULT_RESPONSE_TOPIC).toString();
+    QString quantity = request.value("quantity").toString();
+    double end = (double) endOfToday();
+    double to = request.contains("to") ? request.value("to").toDouble() : (double) collector->getClock()->wallTimeMsec();
+    double from = request.contains("from") ? request.value("from").toDouble() : to - STORESEGMENT_DAY_MS;
+    int points = request.value("points", DEFAULT_QUERY_POINTS).toInt();
+
+    // any JSON value, written back as it came
+    QByteArray id = QJsonDocument::fromVariant(QVariantList() << request.value("id")).toJson(QJsonDocument::Compact);
+    id = id.mid(1, id.size() - 2);
+
+    response.clear();
+    response.append("{\"id\":");
+    response.append(id);
+
+    if (!isReplyTopic(reply)) {
+        response.append(",\"error\":\"invalid reply topic\"}");
+        mqtt->publish(METEOSTORE_DEFAULT_RESPONSE_TOPIC, response);
+        return;
+    }
+
+    if (!qIsFinite(from) || !qIsFinite(to)) {
+        response.append(",\"error\":\"invalid range\"}");
+        mqtt->publish(reply, response);
+        return;
+    }
+
+    int q = findQuantity(quantity);
+    if (q < 0) {
+        response.append(",\"error\":\"unknown quantity\"}");
+        mqtt->publish(reply, response);
+        return;
+    }
+
+    // in range of qint64 before the conversion, query() clamps further
+    int count = query((Quantity) q, (qint64) qBound(0.0, from, end), (qint64) qBound(0.0, to, end), points, &this->points);
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), ",\"quantity\":\"%s\",\"points\":[", QUANTITY_NAMES[q]);
+    response.append(buf);
+    for (int i = 0; i < count; i++) {
+        const HistoryPoint &p = this->points[i];
+        snprintf(buf, sizeof(buf), "%s[%lld,%.3f,%.3f,%.3f]", (i > 0) ? "," : "",
+                 (long long) p.timestamp, p.min, p.max, p.mean);
+        response.append(buf);
+    }
+    response.append("]}");
+
+    mqtt->publish(reply, response);
+}
+
+void MeteoStore::windUpdate()
+{
+    add(WindStream, collector->getWindTimestamp(), collector->getWindVelo(), collector->getWindDir());
+}
+
+void MeteoStore::airPressUpdate()
+{
+    add(AirPressStream, collector->getAirPressTimestamp(), collector->getAirPress());
+}
+
+void MeteoStore::airTempUpdate()
+{
+    add(AirTempStream, collector->getAirTempTimestamp(), collector->getAirTemp());
+}
@@ -0,0 +1,141 @@
+#ifndef METEOSTORE_H
+#define METEOSTORE_H
+
+#include <QObject>
+#include <QVector>
+#include <QVariantList>
+#include <QByteArray>
+
+#include "mqttclient.h"
+#include "meteocollector.h"
+#include "metricsregistry.h"
+#include "historypyramid.h"
+#include "storesegment.h"
+
+#define METEOSTORE_ERR_OK 0
+#define METEOSTORE_ERR_CREATE_DIR -1
+
+// msec between stored records per stream
+#define METEOSTORE_DEFAULT_INTERVAL 1000
+// seconds between writes to the segments
+#define METEOSTORE_DEFAULT_FLUSH_INTERVAL 60
+// records per stream kept between writes, a full batch is written early
+#define METEOSTORE_BATCH_SIZE 4096
+#define METEOSTORE_MAX_POINTS 5000
+
+#define METEOSTORE_DEFAULT_QUERY_TOPIC "meteo/store/query"
+// replies only go to this topic or below it
+#define METEOSTORE_DEFAULT_RESPONSE_TOPIC "meteo/store/response"
+
+class StoreBinner;
+
+// On-disk archive of the collector values in daily segments <dir>/<yyyymmdd>-<stream>.seg
+// per stream (wind velo and dir, air press, air temp), at most one record per interval.
+// Records are batched in memory and appended once per flush interval, so the SD card
+// sees one sequential write per stream and interval. Range queries use the minute
+// summaries of the segments for spans with at least a minute per point, else the records;
+// data of the current flush interval is not yet visible to them.
+// Queries are served to QML (series, seriesRange) and over MQTT: a request
+//   { "quantity": "windVelo", "from": <msec>, "to": <msec>, "points": <n>, "id": <any>, "reply": <topic> }
+// on the query topic is answered on reply (meteo/store/response or a topic below it) with
+//   { "id": <id>, "quantity": "windVelo", "points": [[<msec>, <min>, <max>, <mean>], ...] }
+// Ranges end with the current day at the latest and only read segments that exist.
+class MeteoStore : public QObject
+{
+    Q_OBJECT
+public:
+    enum Stream { WindStream, AirPressStream, AirTempStream, StreamCount };
+    // as HistoryModel
+    enum Quantity { WindVelo, WindDir, AirPress, AirTemp, QuantityCount };
+
+    explicit MeteoStore(MqttClient *mqtt, MeteoCollector *collector, QObject *parent = 0);
+    virtual ~MeteoStore();
+
+    // change before open()
+    void setInterval(int msec) { interval = (msec > 0) ? msec : 1; }
+    void setFlushInterval(int sec) { flushInterval = (sec > 0) ? sec : 1; }
+    // days of segments kept, 0 keeps all
+    void setRetention(int days) { retention = days; }
+
+    int open(const QString &dir);
+    bool isOpen() { return !dir.isEmpty(); }
+
+    // answer queries on topic, empty disables
+    void setQueryTopic(const QString &topic);
+
+    static int findQuantity(const QString &name);
+    // segment file of a stream and day (msec since epoch, UTC midnight)
+    QString segmentPath(Stream stream, qint64 day);
+    // create or open that file for writing, sized for the interval
+    int createSegment(Stream stream, qint64 day, StoreSegment *segment);
+
+    // points of [from, to) in msec since epoch, at most points
+    int query(Quantity quantity, qint64 from, qint64 to, int points, QVector<HistoryPoint> *out);
+
+    // as HistoryModel: the last span seconds or a range in msec since epoch, as up to
+    // points maps { t, min, max, mean }
+    Q_INVOKABLE QVariantList series(const QString &quantity, double span, int points);
+    Q_INVOKABLE QVariantList seriesRange(const QString &quantity, double from, double to, int points);
+
+    void registerMetrics(MetricsRegistry *metrics);
+
+public slots:
+    // write the batched records
+    void flush();
+
+private:
+    struct StreamState {
+        const char *name;
+        int channels;
+        quint32 circularMask;
+        StoreSegment segment;
+        // start of the segments on disk, ascending
+        QVector<qint64> days;
+        QVector<StoreRecord> batch;
+        int batchCount;
+        qint64 lastTimestamp;
+        MetricsCounter records;
+        MetricsCounter dropped;
+    };
+
+    MqttClient *mqtt;
+    MeteoCollector *collector;
+
+    QString dir;
+    int interval;
+    int flushInterval;
+    int retention;
+    int flushTimer;
+
+    StreamState streams[StreamCount];
+
+    QString queryTopic;
+    // reused for queries
+    QVector<HistoryPoint> points;
+    QByteArray response;
+
+    MetricsCounter flushes;
+    MetricsCounter queries;
+
+    void scanSegments(qint64 today);
+    qint64 endOfToday();
+    bool isReplyTopic(const QString &topic);
+    void add(Stream stream, qint64 timestamp, double v0, double v1 = 0.0);
+    void flushStream(Stream stream);
+    int openSegment(Stream stream, qint64 day);
+    void queryMinutes(StoreSegment *segment, int channel, bool circular, qint64 from, qint64 to, StoreBinner *binner);
+    void queryRecords(StoreSegment *segment, int channel, bool circular, qint64 from, qint64 to, StoreBinner *binner);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private slots:
+    void windUpdate();
+    void airTempUpdate();
+    void airPressUpdate();
+    void mqttConnect(int rc);
+    void mqttMessage(int mid, const QString &topic, const QByteArray &payload, int qos, bool retain);
+
+};
+
+#endif // METEOSTORE_H
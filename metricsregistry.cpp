@@ -0,0 +1,227 @@
+#include "metricsregistry.h"
+#include "mqttclient.h"
+
+#include <QTimerEvent>
+
+#include <stdio.h>
+#include <time.h>
+
+static const double SUMMARY_QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static qint64 monotonicUsec() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (qint64) tp.tv_sec * 1000000LL + (qint64) (tp.tv_nsec / 1000L);
+}
+
+MetricsRegistry::MetricsRegistry(QObject *parent) : QObject(parent)
+{
+    lagTimer = 0;
+    lagInterval = 0;
+    lagLast = 0;
+
+    statsTimer = 0;
+    statsMqtt = NULL;
+}
+
+void MetricsRegistry::add(const char *name, const char *help, const QString &labels, MetricType type, const void *metric, double scale) {
+    Entry e;
+    e.name = name;
+    e.help = help;
+    e.labels = labels.toUtf8();
+    e.type = type;
+    e.metric = metric;
+    e.scale = scale;
+    entries.append(e);
+}
+
+void MetricsRegistry::addCounter(const char *name, const char *help, const QString &labels, MetricsCounter *counter) {
+    add(name, help, labels, COUNTER, counter, 1.0);
+}
+
+void MetricsRegistry::addGauge(const char *name, const char *help, const QString &labels, MetricsGauge *gauge) {
+    add(name, help, labels, GAUGE, gauge, 1.0);
+}
+
+void MetricsRegistry::addHistogram(const char *name, const char *help, const QString &labels, LatencyHistogram *histogram, double scale) {
+    add(name, help, labels, SUMMARY, histogram, scale);
+}
+
+void MetricsRegistry::remove(const void *metric) {
+    for (int i = entries.size() - 1; i >= 0; i--) {
+        if (entries[i].metric == metric) {
+            entries.remove(i);
+        }
+    }
+}
+
+QByteArray MetricsRegistry::joinLabels(const QByteArray &labels, const char *extra) {
+    QByteArray out;
+    if (labels.isEmpty() && extra == NULL) {
+        return out;
+    }
+
+    out.append('{');
+    out.append(labels);
+    if (extra != NULL) {
+        if (!labels.isEmpty()) {
+            out.append(',');
+        }
+        out.append(extra);
+    }
+    out.append('}');
+    return out;
+}
+
+QByteArray MetricsRegistry::formatText() {
+    emit collect();
+
+    QByteArray out;
+    char buf[64];
+
+    // samples of one metric have to be grouped below a single HELP/TYPE
+    for (int i = 0; i < entries.size(); i++) {
+        bool first = true;
+        for (int j = 0; j < i; j++) {
+            if (entries[j].name == entries[i].name) {
+                first = false;
+                break;
+            }
+        }
+        if (!first) {
+            continue;
+        }
+
+        const Entry &head = entries[i];
+        out.append("# HELP ").append(head.name).append(' ').append(head.help).append('\n');
+        out.append("# TYPE ").append(head.name).append(' ');
+        switch (head.type) {
+        case COUNTER:
+            out.append("counter\n");
+            break;
+        case GAUGE:
+            out.append("gauge\n");
+            break;
+        default:
+            out.append("summary\n");
+            break;
+        }
+
+        for (int j = i; j < entries.size(); j++) {
+            const Entry &e = entries[j];
+            if (e.name != head.name) {
+                continue;
+            }
+
+            switch (e.type) {
+            case COUNTER:
+                snprintf(buf, sizeof(buf), " %llu\n", (unsigned long long) ((const MetricsCounter *) e.metric)->get());
+                out.append(e.name).append(joinLabels(e.labels, NULL)).append(buf);
+                break;
+            case GAUGE:
+                snprintf(buf, sizeof(buf), " %.9g\n", ((const MetricsGauge *) e.metric)->get());
+                out.append(e.name).append(joinLabels(e.labels, NULL)).append(buf);
+                break;
+            case SUMMARY: {
+                const LatencyHistogram *h = (const LatencyHistogram *) e.metric;
+                for (unsigned int q = 0; q < sizeof(SUMMARY_QUANTILES) / sizeof(SUMMARY_QUANTILES[0]); q++) {
+                    char quantile[32];
+                    snprintf(quantile, sizeof(quantile), "quantile=\"%g\"", SUMMARY_QUANTILES[q]);
+                    snprintf(buf, sizeof(buf), " %.9g\n", (double) h->getPercentile(SUMMARY_QUANTILES[q]) * e.scale);
+                    out.append(e.name).append(joinLabels(e.labels, quantile)).append(buf);
+                }
+                snprintf(buf, sizeof(buf), " %.9g\n", (double) h->getSum() * e.scale);
+                out.append(e.name).append("_sum").append(joinLabels(e.labels, NULL)).append(buf);
+                snprintf(buf, sizeof(buf), " %llu\n", (unsigned long long) h->getCount());
+                out.append(e.name).append("_count").append(joinLabels(e.labels, NULL)).append(buf);
+                break;
+            }
+            }
+        }
+    }
+
+    return out;
+}
+
+QByteArray MetricsRegistry::formatJson() {
+    emit collect();
+
+    QByteArray out("{");
+    char buf[64];
+
+    // flat object, keys are name{labels} like in the text format
+    for (int i = 0; i < entries.size(); i++) {
+        const Entry &e = entries[i];
+        QByteArray key = e.name + joinLabels(e.labels, NULL);
+        key.replace('"', "'");
+
+        if (i > 0) {
+            out.append(',');
+        }
+        out.append('"').append(key).append("\":");
+
+        switch (e.type) {
+        case COUNTER:
+            snprintf(buf, sizeof(buf), "%llu", (unsigned long long) ((const MetricsCounter *) e.metric)->get());
+            break;
+        case GAUGE:
+            snprintf(buf, sizeof(buf), "%.9g", ((const MetricsGauge *) e.metric)->get());
+            break;
+        case SUMMARY: {
+            const LatencyHistogram *h = (const LatencyHistogram *) e.metric;
+            snprintf(buf, sizeof(buf), "{\"n\":%llu,\"p50\":%.6g,\"p99\":%.6g,\"max\":%.6g}",
+                     (unsigned long long) h->getCount(),
+                     (double) h->getPercentile(0.5) * e.scale,
+                     (double) h->getPercentile(0.99) * e.scale,
+                     (double) h->getMax() * e.scale);
+            break;
+        }
+        }
+        out.append(buf);
+    }
+
+    out.append('}');
+    return out;
+}
+
+void MetricsRegistry::startLagMonitor(int intervalMs) {
+    if (lagTimer != 0) {
+        return;
+    }
+
+    lagInterval = intervalMs;
+    lagLast = monotonicUsec();
+    lagTimer = startTimer(intervalMs, Qt::PreciseTimer);
+
+    addHistogram("meteo_event_loop_lag_seconds", "Delay of timer events behind schedule", QString(), &lagHistogram, 1e-6);
+    addGauge("meteo_event_loop_lag_last_seconds", "Last measured event loop delay", QString(), &lagGauge);
+}
+
+void MetricsRegistry::setMqttStats(MqttClient *mqtt, const QString &topic, int intervalSec) {
+    if (statsTimer != 0) {
+        killTimer(statsTimer);
+        statsTimer = 0;
+    }
+
+    statsMqtt = mqtt;
+    statsTopic = topic;
+    if (mqtt != NULL && intervalSec > 0) {
+        statsTimer = startTimer(intervalSec * 1000);
+    }
+}
+
+void MetricsRegistry::timerEvent(QTimerEvent *event) {
+    if (event->timerId() == lagTimer) {
+        qint64 now = monotonicUsec();
+        qint64 lag = now - lagLast - (qint64) lagInterval * 1000LL;
+        lagLast = now;
+
+        if (lag < 0) {
+            lag = 0;
+        }
+        lagHistogram.record(lag);
+        lagGauge.set((double) lag * 1e-6);
+    } else if (event->timerId() == statsTimer) {
+        statsMqtt->publish(statsTopic, formatJson());
+    }
+}
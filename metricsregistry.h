@@ -0,0 +1,108 @@
+#ifndef METRICSREGISTRY_H
+#define METRICSREGISTRY_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+#include <atomic>
+
+#include "latencyhistogram.h"
+
+class MqttClient;
+
+// Monotonic counter. inc() is a relaxed load/store and assumes a single writing thread,
+// which is the case for every counter in the pipeline. Any thread may read.
+class MetricsCounter
+{
+public:
+    MetricsCounter() : value(0) {}
+
+    inline void inc(quint64 n = 1) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    // mirror a total that is counted elsewhere
+    inline void set(quint64 v) { value.store(v, std::memory_order_relaxed); }
+    inline quint64 get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    Q_DISABLE_COPY(MetricsCounter)
+    std::atomic<quint64> value;
+};
+
+// Current value of something
+class MetricsGauge
+{
+public:
+    MetricsGauge() : value(0.0) {}
+
+    inline void set(double v) { value.store(v, std::memory_order_relaxed); }
+    inline double get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    Q_DISABLE_COPY(MetricsGauge)
+    std::atomic<double> value;
+};
+
+// Named view of metrics owned by the pipeline objects. The registry only keeps pointers,
+// metrics have to outlive it or be removed. Exported as Prometheus text or flat JSON.
+class MetricsRegistry : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsRegistry(QObject *parent = 0);
+
+    // labels are preformatted, e.g. pgn="130306"
+    void addCounter(const char *name, const char *help, const QString &labels, MetricsCounter *counter);
+    void addGauge(const char *name, const char *help, const QString &labels, MetricsGauge *gauge);
+    // exported as summary, values are multiplied by scale (e.g. 1e-6 for usec to seconds)
+    void addHistogram(const char *name, const char *help, const QString &labels, LatencyHistogram *histogram, double scale);
+    void remove(const void *metric);
+
+    QByteArray formatText();
+    QByteArray formatJson();
+
+    // measure event loop lag with a timer of the given period
+    void startLagMonitor(int intervalMs);
+
+    // publish formatJson() every interval seconds (0 = never)
+    void setMqttStats(MqttClient *mqtt, const QString &topic, int intervalSec);
+
+signals:
+    // emitted before every export so owners can refresh mirrored values
+    void collect();
+
+private:
+    enum MetricType { COUNTER, GAUGE, SUMMARY };
+
+    struct Entry {
+        QByteArray name;
+        QByteArray help;
+        QByteArray labels;
+        MetricType type;
+        const void *metric;
+        double scale;
+    };
+
+    QVector<Entry> entries;
+
+    void add(const char *name, const char *help, const QString &labels, MetricType type, const void *metric, double scale);
+    static QByteArray joinLabels(const QByteArray &labels, const char *extra);
+
+    int lagTimer;
+    int lagInterval;
+    qint64 lagLast;
+    LatencyHistogram lagHistogram;
+    MetricsGauge lagGauge;
+
+    int statsTimer;
+    MqttClient *statsMqtt;
+    QString statsTopic;
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+};
+
+#endif // METRICSREGISTRY_H
@@ -0,0 +1,61 @@
+#include "metricsserver.h"
+
+MetricsServer::MetricsServer(MetricsRegistry *registry, QObject *parent) : QObject(parent), registry(registry)
+{
+    connect(&server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+int MetricsServer::startup(quint16 port, const QHostAddress &address) {
+    if (!server.listen(address, port)) {
+        return METRICSSERVER_ERR_LISTEN;
+    }
+
+    return METRICSSERVER_ERR_OK;
+}
+
+void MetricsServer::shutdown() {
+    server.close();
+}
+
+void MetricsServer::newConnection() {
+    QTcpSocket *socket;
+    while ((socket = server.nextPendingConnection()) != NULL) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void MetricsServer::readyRead() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (socket == NULL) {
+        return;
+    }
+
+    // wait for the complete header, the request line is all we need
+    QByteArray request = socket->peek(METRICSSERVER_MAX_REQUEST);
+    if (!request.contains("\r\n\r\n") && !request.contains("\n\n")) {
+        if (request.size() >= METRICSSERVER_MAX_REQUEST) {
+            socket->abort();
+        }
+        return;
+    }
+    socket->readAll();
+
+    if (request.startsWith("GET /metrics ") || request.startsWith("GET / ")) {
+        respond(socket, "200 OK", registry->formatText());
+    } else {
+        respond(socket, "404 Not Found", QByteArray("not found\n"));
+    }
+}
+
+void MetricsServer::respond(QTcpSocket *socket, const char *status, const QByteArray &body) {
+    QByteArray header("HTTP/1.0 ");
+    header.append(status);
+    header.append("\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: ");
+    header.append(QByteArray::number(body.size()));
+    header.append("\r\nConnection: close\r\n\r\n");
+
+    socket->write(header);
+    socket->write(body);
+    socket->disconnectFromHost();
+}
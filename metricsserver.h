@@ -0,0 +1,40 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+
+#include "metricsregistry.h"
+
+#define METRICSSERVER_ERR_OK      0
+#define METRICSSERVER_ERR_LISTEN -1
+
+// max. size of a request header before the connection is dropped
+#define METRICSSERVER_MAX_REQUEST 4096
+
+// Minimal HTTP/1.0 endpoint answering GET /metrics with the Prometheus text format.
+// There is no authentication, so it only listens on localhost unless told otherwise.
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(MetricsRegistry *registry, QObject *parent = 0);
+
+    int startup(quint16 port, const QHostAddress &address = QHostAddress(QHostAddress::LocalHost));
+    void shutdown();
+
+private:
+    MetricsRegistry *registry;
+    QTcpServer server;
+
+    void respond(QTcpSocket *socket, const char *status, const QByteArray &body);
+
+private slots:
+    void newConnection();
+    void readyRead();
+
+};
+
+#endif // METRICSSERVER_H
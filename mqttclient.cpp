@@ -7,6 +7,15 @@ static void connect_callback(struct mosquitto *mosq, void *obj, int rc)
     client->connectCallback(rc);
 }
 
+static void connect_v5_callback(struct mosquitto *mosq, void *obj, int rc, int flags, const mosquitto_property *props)
+{
+    Q_UNUSED(mosq)
+    Q_UNUSED(rc)
+    Q_UNUSED(flags)
+    MqttClient *client = (MqttClient *) obj;
+    client->connectPropertiesCallback(props);
+}
+
 static void disconnect_callback(struct mosquitto *mosq, void *obj, int rc)
 {
     Q_UNUSED(mosq)
@@ -52,21 +61,30 @@ static void log_callback(struct mosquitto *mosq, void *obj, int level, const cha
 MqttClient::MqttClient(QString clientId, bool cleanSession, QObject *parent) : QObject(parent)
 {
     isConnected = false;
+    isOnline.store(false);
 
     mosq = mosquitto_new(clientId.isNull() ? NULL : clientId.toLocal8Bit().constData(), cleanSession, (void *) this);
 
+    // only the loop thread does socket I/O, packets queued from other threads
+    // are not written inline and their callbacks run on the loop thread
+    mosquitto_threaded_set(mosq, true);
+
     mosquitto_connect_callback_set(mosq, connect_callback);
+    mosquitto_connect_v5_callback_set(mosq, connect_v5_callback);
     mosquitto_disconnect_callback_set(mosq, disconnect_callback);
     mosquitto_publish_callback_set(mosq, publish_callback);
     mosquitto_message_callback_set(mosq, message_callback);
     mosquitto_subscribe_callback_set(mosq, subscribe_callback);
     mosquitto_unsubscribe_callback_set(mosq, unsubscribe_callback);
     mosquitto_log_callback_set(mosq, log_callback);
+
+    loop = new MqttLoopThread(mosq, this);
 }
 
 MqttClient::~MqttClient()
 {
     disconnectBroker();
+    delete loop;
     mosquitto_destroy(mosq);
 }
 
@@ -75,6 +93,19 @@ int MqttClient::setUsernamePassword(const QString &username, const QString &pass
     return mosquitto_username_pw_set(mosq, username.toLocal8Bit().constData(), password.toLocal8Bit().constData());
 }
 
+int MqttClient::setProtocolVersion(int version)
+{
+    if (isConnected) {
+        return MOSQ_ERR_INVAL;
+    }
+
+    int rc = mosquitto_int_option(mosq, MOSQ_OPT_PROTOCOL_VERSION, (version == 5) ? MQTT_PROTOCOL_V5 : MQTT_PROTOCOL_V311);
+    if (rc == MOSQ_ERR_SUCCESS) {
+        loop->setProtocolV5(version == 5);
+    }
+    return rc;
+}
+
 int MqttClient::connectBroker(const QString &host, int port, int keepalive, unsigned int reconnect_delay)
 {
     int rc;
@@ -83,19 +114,19 @@ int MqttClient::connectBroker(const QString &host, int port, int keepalive, unsi
         return MOSQ_ERR_SUCCESS;
     }
 
-    rc =  mosquitto_reconnect_delay_set(mosq, reconnect_delay, reconnect_delay, false);
-    if (rc != MOSQ_ERR_SUCCESS) {
-        return rc;
+    if (!loop->isValid()) {
+        return MOSQ_ERR_ERRNO;
     }
 
-    mosquitto_connect_async(mosq, host.toLocal8Bit().constData(), port, keepalive);
-
-    rc = mosquitto_loop_start(mosq);
-    if (rc != MOSQ_ERR_SUCCESS) {
-        mosquitto_disconnect(mosq);
+    // a failed attempt is repeated by the loop thread
+    rc = mosquitto_connect_async(mosq, host.toLocal8Bit().constData(), port, keepalive);
+    if (rc == MOSQ_ERR_INVAL) {
         return rc;
     }
 
+    loop->setReconnectDelay(reconnect_delay);
+    loop->start();
+
     isConnected = true;
 
     return MOSQ_ERR_SUCCESS;
@@ -109,46 +140,110 @@ void MqttClient::disconnectBroker()
 
     isConnected = false;
 
-    mosquitto_disconnect(mosq);
-    mosquitto_loop_stop(mosq, false);
+    // disconnects from the broker when done
+    loop->stop();
 }
 
 int MqttClient::publish(const QString &topic, const QByteArray &payload, int qos, bool retain, int *mid)
 {
-    return mosquitto_publish(mosq,
-                             mid,
-                             topic.toLocal8Bit().constData(),
-                             payload.length(),
-                             payload.constData(),
-                             qos,
-                             retain);
+    return publish(topic.toLocal8Bit().constData(), payload.constData(), payload.length(), qos, retain, mid);
+}
+
+int MqttClient::publish(const char *topic, const void *payload, int len, int qos, bool retain, int *mid)
+{
+    if (mid == NULL) {
+        if (!isConnected) {
+            publishFailCount.inc();
+            return MOSQ_ERR_NO_CONN;
+        }
+        // a full queue is counted by the loop thread
+        return loop->post(topic, payload, len, qos, retain) ? MOSQ_ERR_SUCCESS : MOSQ_ERR_NOMEM;
+    }
+
+    int rc = mosquitto_publish(mosq,
+                               mid,
+                               topic,
+                               len,
+                               payload,
+                               qos,
+                               retain);
+
+    if (rc == MOSQ_ERR_SUCCESS) {
+        publishCount.inc();
+        loop->wake();
+    } else {
+        publishFailCount.inc();
+    }
+
+    return rc;
+}
+
+void MqttClient::registerMetrics(MetricsRegistry *metrics)
+{
+    metrics->addCounter("meteo_mqtt_publish_total", "Messages accepted by libmosquitto", "path=\"direct\"", &publishCount);
+    metrics->addCounter("meteo_mqtt_publish_failures_total", "Messages rejected by libmosquitto", QString(), &publishFailCount);
+    metrics->addCounter("meteo_mqtt_publish_done_total", "Messages sent (QoS 0) or acknowledged (QoS 1/2)", QString(), &publishDoneCount);
+    metrics->addGauge("meteo_mqtt_queue_depth", "Accepted messages not yet sent or acknowledged", QString(), &queueDepth);
+    metrics->addGauge("meteo_mqtt_online", "1 while connected to the broker", QString(), &online);
+    loop->registerMetrics(metrics);
+
+    connect(metrics, &MetricsRegistry::collect, this, &MqttClient::collectMetrics, Qt::DirectConnection);
+}
 
+void MqttClient::collectMetrics()
+{
+    queueDepth.set((double) (loop->getPublishedCount() + publishCount.get() - publishDoneCount.get()));
+    online.set(isOnline.load() ? 1.0 : 0.0);
 }
 
 int MqttClient::subscribe(const QString &sub, int qos, int *mid)
 {
-    return mosquitto_subscribe(mosq, mid, sub.toLocal8Bit().constData(), qos);
+    int rc = mosquitto_subscribe(mosq, mid, sub.toLocal8Bit().constData(), qos);
+    if (rc == MOSQ_ERR_SUCCESS) {
+        loop->wake();
+    }
+    return rc;
 }
 
 int MqttClient::unsubscribe(const QString &sub, int *mid)
 {
-    return mosquitto_unsubscribe(mosq, mid, sub.toLocal8Bit().constData());
+    int rc = mosquitto_unsubscribe(mosq, mid, sub.toLocal8Bit().constData());
+    if (rc == MOSQ_ERR_SUCCESS) {
+        loop->wake();
+    }
+    return rc;
 }
 
 void MqttClient::connectCallback(int rc)
 {
-    isOnline = true;
+    isOnline.store(rc == 0);
+    loop->setOnline(rc == 0);
     emit onConnect(rc);
 }
 
+// called after connectCallback, limits announced by the broker in the CONNACK
+void MqttClient::connectPropertiesCallback(const mosquitto_property *props)
+{
+    quint16 topicAliasMax = 0;
+    quint16 receiveMax = 0;
+
+    mosquitto_property_read_int16(props, MQTT_PROP_TOPIC_ALIAS_MAXIMUM, &topicAliasMax, false);
+    mosquitto_property_read_int16(props, MQTT_PROP_RECEIVE_MAXIMUM, &receiveMax, false);
+
+    loop->setBrokerLimits(topicAliasMax, receiveMax);
+}
+
 void MqttClient::disconnectCallback(int rc)
 {
-    isOnline = false;
+    isOnline.store(false);
+    loop->setOnline(false);
     emit onDisconnect(rc);
 }
 
 void MqttClient::publishCallback(int mid)
 {
+    publishDoneCount.inc();
+    loop->messageDone(mid);
     emit onPublish(mid);
 }
 
@@ -9,6 +9,11 @@
 #include <QVector>
 #include <QSocketNotifier>
 
+#include <atomic>
+
+#include "metricsregistry.h"
+#include "mqttloopthread.h"
+
 class MqttClient : public QObject
 {
     Q_OBJECT
@@ -18,17 +23,38 @@ public:
 
     int setUsernamePassword(const QString &username, const QString &password);
 
+    // outbound queue slots and spool for messages published while offline,
+    // change before connectBroker
+    void setQueueSize(int size) { loop->setQueueSize(size); }
+    int setSpool(const QString &dir, qint64 maxSize) { return loop->setSpool(dir, maxSize); }
+    void setReplayRate(int msgPerSec) { loop->setReplayRate(msgPerSec); }
+    // 3 (3.1.1, default) or 5, change before connectBroker
+    int setProtocolVersion(int version);
+    // MQTT v5 message expiry in seconds for a topic, change before connectBroker
+    void setMessageExpiry(const QString &topic, int seconds) { loop->setMessageExpiry(topic.toLocal8Bit(), seconds); }
+    // MQTT v5 topic alias for a frequently published topic, the first ones set win if the
+    // broker allows fewer, change before connectBroker
+    void setTopicAlias(const QString &topic) { loop->setTopicAlias(topic.toLocal8Bit()); }
+
     int connectBroker(const QString &host, int port, int keepalive, unsigned int reconnect_delay);
     void disconnectBroker();
 
     bool getIsConnected() { return isConnected; }
-    bool getIsOnline() { return isOnline; }
+    bool getIsOnline() { return isOnline.load(); }
 
+    // queued for the loop thread, call from one thread only; with mid != NULL the
+    // message is handed to libmosquitto directly to get its id, the loop thread sends it
     int publish(const QString &topic, const QByteArray &payload, int qos = 0, bool retain = false, int *mid = NULL);
+    // without conversions, for callers that keep topic and payload buffers around
+    int publish(const char *topic, const void *payload, int len, int qos = 0, bool retain = false, int *mid = NULL);
     int subscribe(const QString &sub, int qos, int *mid = NULL);
     int unsubscribe(const QString &sub, int *mid = NULL);
 
+    // export publish counters and the number of messages not yet handed to the network
+    void registerMetrics(MetricsRegistry *metrics);
+
     void connectCallback(int rc);
+    void connectPropertiesCallback(const mosquitto_property *props);
     void disconnectCallback(int rc);
     void publishCallback(int mid);
     void messageCallback(const struct mosquitto_message *message);
@@ -42,9 +68,22 @@ private:
     void enableWriteSocketNotifier();
 
     struct mosquitto *mosq;
+    MqttLoopThread *loop;
 
     bool isConnected;
-    bool isOnline;
+    // written by the loop thread
+    std::atomic<bool> isOnline;
+
+    // messages published directly
+    MetricsCounter publishCount;
+    MetricsCounter publishFailCount;
+    // written by the mosquitto thread
+    MetricsCounter publishDoneCount;
+    MetricsGauge queueDepth;
+    MetricsGauge online;
+
+private slots:
+    void collectMetrics();
 
 signals:
     // please use queued connections for this!!!
@@ -0,0 +1,449 @@
+#include "mqttloopthread.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// messages taken from the ring at once
+#define DRAIN_BATCH 16
+// max. spooled messages per loop iteration, the rest waits for the next one
+#define REPLAY_BURST 16
+// mosquitto_loop_misc() has to run at least this often for the keepalive
+#define MISC_INTERVAL_MS 1000
+
+MqttLoopThread::MqttLoopThread(struct mosquitto *mosq, QObject *parent) :
+    QThread(parent), mosq(mosq)
+{
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stopping.store(false);
+
+    ring = new SpscRing<MqttOutMessage>(MQTTLOOPTHREAD_DEFAULT_QUEUE_SIZE);
+
+    replayRate = MQTTLOOPTHREAD_DEFAULT_REPLAY_RATE;
+    reconnectDelay = 5;
+
+    v5 = false;
+    topicCount = 0;
+
+    receiveMax = MQTTLOOPTHREAD_DEFAULT_RECEIVE_MAX;
+    outstanding = 0;
+    memset(ownMids, 0, sizeof(ownMids));
+    online = false;
+    nextReplay = 0;
+    nextReconnect = 0;
+}
+
+MqttLoopThread::~MqttLoopThread()
+{
+    stop();
+
+    // release messages that were never sent
+    MqttOutMessage msg;
+    while (ring->pop(&msg, 1) > 0) {
+        delete msg.large;
+    }
+    delete ring;
+
+    for (int i = 0; i < topicCount; i++) {
+        mosquitto_property_free_all(&topics[i].props);
+        mosquitto_property_free_all(&topics[i].expiryProps);
+    }
+
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+}
+
+qint64 MqttLoopThread::monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (qint64) ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void MqttLoopThread::setQueueSize(int size) {
+    if (isRunning()) {
+        return;
+    }
+
+    delete ring;
+    ring = new SpscRing<MqttOutMessage>(size);
+}
+
+int MqttLoopThread::setSpool(const QString &dir, qint64 maxSize) {
+    if (isRunning()) {
+        return MQTTSPOOL_ERR_NOT_OPEN;
+    }
+
+    int err = spool.open(dir, maxSize);
+    spoolDepth.set((double) spool.getCount());
+    spoolBytes.set((double) spool.getSize());
+    return err;
+}
+
+// existing or new entry of topic, NULL if it does not fit
+MqttLoopThread::TopicEntry *MqttLoopThread::addTopic(const QByteArray &topic) {
+    if (isRunning() || topic.size() >= MQTTLOOPTHREAD_TOPIC_SIZE) {
+        return NULL;
+    }
+
+    TopicEntry *entry = findTopic(topic.constData());
+    if (entry == NULL) {
+        if (topicCount == MQTTLOOPTHREAD_MAX_TOPICS) {
+            return NULL;
+        }
+        entry = &topics[topicCount++];
+        memcpy(entry->topic, topic.constData(), topic.size() + 1);
+        entry->expiry = 0;
+        entry->wantAlias = false;
+        entry->alias = 0;
+        entry->aliasSent = false;
+        entry->props = NULL;
+        entry->expiryProps = NULL;
+    }
+
+    return entry;
+}
+
+void MqttLoopThread::setMessageExpiry(const QByteArray &topic, int seconds) {
+    TopicEntry *entry = addTopic(topic);
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->expiry = (seconds > 0) ? (quint32) seconds : 0;
+    buildProperties(entry);
+}
+
+void MqttLoopThread::setTopicAlias(const QByteArray &topic) {
+    TopicEntry *entry = addTopic(topic);
+    if (entry != NULL) {
+        entry->wantAlias = true;
+    }
+}
+
+void MqttLoopThread::registerMetrics(MetricsRegistry *metrics) {
+    metrics->addCounter("meteo_mqtt_publish_total", "Messages accepted by libmosquitto", "path=\"queue\"", &published);
+    metrics->addCounter("meteo_mqtt_spooled_total", "Messages written to the spool while offline", QString(), &spooled);
+    metrics->addCounter("meteo_mqtt_replayed_total", "Spooled messages published after reconnect", QString(), &replayed);
+    metrics->addCounter("meteo_mqtt_dropped_total", "Messages lost while offline or rejected by libmosquitto", "reason=\"send\"", &dropped);
+    metrics->addCounter("meteo_mqtt_dropped_total", "Messages lost while offline or rejected by libmosquitto", "reason=\"queue_full\"", &queueOverflow);
+    metrics->addCounter("meteo_mqtt_dropped_total", "Messages lost while offline or rejected by libmosquitto", "reason=\"spool_full\"", &spoolDropped);
+    metrics->addGauge("meteo_mqtt_outbound_queue_depth", "Messages posted but not yet taken by the loop thread", QString(), &queueDepth);
+    metrics->addGauge("meteo_mqtt_spool_messages", "Spooled messages waiting for replay", QString(), &spoolDepth);
+    metrics->addGauge("meteo_mqtt_spool_bytes", "Size of the spool on disk", QString(), &spoolBytes);
+
+    connect(metrics, &MetricsRegistry::collect, this, &MqttLoopThread::collectMetrics, Qt::DirectConnection);
+}
+
+void MqttLoopThread::collectMetrics() {
+    queueDepth.set((double) ring->getSize());
+    queueOverflow.set(ring->getOverflowCount());
+}
+
+void MqttLoopThread::wake() {
+    quint64 one = 1;
+    if (write(wakeFd, &one, sizeof(one)) != sizeof(one)) {
+        // counter saturated, the loop is awake anyway
+    }
+}
+
+bool MqttLoopThread::post(const char *topic, const void *payload, int len, int qos, bool retain) {
+    MqttOutMessage msg;
+    size_t topicLen = strlen(topic);
+
+    msg.len = len;
+    msg.qos = qos;
+    msg.retain = retain;
+
+    if (topicLen < MQTTLOOPTHREAD_TOPIC_SIZE && len <= MQTTLOOPTHREAD_PAYLOAD_SIZE) {
+        memcpy(msg.topic, topic, topicLen + 1);
+        memcpy(msg.payload, payload, len);
+        msg.large = NULL;
+    } else {
+        msg.large = new QByteArray(topic, topicLen + 1);
+        msg.large->append((const char *) payload, len);
+    }
+
+    if (ring->push(&msg, 1) != 1) {
+        delete msg.large;
+        return false;
+    }
+
+    wake();
+    return true;
+}
+
+void MqttLoopThread::stop() {
+    if (!isRunning()) {
+        return;
+    }
+
+    stopping.store(true);
+    wake();
+    wait();
+    stopping.store(false);
+}
+
+void MqttLoopThread::setOnline(bool online) {
+    this->online = online;
+    if (online) {
+        nextReplay = monotonicMs();
+        // unsent QoS 0 messages were dropped with the old connection
+        outstanding = 0;
+        memset(ownMids, 0, sizeof(ownMids));
+    }
+}
+
+// aliases are per connection, start over with the limits of the broker
+void MqttLoopThread::setBrokerLimits(int topicAliasMax, int receiveMax) {
+    this->receiveMax = (receiveMax > 0) ? receiveMax : MQTTLOOPTHREAD_DEFAULT_RECEIVE_MAX;
+
+    // all at once, in the order the topics were set up
+    int aliasCount = 0;
+    for (int i = 0; i < topicCount; i++) {
+        topics[i].alias = (topics[i].wantAlias && aliasCount < topicAliasMax) ? ++aliasCount : 0;
+        topics[i].aliasSent = false;
+        buildProperties(&topics[i]);
+    }
+}
+
+void MqttLoopThread::messageDone(int mid) {
+    quint32 bit = 1U << (mid & 31);
+    quint32 &word = ownMids[(mid & (MQTTLOOPTHREAD_MID_COUNT - 1)) >> 5];
+    if (!(word & bit)) {
+        return;
+    }
+
+    word &= ~bit;
+    if (outstanding > 0) {
+        outstanding--;
+    }
+}
+
+MqttLoopThread::TopicEntry *MqttLoopThread::findTopic(const char *topic) {
+    for (int i = 0; i < topicCount; i++) {
+        if (strcmp(topics[i].topic, topic) == 0) {
+            return &topics[i];
+        }
+    }
+    return NULL;
+}
+
+void MqttLoopThread::buildProperties(TopicEntry *entry) {
+    mosquitto_property_free_all(&entry->props);
+    mosquitto_property_free_all(&entry->expiryProps);
+
+    if (entry->expiry > 0) {
+        mosquitto_property_add_int32(&entry->props, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, entry->expiry);
+        mosquitto_property_add_int32(&entry->expiryProps, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, entry->expiry);
+    }
+    if (entry->alias > 0) {
+        mosquitto_property_add_int16(&entry->props, MQTT_PROP_TOPIC_ALIAS, (quint16) entry->alias);
+    }
+}
+
+int MqttLoopThread::publishMessage(const char *topic, const void *payload, int len, int qos, bool retain) {
+    int rc;
+    int mid = 0;
+
+    if (!v5) {
+        rc = mosquitto_publish(mosq, &mid, topic, len, payload, qos, retain);
+    } else if (qos > 0) {
+        // may be resent on a new connection, always with the full topic and no alias
+        TopicEntry *entry = findTopic(topic);
+        rc = mosquitto_publish_v5(mosq, &mid, topic, len, payload, qos, retain, entry != NULL ? entry->expiryProps : NULL);
+    } else {
+        TopicEntry *entry = findTopic(topic);
+        if (entry == NULL) {
+            rc = mosquitto_publish_v5(mosq, &mid, topic, len, payload, qos, retain, NULL);
+        } else {
+            // the topic string is only sent once per alias and connection
+            rc = mosquitto_publish_v5(mosq, &mid, entry->aliasSent ? NULL : topic, len, payload, qos, retain, entry->props);
+            if (rc == MOSQ_ERR_SUCCESS && entry->alias > 0) {
+                entry->aliasSent = true;
+            }
+        }
+    }
+
+    if (rc == MOSQ_ERR_SUCCESS) {
+        published.inc();
+        // the publish callback runs in this thread, not before the next loop call
+        ownMids[(mid & (MQTTLOOPTHREAD_MID_COUNT - 1)) >> 5] |= 1U << (mid & 31);
+        outstanding++;
+    }
+    return rc;
+}
+
+void MqttLoopThread::send(const char *topic, const void *payload, int len, int qos, bool retain) {
+    if (online && publishMessage(topic, payload, len, qos, retain) == MOSQ_ERR_SUCCESS) {
+        return;
+    }
+
+    // outdated by the time it would be replayed
+    TopicEntry *entry = v5 ? findTopic(topic) : NULL;
+    bool expires = entry != NULL && entry->expiry > 0;
+
+    if (!retain && !expires && spool.isOpen() && spool.append(topic, payload, len, qos, retain) == MQTTSPOOL_ERR_OK) {
+        spooled.inc();
+        spoolDropped.set(spool.getDroppedCount());
+        spoolDepth.set((double) spool.getCount());
+        spoolBytes.set((double) spool.getSize());
+        return;
+    }
+
+    dropped.inc();
+}
+
+void MqttLoopThread::drain() {
+    MqttOutMessage msgs[DRAIN_BATCH];
+    int n;
+
+    while (true) {
+        // flow control, the rest stays queued until libmosquitto is done with some
+        int max = DRAIN_BATCH;
+        if (online && receiveMax - outstanding < max) {
+            max = receiveMax - outstanding;
+        }
+        if (max <= 0 || (n = ring->pop(msgs, max)) <= 0) {
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            const MqttOutMessage &msg = msgs[i];
+            if (msg.large == NULL) {
+                send(msg.topic, msg.payload, msg.len, msg.qos, msg.retain);
+            } else {
+                const char *topic = msg.large->constData();
+                send(topic, topic + strlen(topic) + 1, msg.len, msg.qos, msg.retain);
+                delete msg.large;
+            }
+        }
+    }
+}
+
+// spooled messages in order, one every 1/replayRate seconds
+void MqttLoopThread::replay(qint64 now) {
+    qint64 interval = 1000 / replayRate;
+    if (interval < 1) {
+        interval = 1;
+    }
+
+    // do not fall behind by more than one burst after a stall
+    if (nextReplay < now - REPLAY_BURST * interval) {
+        nextReplay = now - REPLAY_BURST * interval;
+    }
+
+    int n = 0;
+    while (online && n < REPLAY_BURST && nextReplay <= now && outstanding < receiveMax && !spool.isEmpty()) {
+        // let libmosquitto write out what it has first
+        if (mosquitto_want_write(mosq)) {
+            break;
+        }
+
+        const char *topic;
+        const char *payload;
+        int len, qos;
+        bool retain;
+        if (!spool.peek(&topic, &payload, &len, &qos, &retain)) {
+            break;
+        }
+
+        // keep the message on failure, try again later
+        if (publishMessage(topic, payload, len, qos, retain) != MOSQ_ERR_SUCCESS) {
+            break;
+        }
+
+        spool.consume();
+        replayed.inc();
+        nextReplay += interval;
+        n++;
+    }
+
+    spoolDropped.set(spool.getDroppedCount());
+    spoolDepth.set((double) spool.getCount());
+    spoolBytes.set((double) spool.getSize());
+}
+
+int MqttLoopThread::pollTimeout(qint64 now) {
+    qint64 timeout = MISC_INTERVAL_MS;
+
+    if (mosquitto_socket(mosq) < 0 && nextReconnect - now < timeout) {
+        timeout = nextReconnect - now;
+    }
+    // a pending write wakes the loop through POLLOUT
+    if (online && !spool.isEmpty() && !mosquitto_want_write(mosq) && outstanding < receiveMax && nextReplay - now < timeout) {
+        timeout = nextReplay - now;
+    }
+
+    return (timeout > 0) ? (int) timeout : 0;
+}
+
+void MqttLoopThread::run() {
+    struct pollfd pfd[2];
+    pfd[0].fd = wakeFd;
+    pfd[0].events = POLLIN;
+
+    while (!stopping.load()) {
+        qint64 now = monotonicMs();
+
+        // connection lost or never established
+        int sock = mosquitto_socket(mosq);
+        if (sock < 0 && now >= nextReconnect) {
+            if (mosquitto_reconnect(mosq) != MOSQ_ERR_SUCCESS) {
+                nextReconnect = now + reconnectDelay * 1000LL;
+            }
+            sock = mosquitto_socket(mosq);
+        }
+
+        int nfds = 1;
+        if (sock >= 0) {
+            pfd[1].fd = sock;
+            pfd[1].events = POLLIN | (mosquitto_want_write(mosq) ? POLLOUT : 0);
+            pfd[1].revents = 0;
+            nfds = 2;
+        }
+
+        if (poll(pfd, nfds, pollTimeout(now)) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (pfd[0].revents & POLLIN) {
+            quint64 value;
+            if (read(wakeFd, &value, sizeof(value)) < 0) {
+                // nothing pending
+            }
+        }
+
+        if (sock >= 0) {
+            int rc = MOSQ_ERR_SUCCESS;
+            if (pfd[1].revents & (POLLIN | POLLERR | POLLHUP)) {
+                rc = mosquitto_loop_read(mosq, 1);
+            }
+            if (rc == MOSQ_ERR_SUCCESS && (pfd[1].revents & POLLOUT)) {
+                rc = mosquitto_loop_write(mosq, 1);
+            }
+            if (rc == MOSQ_ERR_SUCCESS) {
+                rc = mosquitto_loop_misc(mosq);
+            }
+            if (rc != MOSQ_ERR_SUCCESS) {
+                // socket is closed by libmosquitto, reconnect after the delay
+                nextReconnect = monotonicMs() + reconnectDelay * 1000LL;
+            }
+        }
+
+        drain();
+        replay(monotonicMs());
+    }
+
+    // hand over what is left, then say goodbye to the broker
+    drain();
+    if (mosquitto_socket(mosq) >= 0) {
+        mosquitto_disconnect(mosq);
+        for (int i = 0; i < 10 && mosquitto_loop(mosq, 100, 1) == MOSQ_ERR_SUCCESS; i++) {
+        }
+    }
+    online = false;
+}
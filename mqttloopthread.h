@@ -0,0 +1,157 @@
+#ifndef MQTTLOOPTHREAD_H
+#define MQTTLOOPTHREAD_H
+
+#include <QThread>
+#include <QByteArray>
+#include <mosquitto.h>
+#include <mqtt_protocol.h>
+
+#include <atomic>
+
+#include "spscring.h"
+#include "mqttspool.h"
+#include "metricsregistry.h"
+
+#define MQTTLOOPTHREAD_TOPIC_SIZE 64
+#define MQTTLOOPTHREAD_PAYLOAD_SIZE 256
+
+#define MQTTLOOPTHREAD_DEFAULT_QUEUE_SIZE 256
+// spooled messages per second after reconnect
+#define MQTTLOOPTHREAD_DEFAULT_REPLAY_RATE 50
+
+// topics with expiry or alias (MQTT v5)
+#define MQTTLOOPTHREAD_MAX_TOPICS 32
+// receive maximum if the broker announces none
+#define MQTTLOOPTHREAD_DEFAULT_RECEIVE_MAX 65535
+// message ids are 16 bit
+#define MQTTLOOPTHREAD_MID_COUNT 65536
+
+// Queued message. Topic and payload are copied into the slot, only messages that do
+// not fit are allocated.
+struct MqttOutMessage {
+    char topic[MQTTLOOPTHREAD_TOPIC_SIZE];
+    char payload[MQTTLOOPTHREAD_PAYLOAD_SIZE];
+    int len;
+    int qos;
+    bool retain;
+    // topic '\0' payload, owned by the message
+    QByteArray *large;
+};
+
+// Runs the mosquitto network loop and reconnects to the broker. Messages are posted by one
+// producer thread through a lock-free ring and published from here, so a slow broker never
+// blocks the producer. While offline they go to the spool (if set) and are replayed in order
+// at a limited rate after reconnect. Retained messages are not spooled, a replay would
+// overwrite newer retained values.
+// With MQTT v5 the topics reserved with setTopicAlias() get topic aliases in the order they
+// were set up (as many as the broker allows), other topics never do. Only QoS 0 messages use
+// them: libmosquitto resends unacknowledged QoS 1/2 messages after a reconnect as they were,
+// when the aliases of the old connection are gone. Topics can carry a message expiry, such
+// messages are not spooled either. Messages handed to libmosquitto from here and not yet sent
+// or acknowledged are limited to the broker receive maximum.
+class MqttLoopThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit MqttLoopThread(struct mosquitto *mosq, QObject *parent = 0);
+    virtual ~MqttLoopThread();
+
+    bool isValid() { return wakeFd >= 0; }
+
+    // change before start()
+    void setQueueSize(int size);
+    int setSpool(const QString &dir, qint64 maxSize);
+    void setReplayRate(int msgPerSec) { replayRate = (msgPerSec > 0) ? msgPerSec : 1; }
+    void setReconnectDelay(int sec) { reconnectDelay = sec; }
+    void setProtocolV5(bool v5) { this->v5 = v5; }
+    // seconds, 0 = none, MQTT v5 only
+    void setMessageExpiry(const QByteArray &topic, int seconds);
+    // topic gets an alias if the broker has one left, MQTT v5 only
+    void setTopicAlias(const QByteArray &topic);
+
+    // producer side, false if the queue is full
+    bool post(const char *topic, const void *payload, int len, int qos, bool retain);
+    // packets queued in libmosquitto by another thread are only written from here
+    void wake();
+
+    // from the mosquitto callbacks, i.e. this thread
+    void setOnline(bool online);
+    // from the CONNACK properties
+    void setBrokerLimits(int topicAliasMax, int receiveMax);
+    // message mid was sent (QoS 0) or acknowledged, only counted if published from here
+    void messageDone(int mid);
+
+    void stop();
+
+    void registerMetrics(MetricsRegistry *metrics);
+
+    // accepted by libmosquitto, written by this thread
+    quint64 getPublishedCount() { return published.get(); }
+
+protected:
+    void run();
+
+private:
+    struct mosquitto *mosq;
+    int wakeFd;
+    std::atomic<bool> stopping;
+
+    SpscRing<MqttOutMessage> *ring;
+    MqttSpool spool;
+
+    int replayRate;
+    int reconnectDelay;
+
+    struct TopicEntry {
+        char topic[MQTTLOOPTHREAD_TOPIC_SIZE];
+        quint32 expiry;
+        bool wantAlias;
+        // 0 = none, valid for the current connection
+        int alias;
+        bool aliasSent;
+        // built once per connection
+        mosquitto_property *props;
+        // same without the alias
+        mosquitto_property *expiryProps;
+    };
+
+    bool v5;
+    TopicEntry topics[MQTTLOOPTHREAD_MAX_TOPICS];
+    int topicCount;
+
+    // loop thread state
+    int receiveMax;
+    int outstanding;
+    // bit per mid published from here and not yet done, direct publishes are not counted
+    quint32 ownMids[MQTTLOOPTHREAD_MID_COUNT / 32];
+    bool online;
+    qint64 nextReplay;
+    qint64 nextReconnect;
+
+    MetricsCounter published;
+    MetricsCounter spooled;
+    MetricsCounter replayed;
+    MetricsCounter dropped;
+    MetricsCounter queueOverflow;
+    MetricsCounter spoolDropped;
+    MetricsGauge queueDepth;
+    MetricsGauge spoolDepth;
+    MetricsGauge spoolBytes;
+
+    static qint64 monotonicMs();
+
+    void drain();
+    TopicEntry *findTopic(const char *topic);
+    TopicEntry *addTopic(const QByteArray &topic);
+    void buildProperties(TopicEntry *entry);
+    int publishMessage(const char *topic, const void *payload, int len, int qos, bool retain);
+    void send(const char *topic, const void *payload, int len, int qos, bool retain);
+    void replay(qint64 now);
+    int pollTimeout(qint64 now);
+
+private slots:
+    void collectMetrics();
+
+};
+
+#endif // MQTTLOOPTHREAD_H
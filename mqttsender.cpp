@@ -1,52 +1,398 @@
 #include "mqttsender.h"
 
+#include <QJsonDocument>
+#include <QVariantMap>
+#include <QVariantList>
+#include <QTimerEvent>
+
+#include <stdio.h>
+#include <math.h>
+
 const QString WIND_TOPIC("meteo/wind");
 const QString AIR_PRESS_TOPIC("meteo/air/press");
 const QString AIR_TEMP_TOPIC("meteo/air/temp");
+const QString WIND_BINARY_TOPIC("meteo/bin/wind");
+const QString AIR_PRESS_BINARY_TOPIC("meteo/bin/air/press");
+const QString AIR_TEMP_BINARY_TOPIC("meteo/bin/air/temp");
+const QString ARRIVAL_STATS_TOPIC("meteo/stats/arrival");
+
+#define ARRIVAL_STATS_PERIOD_MS 10000
 
 MqttSender::MqttSender(MqttClient *mqtt, MeteoCollector *collector, QObject *parent) : QObject(parent), mqtt(mqtt), collector(collector)
 {
     connect(collector, SIGNAL(windUpdate()), this, SLOT(windUpdate()));
     connect(collector, SIGNAL(airTempUpdate()), this, SLOT(airTempUpdate()));
     connect(collector, SIGNAL(airPressUpdate()), this, SLOT(airPressUpdate()));
+
+    for (int i = 0; i < TopicCount; i++) {
+        topics[i].deferTimer = 0;
+        topics[i].traceOrigin = 0;
+        topics[i].jsonTopic = getTopicName((Topic) i).toLocal8Bit();
+        topics[i].binaryTopic = getBinaryTopicName((Topic) i).toLocal8Bit();
+    }
+
+    format = Json;
+
+    // wind direction and average direction
+    topics[Wind].policy.setAngleMask((1 << 1) | (1 << 2));
+    // pressure trend
+    topics[AirPress].policy.setDiscreteMask(1 << 1);
+
+    statsTimer = startTimer(ARRIVAL_STATS_PERIOD_MS);
 }
 
-void MqttSender::windUpdate()
+const QString &MqttSender::getTopicName(Topic topic)
 {
-    QString data;
-    data.sprintf("{\"d\":%.1f,\"da\":%.1f,\"s\":%.1f,\"sp\":%.1f}",
-                 collector->getWindDir(),
-                 collector->getWindDirAvg(),
-                 collector->getWindVelo(),
-                 collector->getWindVeloPeak());
+    switch (topic) {
+    case Wind:
+        return WIND_TOPIC;
+    case AirPress:
+        return AIR_PRESS_TOPIC;
+    default:
+        return AIR_TEMP_TOPIC;
+    }
+}
 
-    mqtt->publish(WIND_TOPIC, data.toUtf8());
+const QString &MqttSender::getBinaryTopicName(Topic topic)
+{
+    switch (topic) {
+    case Wind:
+        return WIND_BINARY_TOPIC;
+    case AirPress:
+        return AIR_PRESS_BINARY_TOPIC;
+    default:
+        return AIR_TEMP_BINARY_TOPIC;
+    }
 }
 
-void MqttSender::airPressUpdate()
+void MqttSender::registerMetrics(MetricsRegistry *metrics)
 {
-    char trend;
-    switch (collector->getAirPressTrend()) {
+    for (int i = 0; i < TopicCount; i++) {
+        QString topic = getTopicName((Topic) i);
+        metrics->addCounter("meteo_mqtt_updates_total", "Collector updates per topic and publish decision",
+                            QString("topic=\"%1\",result=\"sent\"").arg(topic), &topics[i].sent);
+        metrics->addCounter("meteo_mqtt_updates_total", "Collector updates per topic and publish decision",
+                            QString("topic=\"%1\",result=\"suppressed\"").arg(topic), &topics[i].suppressed);
+        metrics->addCounter("meteo_mqtt_updates_total", "Collector updates per topic and publish decision",
+                            QString("topic=\"%1\",result=\"coalesced\"").arg(topic), &topics[i].coalesced);
+    }
+}
+
+// frame that triggered the current update, 0 if tracing is off
+qint64 MqttSender::currentTraceOrigin()
+{
+    LatencyTrace *trace = collector->getTrace();
+    return trace != NULL ? trace->getOrigin() : 0;
+}
+
+static char trendCode(MeteoCollector::AirPressTrend trend)
+{
+    switch (trend) {
     case MeteoCollector::Rising:
-        trend = 'r';
-        break;
+        return 'r';
     case MeteoCollector::Falling:
-        trend = 'f';
-        break;
+        return 'f';
     case MeteoCollector::Unsteady:
-        trend = 'u';
+        return 'u';
+    default:
+        return 's';
+    }
+}
+
+int MqttSender::formatJson(Topic topic, char *buf, int size)
+{
+    int len;
+
+    switch (topic) {
+    case Wind:
+        len = snprintf(buf, size, "{\"d\":%.1f,\"da\":%.1f,\"s\":%.1f,\"sp\":%.1f}",
+                       collector->getWindDir(),
+                       collector->getWindDirAvg(),
+                       collector->getWindVelo(),
+                       collector->getWindVeloPeak());
+        break;
+    case AirPress:
+        len = snprintf(buf, size, "{\"p\":%.2f,\"t\":\"%c\"}",
+                       collector->getAirPress(),
+                       trendCode(collector->getAirPressTrend()));
         break;
     default:
-        trend = 's';
+        len = snprintf(buf, size, "%.2f", collector->getAirTemp());
+        break;
     }
 
-    QString data;
-    data.sprintf("{\"p\":%.2f,\"t\":\"%c\"}", collector->getAirPress(), trend);
+    return (len < 0 || len >= size) ? -1 : len;
+}
 
-    mqtt->publish(AIR_PRESS_TOPIC, data.toUtf8());
+// scaled to the binary resolution, out of range or unavailable maps to max
+static quint16 scaleU16(double v, double scale)
+{
+    v = round(v * scale);
+    return (isnan(v) || v < 0.0 || v >= 65535.0) ? 0xffff : (quint16) v;
+}
+
+static qint16 scaleI16(double v, double scale)
+{
+    v = round(v * scale);
+    return (isnan(v) || v < -32768.0 || v >= 32767.0) ? 0x7fff : (qint16) v;
+}
+
+static quint32 scaleU32(double v, double scale)
+{
+    v = round(v * scale);
+    return (isnan(v) || v < 0.0 || v >= 4294967295.0) ? 0xffffffffU : (quint32) v;
+}
+
+static quint8 *putU16(quint8 *p, quint16 v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static quint8 *putU32(quint8 *p, quint32 v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+int MqttSender::formatBinary(Topic topic, quint8 *buf, int size)
+{
+    if (size < MQTTSENDER_BINARY_SIZE) {
+        return -1;
+    }
+
+    quint8 *p = buf;
+    *p++ = MQTTSENDER_BINARY_VERSION;
+    *p++ = (quint8) topic;
+
+    switch (topic) {
+    case Wind:
+        p = putU16(p, scaleU16(collector->getWindVelo(), 10.0));
+        p = putU16(p, (quint16) scaleI16(collector->getWindDir(), 10.0));
+        p = putU16(p, (quint16) scaleI16(collector->getWindDirAvg(), 10.0));
+        p = putU16(p, scaleU16(collector->getWindVeloPeak(), 10.0));
+        break;
+    case AirPress:
+        p = putU32(p, scaleU32(collector->getAirPress(), 100.0));
+        *p++ = (quint8) collector->getAirPressTrend();
+        break;
+    default:
+        p = putU16(p, (quint16) scaleI16(collector->getAirTemp(), 100.0));
+        break;
+    }
+
+    return p - buf;
+}
+
+QByteArray MqttSender::formatWind()
+{
+    int len = formatJson(Wind, jsonBuf, sizeof(jsonBuf));
+    return QByteArray(jsonBuf, len > 0 ? len : 0);
+}
+
+QByteArray MqttSender::formatAirPress()
+{
+    int len = formatJson(AirPress, jsonBuf, sizeof(jsonBuf));
+    return QByteArray(jsonBuf, len > 0 ? len : 0);
+}
+
+QByteArray MqttSender::formatAirTemp()
+{
+    int len = formatJson(AirTemp, jsonBuf, sizeof(jsonBuf));
+    return QByteArray(jsonBuf, len > 0 ? len : 0);
+}
+
+QByteArray MqttSender::formatArrivalStats()
+{
+    qint64 now = collector->currentTimestampUsec();
+
+    QVariantMap streams;
+    streams.insert("wind", collector->getWindArrivals().toVariantMap(now));
+    streams.insert("airTemp", collector->getAirTempArrivals().toVariantMap(now));
+    streams.insert("airPress", collector->getAirPressArrivals().toVariantMap(now));
+
+    QVariantList pgns;
+    const N2kArrivalTable &arrivals = collector->getParser()->getArrivals();
+    for (int i = 0; i < arrivals.getSize(); i++) {
+        const N2kArrivalTable::Entry &e = arrivals.getEntry(i);
+        QVariantMap m = e.stats.toVariantMap(now);
+        m.insert("pgn", (int) e.pgn);
+        m.insert("source", (int) e.source);
+        pgns.append(m);
+    }
+
+    QVariantMap data;
+    data.insert("streams", streams);
+    data.insert("pgns", pgns);
+
+    return QJsonDocument::fromVariant(data).toJson(QJsonDocument::Compact);
+}
+
+const char *MqttSender::getValueName(Topic topic, int index)
+{
+    static const char *windNames[] = { "velo", "dir", "dir", "velo", NULL };
+    static const char *airPressNames[] = { "press", "trend", NULL };
+    static const char *airTempNames[] = { "temp", NULL };
+
+    const char **names;
+    int count;
+    switch (topic) {
+    case Wind:
+        names = windNames;
+        count = 4;
+        break;
+    case AirPress:
+        names = airPressNames;
+        count = 2;
+        break;
+    default:
+        names = airTempNames;
+        count = 1;
+        break;
+    }
+
+    return (index >= 0 && index < count) ? names[index] : NULL;
+}
+
+// values compared by the deadband, same order as getValueName()
+int MqttSender::topicValues(Topic topic, double *values)
+{
+    switch (topic) {
+    case Wind:
+        values[0] = collector->getWindVelo();
+        values[1] = collector->getWindDir();
+        values[2] = collector->getWindDirAvg();
+        values[3] = collector->getWindVeloPeak();
+        return 4;
+    case AirPress:
+        values[0] = collector->getAirPress();
+        values[1] = (double) collector->getAirPressTrend();
+        return 2;
+    default:
+        values[0] = collector->getAirTemp();
+        return 1;
+    }
+}
+
+void MqttSender::publishTopic(Topic topic, const double *values, int count, qint64 now, qint64 traceOrigin)
+{
+    TopicState &t = topics[topic];
+
+    int len;
+    if (format & Json) {
+        len = formatJson(topic, jsonBuf, sizeof(jsonBuf));
+        if (len > 0) {
+            mqtt->publish(t.jsonTopic.constData(), jsonBuf, len);
+        }
+    }
+    if (format & Binary) {
+        len = formatBinary(topic, binaryBuf, sizeof(binaryBuf));
+        if (len > 0) {
+            mqtt->publish(t.binaryTopic.constData(), binaryBuf, len);
+        }
+    }
+    LatencyTrace *trace = collector->getTrace();
+    if (trace != NULL) {
+        trace->record(LATENCY_STAGE_PUBLISH, traceOrigin);
+    }
+
+    t.policy.sent(now, values, count);
+    t.sent.inc();
+}
+
+void MqttSender::update(Topic topic)
+{
+    TopicState &t = topics[topic];
+
+    double values[PUBLISHPOLICY_MAX_VALUES];
+    int count = topicValues(topic, values);
+    qint64 now = collector->currentTimestamp();
+
+    PublishPolicy::Decision decision = t.policy.check(now, values, count);
+
+    // a deferred message is pending, it will carry these values
+    if (t.deferTimer != 0 && decision != PublishPolicy::Send) {
+        t.coalesced.inc();
+        return;
+    }
+
+    switch (decision) {
+    case PublishPolicy::Send:
+        if (t.deferTimer != 0) {
+            killTimer(t.deferTimer);
+            t.deferTimer = 0;
+        }
+        t.traceOrigin = 0;
+        publishTopic(topic, values, count, now, currentTraceOrigin());
+        break;
+    case PublishPolicy::Defer:
+        t.deferTimer = startTimer(t.policy.getDeferDelay(now), Qt::PreciseTimer);
+        // the trace origin moves on with every decoded frame, remember ours
+        t.traceOrigin = currentTraceOrigin();
+        break;
+    default:
+        t.suppressed.inc();
+        break;
+    }
+}
+
+// deferred message is due, send the latest values if they still count as change
+void MqttSender::flush(Topic topic)
+{
+    TopicState &t = topics[topic];
+
+    killTimer(t.deferTimer);
+    t.deferTimer = 0;
+
+    double values[PUBLISHPOLICY_MAX_VALUES];
+    int count = topicValues(topic, values);
+    qint64 now = collector->currentTimestamp();
+
+    switch (t.policy.check(now, values, count)) {
+    case PublishPolicy::Send:
+        publishTopic(topic, values, count, now, t.traceOrigin);
+        t.traceOrigin = 0;
+        break;
+    case PublishPolicy::Defer:
+        t.deferTimer = startTimer(t.policy.getDeferDelay(now), Qt::PreciseTimer);
+        break;
+    default:
+        t.suppressed.inc();
+        t.traceOrigin = 0;
+        break;
+    }
+}
+
+void MqttSender::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == statsTimer) {
+        mqtt->publish(ARRIVAL_STATS_TOPIC, formatArrivalStats());
+        return;
+    }
+
+    for (int i = 0; i < TopicCount; i++) {
+        if (topics[i].deferTimer == event->timerId()) {
+            flush((Topic) i);
+            return;
+        }
+    }
+}
+
+void MqttSender::windUpdate()
+{
+    update(Wind);
+}
+
+void MqttSender::airPressUpdate()
+{
+    update(AirPress);
 }
 
 void MqttSender::airTempUpdate()
 {
-    mqtt->publish(AIR_TEMP_TOPIC, QString::number(collector->getAirTemp(), 'f', 2).toUtf8());
+    update(AirTemp);
 }
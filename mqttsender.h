@@ -5,17 +5,96 @@
 
 #include "mqttclient.h"
 #include "meteocollector.h"
+#include "publishpolicy.h"
+#include "metricsregistry.h"
+
+// Binary payloads, little endian, unavailable values are the max. of their type:
+//   u8 version, u8 topic (0 wind, 1 air press, 2 air temp), then
+//   wind:      u16 velo 0.1 kn, i16 dir 0.1 deg, i16 dirAvg 0.1 deg, u16 veloPeak 0.1 kn
+//   air press: u32 press 0.01 hPa, u8 trend (0 steady, 1 unsteady, 2 rising, 3 falling)
+//   air temp:  i16 temp 0.01 degC
+#define MQTTSENDER_BINARY_VERSION 1
+
+// enough for every payload of formatJson / formatBinary
+#define MQTTSENDER_JSON_SIZE 128
+#define MQTTSENDER_BINARY_SIZE 16
 
 class MqttSender : public QObject
 {
     Q_OBJECT
 public:
+    enum Topic { Wind, AirPress, AirTemp, TopicCount };
+    // payload encodings, binary messages go to meteo/bin/...
+    enum Format { Json = 1, Binary = 2, JsonAndBinary = Json | Binary };
+
     explicit MqttSender(MqttClient *mqtt, MeteoCollector *collector, QObject *parent = 0);
 
+    // rate limit, heartbeat and deadband per topic, change before data arrives
+    PublishPolicy *getPolicy(Topic topic) { return &topics[topic].policy; }
+    static const QString &getTopicName(Topic topic);
+    static const QString &getBinaryTopicName(Topic topic);
+    // name of value index of a topic in the order the policy compares them, NULL past the last;
+    // values of the same name share a unit and a deadband
+    static const char *getValueName(Topic topic, int index);
+
+    // Json (default), Binary or both
+    void setFormat(int format) { this->format = format; }
+    int getFormat() { return format; }
+
+    // updates published, dropped by the deadband and merged into a deferred message
+    quint64 getSentCount(Topic topic) { return topics[topic].sent.get(); }
+    quint64 getSuppressedCount(Topic topic) { return topics[topic].suppressed.get(); }
+    quint64 getCoalescedCount(Topic topic) { return topics[topic].coalesced.get(); }
+
+    void registerMetrics(MetricsRegistry *metrics);
+
+    // payload for the current collector values written to buf without allocating,
+    // returns its length, -1 if buf is too small
+    int formatJson(Topic topic, char *buf, int size);
+    int formatBinary(Topic topic, quint8 *buf, int size);
+
+    // payloads for the current collector values
+    QByteArray formatWind();
+    QByteArray formatAirPress();
+    QByteArray formatAirTemp();
+    // arrival statistics of the collector streams and all (PGN, source) pairs
+    QByteArray formatArrivalStats();
+
 private:
     MqttClient *mqtt;
     MeteoCollector *collector;
 
+    struct TopicState {
+        PublishPolicy policy;
+        // pending deferred message
+        int deferTimer;
+        // receive time of the first frame waiting for it, 0 if not traced
+        qint64 traceOrigin;
+        MetricsCounter sent;
+        MetricsCounter suppressed;
+        MetricsCounter coalesced;
+        // converted once, publish() takes C strings
+        QByteArray jsonTopic;
+        QByteArray binaryTopic;
+    };
+    TopicState topics[TopicCount];
+
+    int format;
+    // reused for every message
+    char jsonBuf[MQTTSENDER_JSON_SIZE];
+    quint8 binaryBuf[MQTTSENDER_BINARY_SIZE];
+
+    int statsTimer;
+
+    int topicValues(Topic topic, double *values);
+    void update(Topic topic);
+    void flush(Topic topic);
+    void publishTopic(Topic topic, const double *values, int count, qint64 now, qint64 traceOrigin);
+    qint64 currentTraceOrigin();
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
 private slots:
     void windUpdate();
     void airTempUpdate();
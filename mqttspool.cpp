@@ -0,0 +1,312 @@
+#include "mqttspool.h"
+
+#include <QDir>
+#include <QStringList>
+#include <QtEndian>
+
+#include <string.h>
+
+// record: u8 magic, u8 qos | retain << 2, u16 topic length, u32 payload length (little endian),
+// topic, payload
+#define RECORD_MAGIC 0xa5
+#define RECORD_HEADER_LEN 8
+
+MqttSpool::MqttSpool()
+{
+    maxSize = 0;
+    segmentSize = MQTTSPOOL_DEFAULT_SEGMENT_SIZE;
+
+    readOffset = 0;
+    readIndex = 0;
+
+    headLoaded = false;
+    headTopicLen = 0;
+    headLen = 0;
+    headQos = 0;
+    headRetain = false;
+
+    count = 0;
+    size = 0;
+    dropped = 0;
+}
+
+MqttSpool::~MqttSpool()
+{
+    close();
+}
+
+QString MqttSpool::segmentPath(quint32 seq) const {
+    return QString("%1/%2.spool").arg(dir).arg(seq, 10, 10, QChar('0'));
+}
+
+int MqttSpool::open(const QString &dir, qint64 maxSize, qint64 segmentSize) {
+    close();
+
+    this->dir = dir;
+    this->maxSize = maxSize;
+    this->segmentSize = (segmentSize < maxSize) ? segmentSize : maxSize;
+
+    QDir d(dir);
+    if (!d.mkpath(".")) {
+        return MQTTSPOOL_ERR_CREATE_DIR;
+    }
+
+    // zero padded names sort by sequence number
+    QStringList names = d.entryList(QStringList() << "*.spool", QDir::Files, QDir::Name);
+    for (int i = 0; i < names.size(); i++) {
+        Segment segment;
+        segment.seq = names[i].section('.', 0, 0).toUInt();
+        scanSegment(&segment);
+        if (segment.count == 0) {
+            QFile::remove(segmentPath(segment.seq));
+            continue;
+        }
+        segments.append(segment);
+        size += segment.size;
+        count += segment.count;
+    }
+
+    int err = openWriteSegment(segments.isEmpty() ? 1 : segments.last().seq + 1);
+    if (err != MQTTSPOOL_ERR_OK) {
+        segments.clear();
+        count = 0;
+        size = 0;
+        return err;
+    }
+
+    while (size > maxSize && segments.size() > 1) {
+        removeFirstSegment();
+    }
+
+    return MQTTSPOOL_ERR_OK;
+}
+
+void MqttSpool::close() {
+    writeFile.close();
+    readFile.close();
+    segments.clear();
+
+    readOffset = 0;
+    readIndex = 0;
+    headLoaded = false;
+
+    count = 0;
+    size = 0;
+}
+
+int MqttSpool::openWriteSegment(quint32 seq) {
+    writeFile.close();
+    writeFile.setFileName(segmentPath(seq));
+    if (!writeFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return MQTTSPOOL_ERR_OPEN_SEGMENT;
+    }
+
+    Segment segment;
+    segment.seq = seq;
+    segment.size = 0;
+    segment.count = 0;
+    segments.append(segment);
+
+    return MQTTSPOOL_ERR_OK;
+}
+
+// count the records, a torn record at the end (crash while writing) is cut off
+void MqttSpool::scanSegment(Segment *segment) {
+    segment->size = 0;
+    segment->count = 0;
+
+    QFile file(segmentPath(segment->seq));
+    if (!file.open(QIODevice::ReadWrite)) {
+        return;
+    }
+
+    qint64 fileSize = file.size();
+    qint64 offset = 0;
+    uchar header[RECORD_HEADER_LEN];
+    while (offset + RECORD_HEADER_LEN <= fileSize) {
+        if (!file.seek(offset) || file.read((char *) header, RECORD_HEADER_LEN) != RECORD_HEADER_LEN) {
+            break;
+        }
+        if (header[0] != RECORD_MAGIC) {
+            break;
+        }
+        qint64 len = RECORD_HEADER_LEN + qFromLittleEndian<quint16>(header + 2) + qFromLittleEndian<quint32>(header + 4);
+        if (offset + len > fileSize) {
+            break;
+        }
+        offset += len;
+        segment->count++;
+    }
+
+    if (offset < fileSize) {
+        file.resize(offset);
+    }
+    segment->size = offset;
+}
+
+void MqttSpool::removeFirstSegment() {
+    Segment segment = segments.takeFirst();
+
+    int lost = segment.count - readIndex;
+    dropped += lost;
+    count -= lost;
+    size -= segment.size;
+
+    readFile.close();
+    readOffset = 0;
+    readIndex = 0;
+    headLoaded = false;
+
+    QFile::remove(segmentPath(segment.seq));
+}
+
+// only the write segment is left, start it over
+void MqttSpool::restartWriteSegment() {
+    if (!writeFile.resize(0) || !writeFile.seek(0)) {
+        return;
+    }
+
+    Segment &segment = segments.first();
+    int lost = segment.count - readIndex;
+    dropped += lost;
+    count -= lost;
+    size -= segment.size;
+    segment.size = 0;
+    segment.count = 0;
+
+    readFile.close();
+    readOffset = 0;
+    readIndex = 0;
+    headLoaded = false;
+}
+
+int MqttSpool::append(const char *topic, const void *payload, int len, int qos, bool retain) {
+    if (!isOpen()) {
+        return MQTTSPOOL_ERR_NOT_OPEN;
+    }
+
+    size_t topicLen = strlen(topic);
+    qint64 recordLen = RECORD_HEADER_LEN + (qint64) topicLen + len;
+    if (topicLen > 0xffff || len < 0 || recordLen > segmentSize) {
+        return MQTTSPOOL_ERR_TOO_LARGE;
+    }
+
+    if (segments.last().size > 0 && segments.last().size + recordLen > segmentSize) {
+        int err = openWriteSegment(segments.last().seq + 1);
+        if (err != MQTTSPOOL_ERR_OK) {
+            return err;
+        }
+    }
+
+    uchar header[RECORD_HEADER_LEN];
+    header[0] = RECORD_MAGIC;
+    header[1] = (qos & 0x03) | (retain ? 0x04 : 0x00);
+    qToLittleEndian<quint16>((quint16) topicLen, header + 2);
+    qToLittleEndian<quint32>((quint32) len, header + 4);
+
+    Segment &segment = segments.last();
+    if (writeFile.write((const char *) header, RECORD_HEADER_LEN) != RECORD_HEADER_LEN
+            || writeFile.write(topic, topicLen) != (qint64) topicLen
+            || writeFile.write((const char *) payload, len) != len
+            || !writeFile.flush()) {
+        // do not leave a partial record behind
+        writeFile.resize(segment.size);
+        return MQTTSPOOL_ERR_WRITE_SEGMENT;
+    }
+
+    segment.size += recordLen;
+    segment.count++;
+    size += recordLen;
+    count++;
+
+    while (size > maxSize && segments.size() > 1) {
+        removeFirstSegment();
+    }
+
+    return MQTTSPOOL_ERR_OK;
+}
+
+bool MqttSpool::loadHead() {
+    // skip segments that are read completely
+    while (readIndex >= segments.first().count) {
+        if (segments.size() == 1) {
+            return false;
+        }
+        removeFirstSegment();
+    }
+
+    if (!readFile.isOpen()) {
+        readFile.setFileName(segmentPath(segments.first().seq));
+        if (!readFile.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+    }
+
+    uchar header[RECORD_HEADER_LEN];
+    if (!readFile.seek(readOffset) || readFile.read((char *) header, RECORD_HEADER_LEN) != RECORD_HEADER_LEN
+            || header[0] != RECORD_MAGIC) {
+        return false;
+    }
+
+    headQos = header[1] & 0x03;
+    headRetain = (header[1] & 0x04) != 0;
+    headTopicLen = qFromLittleEndian<quint16>(header + 2);
+    headLen = qFromLittleEndian<quint32>(header + 4);
+
+    head.resize(headTopicLen + 1 + headLen);
+    char *data = head.data();
+    if (readFile.read(data, headTopicLen) != headTopicLen
+            || readFile.read(data + headTopicLen + 1, headLen) != headLen) {
+        return false;
+    }
+    data[headTopicLen] = '\0';
+
+    headLoaded = true;
+    return true;
+}
+
+bool MqttSpool::peek(const char **topic, const char **payload, int *len, int *qos, bool *retain) {
+    if (count == 0) {
+        return false;
+    }
+
+    if (!headLoaded && !loadHead()) {
+        // unreadable, give up the rest of the segment
+        if (segments.size() > 1) {
+            removeFirstSegment();
+        } else {
+            restartWriteSegment();
+        }
+        return false;
+    }
+
+    *topic = head.constData();
+    *payload = head.constData() + headTopicLen + 1;
+    *len = headLen;
+    *qos = headQos;
+    *retain = headRetain;
+    return true;
+}
+
+void MqttSpool::consume() {
+    if (!headLoaded) {
+        return;
+    }
+
+    headLoaded = false;
+    readOffset += RECORD_HEADER_LEN + headTopicLen + headLen;
+    readIndex++;
+    count--;
+
+    if (readIndex < segments.first().count) {
+        return;
+    }
+
+    if (segments.size() > 1) {
+        removeFirstSegment();
+        return;
+    }
+
+    // everything replayed
+    restartWriteSegment();
+}
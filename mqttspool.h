@@ -0,0 +1,87 @@
+#ifndef MQTTSPOOL_H
+#define MQTTSPOOL_H
+
+#include <QString>
+#include <QList>
+#include <QFile>
+#include <QByteArray>
+
+#define MQTTSPOOL_ERR_OK 0
+#define MQTTSPOOL_ERR_CREATE_DIR -1
+#define MQTTSPOOL_ERR_OPEN_SEGMENT -2
+#define MQTTSPOOL_ERR_WRITE_SEGMENT -3
+#define MQTTSPOOL_ERR_TOO_LARGE -4
+#define MQTTSPOOL_ERR_NOT_OPEN -5
+
+#define MQTTSPOOL_DEFAULT_SEGMENT_SIZE (1024 * 1024)
+
+// Store-and-forward buffer for MQTT messages in append-only segment files <dir>/<seq>.spool.
+// Messages are read back oldest first, a segment is deleted once it is read completely.
+// When the size cap is exceeded the oldest segment is dropped. Segments left by a previous
+// run are picked up by open(), a partly replayed segment is replayed again from its start.
+// Not thread safe, owned by the MQTT loop thread.
+class MqttSpool
+{
+public:
+    MqttSpool();
+    ~MqttSpool();
+
+    int open(const QString &dir, qint64 maxSize, qint64 segmentSize = MQTTSPOOL_DEFAULT_SEGMENT_SIZE);
+    void close();
+    bool isOpen() const { return writeFile.isOpen(); }
+
+    bool isEmpty() const { return count == 0; }
+    // messages not yet consumed
+    quint64 getCount() const { return count; }
+    // bytes on disk
+    qint64 getSize() const { return size; }
+    // messages lost to the size cap or unreadable segments
+    quint64 getDroppedCount() const { return dropped; }
+
+    int append(const char *topic, const void *payload, int len, int qos, bool retain);
+
+    // oldest message, stays the head until consume(), pointers valid until the next call
+    bool peek(const char **topic, const char **payload, int *len, int *qos, bool *retain);
+    void consume();
+
+private:
+    struct Segment {
+        quint32 seq;
+        qint64 size;
+        int count;
+    };
+
+    QString dir;
+    qint64 maxSize;
+    qint64 segmentSize;
+
+    QList<Segment> segments;
+    QFile writeFile;
+
+    // position of the head message in the first segment
+    QFile readFile;
+    qint64 readOffset;
+    int readIndex;
+
+    // head message as topic '\0' payload
+    bool headLoaded;
+    QByteArray head;
+    int headTopicLen;
+    int headLen;
+    int headQos;
+    bool headRetain;
+
+    quint64 count;
+    qint64 size;
+    quint64 dropped;
+
+    QString segmentPath(quint32 seq) const;
+    int openWriteSegment(quint32 seq);
+    void scanSegment(Segment *segment);
+    void removeFirstSegment();
+    void restartWriteSegment();
+    bool loadHead();
+
+};
+
+#endif // MQTTSPOOL_H
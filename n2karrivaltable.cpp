@@ -0,0 +1,43 @@
+#include "n2karrivaltable.h"
+
+N2kArrivalTable::N2kArrivalTable()
+{
+    clear();
+}
+
+void N2kArrivalTable::clear() {
+    size = 0;
+    lastHit = 0;
+}
+
+ArrivalStats *N2kArrivalTable::lookup(quint32 pgn, quint8 source) {
+    // consecutive frames are often from the same stream
+    if (lastHit < size && entries[lastHit].pgn == pgn && entries[lastHit].source == source) {
+        return &entries[lastHit].stats;
+    }
+
+    for (int i = 0; i < size; i++) {
+        if (entries[i].pgn == pgn && entries[i].source == source) {
+            lastHit = i;
+            return &entries[i].stats;
+        }
+    }
+
+    int slot;
+    if (size < N2KARRIVALTABLE_SIZE) {
+        slot = size++;
+    } else {
+        slot = 0;
+        for (int i = 1; i < size; i++) {
+            if (entries[i].stats.getLastTimestamp() < entries[slot].stats.getLastTimestamp()) {
+                slot = i;
+            }
+        }
+    }
+
+    entries[slot].pgn = pgn;
+    entries[slot].source = source;
+    entries[slot].stats.reset();
+    lastHit = slot;
+    return &entries[slot].stats;
+}
@@ -0,0 +1,38 @@
+#ifndef N2KARRIVALTABLE_H
+#define N2KARRIVALTABLE_H
+
+#include <QtGlobal>
+
+#include "arrivalstats.h"
+
+// max. number of (PGN, source) streams tracked at once
+#define N2KARRIVALTABLE_SIZE 32
+
+// Arrival statistics per (PGN, source address) in a fixed table. When it is full
+// the stream that was quiet for the longest time is replaced.
+class N2kArrivalTable
+{
+public:
+    struct Entry {
+        quint32 pgn;
+        quint8 source;
+        ArrivalStats stats;
+    };
+
+    N2kArrivalTable();
+
+    ArrivalStats *lookup(quint32 pgn, quint8 source);
+
+    int getSize() const { return size; }
+    const Entry &getEntry(int i) const { return entries[i]; }
+
+    void clear();
+
+private:
+    Entry entries[N2KARRIVALTABLE_SIZE];
+    int size;
+    int lastHit;
+
+};
+
+#endif // N2KARRIVALTABLE_H
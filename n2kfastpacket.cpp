@@ -0,0 +1,142 @@
+#include "n2kfastpacket.h"
+
+#include <string.h>
+
+// payload bytes in the first and in the following frames
+#define FIRST_FRAME_DATA 6
+#define NEXT_FRAME_DATA  7
+
+N2kFastPacket::N2kFastPacket()
+{
+    reset();
+}
+
+void N2kFastPacket::reset() {
+    for (int i = 0; i < N2K_FAST_PACKET_SLOTS; i++) {
+        pool[i].used = false;
+    }
+
+    completedCount = 0;
+    timeoutCount = 0;
+    outOfOrderCount = 0;
+    evictedCount = 0;
+}
+
+N2kFastPacket::Slot *N2kFastPacket::find(quint8 source, quint32 pgn, quint8 seq) {
+    for (int i = 0; i < N2K_FAST_PACKET_SLOTS; i++) {
+        Slot *slot = &pool[i];
+        if (slot->used && slot->source == source && slot->pgn == pgn && slot->seq == seq) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+N2kFastPacket::Slot *N2kFastPacket::allocate(qint64 timestamp) {
+    Slot *oldest = NULL;
+
+    for (int i = 0; i < N2K_FAST_PACKET_SLOTS; i++) {
+        Slot *slot = &pool[i];
+        if (!slot->used) {
+            return slot;
+        }
+
+        // stale messages can be reused right away
+        if (timestamp - slot->timestamp > N2K_FAST_PACKET_TIMEOUT) {
+            timeoutCount++;
+            return slot;
+        }
+
+        if (oldest == NULL || slot->timestamp < oldest->timestamp) {
+            oldest = slot;
+        }
+    }
+
+    // all slots busy, drop the oldest message
+    evictedCount++;
+    return oldest;
+}
+
+bool N2kFastPacket::feed(qint64 timestamp, quint8 source, quint32 pgn, const quint8 *data, int len,
+                         const quint8 **payload, int *payloadLen) {
+    if (len < 1) {
+        return false;
+    }
+
+    quint8 seq = data[0] >> 5;
+    quint8 frame = data[0] & 0x1f;
+    Slot *slot = find(source, pgn, seq);
+
+    if (frame == 0) {
+        if (len < 2 || data[1] > N2K_FAST_PACKET_MAX_LEN) {
+            return false;
+        }
+
+        // restarted sequence, previous message is incomplete
+        if (slot != NULL) {
+            outOfOrderCount++;
+        } else {
+            slot = allocate(timestamp);
+        }
+
+        slot->used = true;
+        slot->source = source;
+        slot->pgn = pgn;
+        slot->seq = seq;
+        slot->nextFrame = 1;
+        slot->length = data[1];
+        slot->received = 0;
+
+        data += 2;
+        len -= 2;
+        if (len > FIRST_FRAME_DATA) {
+            len = FIRST_FRAME_DATA;
+        }
+    } else {
+        // missing start of message
+        if (slot == NULL) {
+            outOfOrderCount++;
+            return false;
+        }
+
+        if (timestamp - slot->timestamp > N2K_FAST_PACKET_TIMEOUT) {
+            timeoutCount++;
+            slot->used = false;
+            return false;
+        }
+
+        if (frame != slot->nextFrame) {
+            outOfOrderCount++;
+            slot->used = false;
+            return false;
+        }
+
+        slot->nextFrame++;
+
+        data += 1;
+        len -= 1;
+        if (len > NEXT_FRAME_DATA) {
+            len = NEXT_FRAME_DATA;
+        }
+    }
+
+    // last frame is padded
+    if (len > slot->length - slot->received) {
+        len = slot->length - slot->received;
+    }
+    memcpy(&slot->data[slot->received], data, len);
+    slot->received += len;
+    slot->timestamp = timestamp;
+
+    if (slot->received < slot->length) {
+        return false;
+    }
+
+    // complete, data stays in place until the slot is reused
+    slot->used = false;
+    completedCount++;
+
+    *payload = slot->data;
+    *payloadLen = slot->length;
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef N2KFASTPACKET_H
+#define N2KFASTPACKET_H
+
+#include <QtGlobal>
+
+#define N2K_FAST_PACKET_MAX_LEN  223
+#define N2K_FAST_PACKET_SLOTS    16
+#define N2K_FAST_PACKET_TIMEOUT  750
+
+// Reassembles NMEA 2000 fast-packet messages keyed by (source, PGN, sequence id)
+// in a fixed pool of slots, nothing is allocated per message.
+class N2kFastPacket
+{
+public:
+    N2kFastPacket();
+
+    // feed one frame (timestamp in msec), returns true if a message is complete,
+    // the payload then stays valid until the next call
+    bool feed(qint64 timestamp, quint8 source, quint32 pgn, const quint8 *data, int len,
+              const quint8 **payload, int *payloadLen);
+
+    void reset();
+
+    quint64 getCompletedCount() const { return completedCount; }
+    quint64 getTimeoutCount() const { return timeoutCount; }
+    quint64 getOutOfOrderCount() const { return outOfOrderCount; }
+    quint64 getEvictedCount() const { return evictedCount; }
+
+private:
+    struct Slot {
+        bool used;
+        quint8 source;
+        quint32 pgn;
+        quint8 seq;
+        quint8 nextFrame;
+        int length;
+        int received;
+        qint64 timestamp;
+        quint8 data[N2K_FAST_PACKET_MAX_LEN];
+    };
+
+    Slot pool[N2K_FAST_PACKET_SLOTS];
+
+    quint64 completedCount;
+    quint64 timeoutCount;
+    quint64 outOfOrderCount;
+    quint64 evictedCount;
+
+    Slot *find(quint8 source, quint32 pgn, quint8 seq);
+    Slot *allocate(qint64 timestamp);
+};
+
+#endif // N2KFASTPACKET_H
@@ -0,0 +1,86 @@
+#ifndef N2KFIELD_H
+#define N2KFIELD_H
+
+#include <QtGlobal>
+
+// Compile time descriptors for little endian NMEA 2000 payload fields.
+// Offsets are in bytes from the start of the payload. Bounds are checked once per
+// message against N2kLength<...>::value, the accessors do no checks themselves.
+
+// Integer field of Bytes bytes at Offset,
+// value() = raw * ScaleNum / ScaleDen + BiasNum / BiasDen
+template <int Offset, int Bytes, bool Signed = false,
+          qint64 ScaleNum = 1, qint64 ScaleDen = 1,
+          qint64 BiasNum = 0, qint64 BiasDen = 1>
+struct N2kField
+{
+    static const int end = Offset + Bytes;
+    static const quint64 mask = ~0ULL >> (64 - 8 * Bytes);
+
+    static inline quint64 raw(const quint8 *d) {
+        quint64 v = 0;
+        for (int i = 0; i < Bytes; i++) {
+            v |= ((quint64) d[Offset + i]) << (8 * i);
+        }
+        return v;
+    }
+
+    static inline qint64 rawSigned(const quint8 *d) {
+        quint64 v = raw(d);
+        if (Signed && (v & (1ULL << (8 * Bytes - 1)))) {
+            v |= ~mask;
+        }
+        return (qint64) v;
+    }
+
+    // all ones (unsigned) or max. positive value (signed) mark "data not available"
+    static inline bool isAvailable(const quint8 *d) {
+        return raw(d) != (Signed ? (mask >> 1) : mask);
+    }
+
+    static inline double value(const quint8 *d) {
+        double r = Signed ? (double) rawSigned(d) : (double) raw(d);
+        return r * ((double) ScaleNum / (double) ScaleDen) + ((double) BiasNum / (double) BiasDen);
+    }
+};
+
+// Bits Shift..Shift+Width-1 of the byte at Offset
+template <int Offset, int Shift, int Width>
+struct N2kBits
+{
+    static const int end = Offset + 1;
+
+    static inline int get(const quint8 *d) {
+        return (d[Offset] >> Shift) & ((1 << Width) - 1);
+    }
+};
+
+// Sequence id of a descriptor with a Sid field, -1 for descriptors without
+template <typename Desc>
+struct N2kSidOf
+{
+    template <typename D>
+    static inline int get(const quint8 *d, typename D::Sid *) { return (int) D::Sid::raw(d); }
+    template <typename D>
+    static inline int get(const quint8 *d, ...) { Q_UNUSED(d); return -1; }
+
+    static inline int get(const quint8 *d) { return get<Desc>(d, 0); }
+};
+
+// Minimum payload length covering all given fields
+template <typename... Fields>
+struct N2kLength;
+
+template <>
+struct N2kLength<>
+{
+    static const int value = 0;
+};
+
+template <typename Field, typename... Fields>
+struct N2kLength<Field, Fields...>
+{
+    static const int value = (Field::end > N2kLength<Fields...>::value) ? Field::end : N2kLength<Fields...>::value;
+};
+
+#endif // N2KFIELD_H
@@ -1,139 +1,274 @@
 #include "n2kparser.h"
+#include "canbatch.h"
 
-#define KELVIN_OFFSET (-273.15)
+#include <math.h>
 
+#include "n2kpgns.h"
+
+// Non-owning, bounds checked view of a NMEA 2000 payload
 class NmeaBuffer
 {
 public:
-    NmeaBuffer(const QByteArray &data) : data(data), pos(0) {}
+    NmeaBuffer(const quint8 *data, int len) : data(data), len(len) {}
 
     int length() {
-        return data.length();
+        return len;
     }
 
-    quint8 getByte() {
-        return (quint8) data[pos++];
+    // payload if it holds at least n bytes, NULL otherwise
+    const quint8 *require(int n) {
+        return (n <= len) ? data : NULL;
     }
 
-    qint8 getSignedByte() {
-        return getByte();
-    }
+private:
+    const quint8 *data;
+    int len;
 
-    quint16 getShort() {
-        return ((quint16) getByte()) | (((quint16) getByte()) << 8);
-    }
+};
 
-    qint16 getSignedShort() {
-        return getShort();
-    }
+N2kParser::N2kParser(CanSource *source, QObject *parent) : QObject(parent)
+{
+    trace = NULL;
+    frameTimestamp = 0;
+
+    // hot path, keep it a plain direct call
+    connect(source, &CanSource::receivedBatch, this, &N2kParser::canReceivedBatch, Qt::DirectConnection);
+    connect(this, &N2kParser::activePgnsChanged, source, &CanSource::setPgnFilter);
 
-    quint32 getLong() {
-        return ((quint32) getByte()) | (((quint32) getByte()) << 8) | (((quint32) getByte()) << 16) | (((quint32) getByte()) << 24);
+    // nobody is interested yet
+    emit activePgnsChanged(activePgns);
+}
+
+void N2kParser::connectNotify(const QMetaMethod &signal) {
+    Q_UNUSED(signal);
+    updateActivePgns();
+}
+
+void N2kParser::disconnectNotify(const QMetaMethod &signal) {
+    Q_UNUSED(signal);
+    updateActivePgns();
+}
+
+void N2kParser::updateActivePgns() {
+    QVector<quint32> pgns;
+
+#define N2K_ACTIVE_PGN(num, name, signal, transport) \
+    if (isSignalConnected(QMetaMethod::fromSignal(&N2kParser::signal))) { \
+        pgns.append(num); \
     }
+    N2K_PGN_TABLE(N2K_ACTIVE_PGN)
+#undef N2K_ACTIVE_PGN
 
-    qint32 getSignedLong() {
-        return getLong();
+    if (pgns == activePgns) {
+        return;
     }
 
-private:
-    const QByteArray data;
-    int pos;
+    activePgns = pgns;
+    emit activePgnsChanged(activePgns);
+}
 
-};
+void N2kParser::registerMetrics(MetricsRegistry *metrics) {
+#define N2K_REGISTER_PGN(num, name, signal, transport) \
+    metrics->addCounter("meteo_n2k_frames_total", "CAN frames received per PGN", "pgn=\"" #num "\"", &pgnFrames[N2K_PGN_INDEX_##name]); \
+    metrics->addCounter("meteo_n2k_messages_total", "NMEA 2000 messages decoded per PGN", "pgn=\"" #num "\"", &pgnMessages[N2K_PGN_INDEX_##name]); \
+    metrics->addCounter("meteo_n2k_decode_errors_total", "Messages dropped for a short payload per PGN", "pgn=\"" #num "\"", &pgnErrors[N2K_PGN_INDEX_##name]);
+    N2K_PGN_TABLE(N2K_REGISTER_PGN)
+#undef N2K_REGISTER_PGN
+    metrics->addCounter("meteo_n2k_frames_total", "CAN frames received per PGN", "pgn=\"other\"", &otherFrames);
 
-N2kParser::N2kParser(const QObject *receiver, QObject *parent) : QObject(parent)
-{
-    connect(receiver, SIGNAL(received(bool, bool, bool, quint32, const QByteArray &)), this, SLOT(canReceived(bool, bool, bool, quint32, const QByteArray &)));
+    metrics->addCounter("meteo_n2k_fast_packets_total", "Fast-packet reassembly results", "result=\"completed\"", &fastCompleted);
+    metrics->addCounter("meteo_n2k_fast_packets_total", "Fast-packet reassembly results", "result=\"timeout\"", &fastTimeout);
+    metrics->addCounter("meteo_n2k_fast_packets_total", "Fast-packet reassembly results", "result=\"out_of_order\"", &fastOutOfOrder);
+    metrics->addCounter("meteo_n2k_fast_packets_total", "Fast-packet reassembly results", "result=\"evicted\"", &fastEvicted);
+
+    connect(metrics, &MetricsRegistry::collect, this, &N2kParser::collectMetrics, Qt::DirectConnection);
+}
+
+void N2kParser::collectMetrics() {
+    fastCompleted.set(fastPacket.getCompletedCount());
+    fastTimeout.set(fastPacket.getTimeoutCount());
+    fastOutOfOrder.set(fastPacket.getOutOfOrderCount());
+    fastEvicted.set(fastPacket.getEvictedCount());
 }
 
-void N2kParser::canReceived(bool isEff, bool isRtr, bool isErr, quint32 canId, const QByteArray &data) {
-    Q_UNUSED(isRtr);
+void N2kParser::canReceivedBatch(const CanFrame *frames, int count) {
+    for (int i = 0; i < count; i++) {
+        canReceived(frames[i]);
+    }
+}
 
+void N2kParser::canReceived(const CanFrame &frame) {
     // ignore error frames
-    if (isErr) {
+    if (frame.flags & CAN_FRAME_FLAG_ERR) {
+        otherFrames.inc();
         return;
     }
 
     // need extended frame
-    if (!isEff) {
+    if (!(frame.flags & CAN_FRAME_FLAG_EFF)) {
+        otherFrames.inc();
         return;
     }
 
-    NmeaBuffer buf(data);
-    qint32 pgn = (canId >> 8) & 0x3ffff;
+    qint64 timestamp = frame.timestamp / 1000LL;
+    qint32 pgn = (frame.id >> 8) & 0x3ffff;
+    quint8 source = frame.id & 0xff;
 
-    // Wind Data
-    if (pgn == 130306 && buf.length() >= 6) {
-        int sid = buf.getByte();
-        int veloRaw = buf.getShort();
-        int dirRaw = buf.getSignedShort();
-        int ref = buf.getByte() & 0x07;
+    NmeaBuffer buf(frame.data, frame.dlc);
+    const quint8 *d;
+    int len;
 
-        if (ref < _N2K_WIND_REF_EOL) {
-            double velo = (double) veloRaw * 0.01;
-            double dir = (double) dirRaw * 0.0001;
-            emit receivedWindData(sid, (N2K_WIND_REF_T) ref, velo, dir);
-        }
+    // dispatch to the decoder, fast-packets are reassembled first,
+    // messages shorter than the descriptor are ignored
+    switch (pgn) {
+#define N2K_DISPATCH_PGN(num, name, signal, transport) \
+    case num: \
+        pgnFrames[N2K_PGN_INDEX_##name].inc(); \
+        if (transport == N2K_FAST) { \
+            if (!fastPacket.feed(timestamp, source, num, frame.data, frame.dlc, &d, &len)) { \
+                return; \
+            } \
+            buf = NmeaBuffer(d, len); \
+        } \
+        d = buf.require(N2k##name::length); \
+        if (d == NULL) { \
+            pgnErrors[N2K_PGN_INDEX_##name].inc(); \
+        } else { \
+            pgnMessages[N2K_PGN_INDEX_##name].inc(); \
+            arrivals.lookup(num, source)->record(frame.timestamp, N2kSidOf<N2k##name>::get(d)); \
+            frameTimestamp = frame.timestamp; \
+            if (trace != NULL) { \
+                trace->setOrigin(frame.timestamp); \
+                trace->record(LATENCY_STAGE_DECODE); \
+            } \
+            decode##name(timestamp, d); \
+        } \
+        return;
+    N2K_PGN_TABLE(N2K_DISPATCH_PGN)
+#undef N2K_DISPATCH_PGN
+    default:
+        otherFrames.inc();
         return;
     }
+}
+
+void N2kParser::decodeSystemTime(qint64 timestamp, const quint8 *d) {
+    typedef N2kSystemTime F;
 
-    // Environmental Parameters
-    if (pgn == 130311 && buf.length() >= 8) {
-        int sid = buf.getByte();
-        int source = buf.getByte();
-        int tempRaw = buf.getShort();
-        int humiRaw = buf.getShort();
-        int pressRaw = buf.getShort();
-
-        double temp = 0.0;
-        int tempSrc = source & 0x3f;
-        if (tempSrc >= _N2K_TEMP_SRC_EOL) {
-            tempSrc = N2K_TEMP_SRC_INVAL;
-        } else {
-            temp = (double) tempRaw * 0.01 + KELVIN_OFFSET;
-        }
-
-        double humi = 0.0;
-        int humiSrc = (source >> 6) & 0x03;
-        if (humiSrc >= _N2K_HUMI_SRC_EOL) {
-            humiSrc = N2K_HUMI_SRC_INVAL;
-        } else {
-            humi = (double) humiRaw * 0.004;
-        }
-
-        double press = (double) pressRaw * 1.0;
-
-        emit receivedEnvParams(sid, (N2K_TEMP_SRC_T) tempSrc, temp, (N2K_HUMI_SRC_T) humiSrc, humi, press);
+    int source = F::Source::get(d);
+    if (source >= _N2K_TIME_SRC_EOL || !F::Date::isAvailable(d) || !F::Time::isAvailable(d)) {
         return;
     }
 
-    // Temperature
-    if (pgn == 130312 && buf.length() >= 7) {
-        int sid = buf.getByte();
-        int inst = buf.getByte();
-        int source = buf.getByte();
-        int tempRaw = buf.getShort();
-        int setpRaw = buf.getShort();
+    qint64 utc = (qint64) F::Date::raw(d) * 86400000LL + (qint64) F::Time::value(d);
+    emit receivedSystemTime(timestamp, F::Sid::raw(d), (N2K_TIME_SRC_T) source, utc);
+}
+
+void N2kParser::decodeVesselHeading(qint64 timestamp, const quint8 *d) {
+    typedef N2kVesselHeading F;
 
-        if (source < _N2K_TEMP_SRC_EOL) {
-            double temp = (double) tempRaw * 0.01 + KELVIN_OFFSET;
-            double setp = (double) setpRaw * 0.01 + KELVIN_OFFSET;
-            emit receivedTemperature(sid, inst, (N2K_TEMP_SRC_T) source, temp, setp);
-        }
+    int ref = F::Ref::get(d);
+    if (ref >= _N2K_HEADING_REF_EOL || !F::Heading::isAvailable(d)) {
         return;
     }
 
-    // Actual Pressure
-    if (pgn == 130314 && buf.length() >= 7) {
-        int sid = buf.getByte();
-        int inst = buf.getByte();
-        int source = buf.getByte();
-        unsigned int pressRaw = buf.getLong();
+    double deviation = F::Deviation::isAvailable(d) ? F::Deviation::value(d) : NAN;
+    double variation = F::Variation::isAvailable(d) ? F::Variation::value(d) : NAN;
+    emit receivedVesselHeading(timestamp, F::Sid::raw(d), (N2K_HEADING_REF_T) ref, F::Heading::value(d), deviation, variation);
+}
+
+void N2kParser::decodeGnssPosition(qint64 timestamp, const quint8 *d) {
+    typedef N2kGnssPosition F;
 
-        if (source < _N2K_PRESS_SRC_EOL) {
-            double press = (double) pressRaw * 0.001;
-            emit receivedActualPressure(sid, inst, (N2K_PRESS_SRC_T) source, press);
-        }
+    qint64 utc = 0;
+    if (F::Date::isAvailable(d) && F::Time::isAvailable(d)) {
+        utc = (qint64) F::Date::raw(d) * 86400000LL + (qint64) F::Time::value(d);
+    }
+
+    double lat = F::Lat::isAvailable(d) ? F::Lat::value(d) : NAN;
+    double lon = F::Lon::isAvailable(d) ? F::Lon::value(d) : NAN;
+    double alt = F::Alt::isAvailable(d) ? F::Alt::value(d) : NAN;
+    emit receivedGnssPosition(timestamp, F::Sid::raw(d), utc, lat, lon, alt, F::Method::get(d), F::Satellites::raw(d));
+}
+
+void N2kParser::decodeWindData(qint64 timestamp, const quint8 *d) {
+    typedef N2kWindData F;
+
+    int ref = F::Ref::get(d);
+    if (ref < _N2K_WIND_REF_EOL) {
+        emit receivedWindData(timestamp, F::Sid::raw(d), (N2K_WIND_REF_T) ref, F::Velo::value(d), F::Dir::value(d));
+    }
+}
+
+void N2kParser::decodeEnvParams(qint64 timestamp, const quint8 *d) {
+    typedef N2kEnvParams F;
+
+    double temp = 0.0;
+    int tempSrc = F::TempSrc::get(d);
+    if (tempSrc >= _N2K_TEMP_SRC_EOL) {
+        tempSrc = N2K_TEMP_SRC_INVAL;
+    } else {
+        temp = F::Temp::value(d);
+    }
+
+    double humi = 0.0;
+    int humiSrc = F::HumiSrc::get(d);
+    if (humiSrc >= _N2K_HUMI_SRC_EOL) {
+        humiSrc = N2K_HUMI_SRC_INVAL;
+    } else {
+        humi = F::Humi::value(d);
+    }
+
+    emit receivedEnvParams(timestamp, F::Sid::raw(d), (N2K_TEMP_SRC_T) tempSrc, temp, (N2K_HUMI_SRC_T) humiSrc, humi, F::Press::value(d));
+}
+
+void N2kParser::decodeTemperature(qint64 timestamp, const quint8 *d) {
+    typedef N2kTemperature F;
+
+    int source = F::Source::raw(d);
+    if (source < _N2K_TEMP_SRC_EOL) {
+        emit receivedTemperature(timestamp, F::Sid::raw(d), F::Inst::raw(d), (N2K_TEMP_SRC_T) source, F::Temp::value(d), F::Setp::value(d));
+    }
+}
+
+void N2kParser::decodeHumidity(qint64 timestamp, const quint8 *d) {
+    typedef N2kHumidity F;
+
+    int source = F::Source::raw(d);
+    if (source < _N2K_HUMI_SRC_EOL && F::Humi::isAvailable(d)) {
+        double setp = F::Setp::isAvailable(d) ? F::Setp::value(d) : NAN;
+        emit receivedHumidity(timestamp, F::Sid::raw(d), F::Inst::raw(d), (N2K_HUMI_SRC_T) source, F::Humi::value(d), setp);
+    }
+}
+
+void N2kParser::decodeActualPressure(qint64 timestamp, const quint8 *d) {
+    typedef N2kActualPressure F;
+
+    int source = F::Source::raw(d);
+    if (source < _N2K_PRESS_SRC_EOL) {
+        emit receivedActualPressure(timestamp, F::Sid::raw(d), F::Inst::raw(d), (N2K_PRESS_SRC_T) source, F::Press::value(d));
+    }
+}
+
+void N2kParser::decodeMeteoStation(qint64 timestamp, const quint8 *d) {
+    typedef N2kMeteoStation F;
+
+    int ref = F::Ref::get(d);
+    if (ref >= _N2K_WIND_REF_EOL) {
         return;
     }
+
+    qint64 utc = 0;
+    if (F::Date::isAvailable(d) && F::Time::isAvailable(d)) {
+        utc = (qint64) F::Date::raw(d) * 86400000LL + (qint64) F::Time::value(d);
+    }
+
+    double lat = F::Lat::isAvailable(d) ? F::Lat::value(d) : NAN;
+    double lon = F::Lon::isAvailable(d) ? F::Lon::value(d) : NAN;
+    double velo = F::Velo::isAvailable(d) ? F::Velo::value(d) : NAN;
+    double dir = F::Dir::isAvailable(d) ? F::Dir::value(d) : NAN;
+    double gusts = F::Gusts::isAvailable(d) ? F::Gusts::value(d) : NAN;
+    double press = F::Press::isAvailable(d) ? F::Press::value(d) : NAN;
+    double temp = F::Temp::isAvailable(d) ? F::Temp::value(d) : NAN;
+    emit receivedMeteoStation(timestamp, F::Mode::get(d), utc, lat, lon, (N2K_WIND_REF_T) ref, velo, dir, gusts, press, temp);
 }
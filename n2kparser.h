@@ -2,6 +2,16 @@
 #define N2KPARSER_H
 
 #include <QObject>
+#include <QVector>
+#include <QMetaMethod>
+
+#include "canframe.h"
+#include "cansource.h"
+#include "n2kfastpacket.h"
+#include "n2karrivaltable.h"
+#include "n2kpgns.h"
+#include "latencytrace.h"
+#include "metricsregistry.h"
 
 typedef enum {
     N2K_WIND_REF_GEO_NORTH = 0,
@@ -49,20 +59,103 @@ typedef enum {
     _N2K_PRESS_SRC_EOL
 } N2K_PRESS_SRC_T;
 
+typedef enum {
+    N2K_TIME_SRC_GPS = 0,
+    N2K_TIME_SRC_GLONASS,
+    N2K_TIME_SRC_RADIO_STATION,
+    N2K_TIME_SRC_LOCAL_CESIUM,
+    N2K_TIME_SRC_LOCAL_RUBIDIUM,
+    N2K_TIME_SRC_LOCAL_CRYSTAL,
+    _N2K_TIME_SRC_EOL
+} N2K_TIME_SRC_T;
+
+typedef enum {
+    N2K_HEADING_REF_TRUE = 0,
+    N2K_HEADING_REF_MAGNETIC,
+    _N2K_HEADING_REF_EOL
+} N2K_HEADING_REF_T;
+
 class N2kParser : public QObject
 {
     Q_OBJECT
 public:
-    explicit N2kParser(const QObject *receiver, QObject *parent = 0);
+    explicit N2kParser(CanSource *source, QObject *parent = 0);
+
+    // PGNs that have at least one connected handler
+    const QVector<quint32> &getActivePgns() { return activePgns; }
+
+    const N2kFastPacket &getFastPacket() { return fastPacket; }
+
+    // rate, gap and sid statistics per (PGN, source) of decoded messages
+    const N2kArrivalTable &getArrivals() { return arrivals; }
+
+    // usec receive time of the frame being decoded, valid in directly connected handlers
+    qint64 getFrameTimestamp() { return frameTimestamp; }
+
+    // record decode latency and set the trace origin for the handlers, NULL disables
+    void setTrace(LatencyTrace *trace) { this->trace = trace; }
+
+    // export frame/message/error counters per PGN and fast-packet statistics
+    void registerMetrics(MetricsRegistry *metrics);
 
 signals:
-    void receivedWindData(int sid, N2K_WIND_REF_T ref, double velo, double dir);
-    void receivedEnvParams(int sid, N2K_TEMP_SRC_T tempSrc, double temp, N2K_HUMI_SRC_T humiSrc, double humi, double press);
-    void receivedTemperature(int sid, int inst, N2K_TEMP_SRC_T source, double temp, double setp);
-    void receivedActualPressure(int sid, int inst, N2K_PRESS_SRC_T source, double press);
+    void activePgnsChanged(const QVector<quint32> &pgns);
+
+    // timestamp is the frame receive time in msec, CLOCK_MONOTONIC
+    void receivedWindData(qint64 timestamp, int sid, N2K_WIND_REF_T ref, double velo, double dir);
+    void receivedEnvParams(qint64 timestamp, int sid, N2K_TEMP_SRC_T tempSrc, double temp, N2K_HUMI_SRC_T humiSrc, double humi, double press);
+    void receivedTemperature(qint64 timestamp, int sid, int inst, N2K_TEMP_SRC_T source, double temp, double setp);
+    void receivedActualPressure(qint64 timestamp, int sid, int inst, N2K_PRESS_SRC_T source, double press);
+    void receivedHumidity(qint64 timestamp, int sid, int inst, N2K_HUMI_SRC_T source, double humi, double setp);
+    // utc in msec since 1970-01-01
+    void receivedSystemTime(qint64 timestamp, int sid, N2K_TIME_SRC_T source, qint64 utc);
+    // angles in rad, deviation/variation are NAN if not available
+    void receivedVesselHeading(qint64 timestamp, int sid, N2K_HEADING_REF_T ref, double heading, double deviation, double variation);
+    // utc in msec since 1970-01-01, lat/lon in deg, alt in m, NAN if not available
+    void receivedGnssPosition(qint64 timestamp, int sid, qint64 utc, double lat, double lon, double alt, int method, int satellites);
+    // utc and lat/lon as above, velo/gusts in m/s, dir in rad, press in hPa, temp in deg C, NAN if not available
+    void receivedMeteoStation(qint64 timestamp, int mode, qint64 utc, double lat, double lon, N2K_WIND_REF_T ref, double velo, double dir, double gusts, double press, double temp);
+
+protected:
+    void connectNotify(const QMetaMethod &signal);
+    void disconnectNotify(const QMetaMethod &signal);
+
+private:
+    QVector<quint32> activePgns;
+    N2kFastPacket fastPacket;
+    N2kArrivalTable arrivals;
+    LatencyTrace *trace;
+    qint64 frameTimestamp;
+
+    // indexed like N2K_PGN_TABLE
+    MetricsCounter pgnFrames[N2K_PGN_COUNT];
+    MetricsCounter pgnMessages[N2K_PGN_COUNT];
+    MetricsCounter pgnErrors[N2K_PGN_COUNT];
+    MetricsCounter otherFrames;
+
+    // mirrored from fastPacket
+    MetricsCounter fastCompleted;
+    MetricsCounter fastTimeout;
+    MetricsCounter fastOutOfOrder;
+    MetricsCounter fastEvicted;
+
+    void updateActivePgns();
+    void canReceived(const CanFrame &frame);
+
+    // one decoder per entry in N2K_PGN_TABLE, payload length is already checked
+    void decodeSystemTime(qint64 timestamp, const quint8 *d);
+    void decodeVesselHeading(qint64 timestamp, const quint8 *d);
+    void decodeGnssPosition(qint64 timestamp, const quint8 *d);
+    void decodeWindData(qint64 timestamp, const quint8 *d);
+    void decodeEnvParams(qint64 timestamp, const quint8 *d);
+    void decodeTemperature(qint64 timestamp, const quint8 *d);
+    void decodeHumidity(qint64 timestamp, const quint8 *d);
+    void decodeActualPressure(qint64 timestamp, const quint8 *d);
+    void decodeMeteoStation(qint64 timestamp, const quint8 *d);
 
 private slots:
-    void canReceived(bool isEff, bool isRtr, bool isErr, quint32 canId, const QByteArray &data);
+    void canReceivedBatch(const CanFrame *frames, int count);
+    void collectMetrics();
 };
 
 #endif // N2KPARSER_H
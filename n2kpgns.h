@@ -0,0 +1,133 @@
+#ifndef N2KPGNS_H
+#define N2KPGNS_H
+
+#include "n2kfield.h"
+
+// transport of a PGN
+enum {
+    N2K_SINGLE = 0,     // single frame
+    N2K_FAST            // fast-packet, up to 223 bytes
+};
+
+// Decoded PGNs: number, name of the descriptor (N2k<name>) and
+// decoder (N2kParser::decode<name>), signal carrying the result, transport.
+// Adding a PGN takes a descriptor below, a table entry and the decoder.
+#define N2K_PGN_TABLE(X) \
+    X(126992, SystemTime,     receivedSystemTime,     N2K_SINGLE) \
+    X(127250, VesselHeading,  receivedVesselHeading,  N2K_SINGLE) \
+    X(129029, GnssPosition,   receivedGnssPosition,   N2K_FAST) \
+    X(130306, WindData,       receivedWindData,       N2K_SINGLE) \
+    X(130311, EnvParams,      receivedEnvParams,      N2K_SINGLE) \
+    X(130312, Temperature,    receivedTemperature,    N2K_SINGLE) \
+    X(130313, Humidity,       receivedHumidity,       N2K_SINGLE) \
+    X(130314, ActualPressure, receivedActualPressure, N2K_SINGLE) \
+    X(130323, MeteoStation,   receivedMeteoStation,   N2K_FAST)
+
+// position of a PGN in N2K_PGN_TABLE
+enum {
+#define N2K_PGN_INDEX(num, name, signal, transport) N2K_PGN_INDEX_##name,
+    N2K_PGN_TABLE(N2K_PGN_INDEX)
+#undef N2K_PGN_INDEX
+    N2K_PGN_COUNT
+};
+
+#define N2K_KELVIN_FIELD(offset) N2kField<offset, 2, false, 1, 100, -27315, 100>
+
+// System Time
+struct N2kSystemTime {
+    typedef N2kField<0, 1> Sid;
+    typedef N2kBits<1, 0, 4> Source;
+    typedef N2kField<2, 2> Date;                            // days since 1970-01-01
+    typedef N2kField<4, 4, false, 1, 10> Time;              // msec since midnight
+    static const int length = N2kLength<Sid, Source, Date, Time>::value;
+};
+
+// Vessel Heading
+struct N2kVesselHeading {
+    typedef N2kField<0, 1> Sid;
+    typedef N2kField<1, 2, false, 1, 10000> Heading;        // rad
+    typedef N2kField<3, 2, true, 1, 10000> Deviation;       // rad
+    typedef N2kField<5, 2, true, 1, 10000> Variation;       // rad
+    typedef N2kBits<7, 0, 2> Ref;
+    static const int length = N2kLength<Sid, Heading, Deviation, Variation, Ref>::value;
+};
+
+// GNSS Position Data
+struct N2kGnssPosition {
+    typedef N2kField<0, 1> Sid;
+    typedef N2kField<1, 2> Date;                            // days since 1970-01-01
+    typedef N2kField<3, 4, false, 1, 10> Time;              // msec since midnight
+    typedef N2kField<7, 8, true, 1, 10000000000000000LL> Lat;   // deg
+    typedef N2kField<15, 8, true, 1, 10000000000000000LL> Lon;  // deg
+    typedef N2kField<23, 8, true, 1, 1000000> Alt;          // m
+    typedef N2kBits<31, 4, 4> Method;
+    typedef N2kField<33, 1> Satellites;
+    static const int length = N2kLength<Sid, Date, Time, Lat, Lon, Alt, Method, Satellites>::value;
+};
+
+// Wind Data
+struct N2kWindData {
+    typedef N2kField<0, 1> Sid;
+    typedef N2kField<1, 2, false, 1, 100> Velo;             // m/s
+    typedef N2kField<3, 2, true, 1, 10000> Dir;             // rad
+    typedef N2kBits<5, 0, 3> Ref;
+    static const int length = N2kLength<Sid, Velo, Dir, Ref>::value;
+};
+
+// Environmental Parameters
+struct N2kEnvParams {
+    typedef N2kField<0, 1> Sid;
+    typedef N2kBits<1, 0, 6> TempSrc;
+    typedef N2kBits<1, 6, 2> HumiSrc;
+    typedef N2K_KELVIN_FIELD(2) Temp;                       // deg C
+    typedef N2kField<4, 2, false, 4, 1000> Humi;            // %
+    typedef N2kField<6, 2> Press;                           // hPa
+    static const int length = N2kLength<Sid, TempSrc, HumiSrc, Temp, Humi, Press>::value;
+};
+
+// Temperature
+struct N2kTemperature {
+    typedef N2kField<0, 1> Sid;
+    typedef N2kField<1, 1> Inst;
+    typedef N2kField<2, 1> Source;
+    typedef N2K_KELVIN_FIELD(3) Temp;                       // deg C
+    typedef N2K_KELVIN_FIELD(5) Setp;                       // deg C
+    static const int length = N2kLength<Sid, Inst, Source, Temp, Setp>::value;
+};
+
+// Humidity
+struct N2kHumidity {
+    typedef N2kField<0, 1> Sid;
+    typedef N2kField<1, 1> Inst;
+    typedef N2kField<2, 1> Source;
+    typedef N2kField<3, 2, true, 4, 1000> Humi;             // %
+    typedef N2kField<5, 2, true, 4, 1000> Setp;             // %
+    static const int length = N2kLength<Sid, Inst, Source, Humi, Setp>::value;
+};
+
+// Actual Pressure
+struct N2kActualPressure {
+    typedef N2kField<0, 1> Sid;
+    typedef N2kField<1, 1> Inst;
+    typedef N2kField<2, 1> Source;
+    typedef N2kField<3, 4, false, 1, 1000> Press;           // hPa
+    static const int length = N2kLength<Sid, Inst, Source, Press>::value;
+};
+
+// Meteorological Station Data, station id and name strings are not decoded
+struct N2kMeteoStation {
+    typedef N2kBits<0, 0, 4> Mode;
+    typedef N2kField<1, 2> Date;                            // days since 1970-01-01
+    typedef N2kField<3, 4, false, 1, 10> Time;              // msec since midnight
+    typedef N2kField<7, 4, true, 1, 10000000> Lat;          // deg
+    typedef N2kField<11, 4, true, 1, 10000000> Lon;         // deg
+    typedef N2kField<15, 2, false, 1, 100> Velo;            // m/s
+    typedef N2kField<17, 2, false, 1, 10000> Dir;           // rad
+    typedef N2kBits<19, 0, 3> Ref;
+    typedef N2kField<20, 2, false, 1, 100> Gusts;           // m/s
+    typedef N2kField<22, 2> Press;                          // hPa
+    typedef N2K_KELVIN_FIELD(24) Temp;                      // deg C
+    static const int length = N2kLength<Mode, Date, Time, Lat, Lon, Velo, Dir, Ref, Gusts, Press, Temp>::value;
+};
+
+#endif // N2KPGNS_H
@@ -0,0 +1,131 @@
+#include "publishpolicy.h"
+
+#include <math.h>
+
+PublishPolicy::PublishPolicy()
+{
+    minInterval = 0;
+    heartbeat = 0;
+    for (int i = 0; i < PUBLISHPOLICY_MAX_VALUES; i++) {
+        deadbandAbs[i] = 0.0;
+        deadbandRel[i] = 0.0;
+    }
+    hasDeadband = false;
+    angleMask = 0;
+    discreteMask = 0;
+
+    hasSent = false;
+    lastSent = 0;
+    lastCount = 0;
+}
+
+void PublishPolicy::setMaxRate(double hz) {
+    minInterval = (hz > 0.0) ? (qint64) (1000.0 / hz + 0.5) : 0;
+}
+
+void PublishPolicy::setDeadband(int index, double absolute, double relative) {
+    if (index < 0 || index >= PUBLISHPOLICY_MAX_VALUES) {
+        return;
+    }
+
+    deadbandAbs[index] = (absolute > 0.0) ? absolute : 0.0;
+    deadbandRel[index] = (relative > 0.0) ? relative : 0.0;
+
+    hasDeadband = false;
+    for (int i = 0; i < PUBLISHPOLICY_MAX_VALUES; i++) {
+        if (deadbandAbs[i] > 0.0 || deadbandRel[i] > 0.0) {
+            hasDeadband = true;
+        }
+    }
+}
+
+bool PublishPolicy::changed(const double *values, int count) const {
+    if (!hasDeadband) {
+        return true;
+    }
+
+    if (count != lastCount) {
+        return true;
+    }
+
+    for (int i = 0; i < count; i++) {
+        double last = lastValues[i];
+        double v = values[i];
+
+        // becoming available or unavailable is always a change
+        if (isnan(v) != isnan(last)) {
+            return true;
+        }
+        if (isnan(v)) {
+            continue;
+        }
+
+        // e.g. the pressure trend, there is no "almost the same" enum value
+        if (discreteMask & (1U << i)) {
+            if (v != last) {
+                return true;
+            }
+            continue;
+        }
+
+        double delta = fabs(v - last);
+        if (angleMask & (1U << i)) {
+            delta = fmod(delta, 360.0);
+            if (delta > 180.0) {
+                delta = 360.0 - delta;
+            }
+        }
+
+        double absolute = deadbandAbs[i];
+        double relative = deadbandRel[i];
+        if (absolute <= 0.0 && relative <= 0.0) {
+            if (delta > 0.0) {
+                return true;
+            }
+            continue;
+        }
+        if (absolute > 0.0 && delta > absolute) {
+            return true;
+        }
+        if (relative > 0.0 && delta > relative * fabs(last)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+PublishPolicy::Decision PublishPolicy::check(qint64 now, const double *values, int count) {
+    if (!hasSent) {
+        return Send;
+    }
+
+    bool heartbeatDue = heartbeat > 0 && (now - lastSent) >= heartbeat;
+    if (!heartbeatDue && !changed(values, count)) {
+        return Suppress;
+    }
+
+    if (minInterval > 0 && (now - lastSent) < minInterval) {
+        return Defer;
+    }
+
+    return Send;
+}
+
+qint64 PublishPolicy::getDeferDelay(qint64 now) const {
+    qint64 delay = lastSent + minInterval - now;
+    return (delay > 0) ? delay : 0;
+}
+
+void PublishPolicy::sent(qint64 now, const double *values, int count) {
+    if (count > PUBLISHPOLICY_MAX_VALUES) {
+        count = PUBLISHPOLICY_MAX_VALUES;
+    }
+
+    hasSent = true;
+    lastSent = now;
+    for (int i = 0; i < count; i++) {
+        lastValues[i] = values[i];
+    }
+    lastCount = count;
+}
@@ -0,0 +1,65 @@
+#ifndef PUBLISHPOLICY_H
+#define PUBLISHPOLICY_H
+
+#include <QtGlobal>
+
+// max. number of values compared by the deadband
+#define PUBLISHPOLICY_MAX_VALUES 4
+
+// When to publish updates of one topic: at most maxRate messages per second (later
+// updates are deferred and coalesced to the latest value), not before a value left
+// its deadband, but at least every heartbeat interval while updates keep coming.
+// All limits are off by default, every update is sent.
+class PublishPolicy
+{
+public:
+    enum Decision { Send, Defer, Suppress };
+
+    PublishPolicy();
+
+    // messages per second, 0 = unlimited
+    void setMaxRate(double hz);
+    double getMaxRate() const { return minInterval > 0 ? 1000.0 / (double) minInterval : 0.0; }
+
+    // msec, resend unchanged values after this time, 0 = never
+    void setHeartbeat(qint64 msec) { heartbeat = msec; }
+    qint64 getHeartbeat() const { return heartbeat; }
+
+    // value n has changed if it moved more than absolute or more than relative * |last sent|,
+    // in its own unit; both 0 = every change of value n counts, if no value has a deadband
+    // every update counts as change
+    void setDeadband(int index, double absolute, double relative);
+    double getDeadbandAbs(int index) const { return deadbandAbs[index]; }
+    double getDeadbandRel(int index) const { return deadbandRel[index]; }
+
+    // bit n set: value n is an angle in degrees, compared across 0/360
+    void setAngleMask(quint32 mask) { angleMask = mask; }
+    // bit n set: value n is discrete (an enum), every change is sent regardless of the deadband
+    void setDiscreteMask(quint32 mask) { discreteMask = mask; }
+
+    // what to do with the values at time now (msec)
+    Decision check(qint64 now, const double *values, int count);
+    // msec until a deferred message may be sent
+    qint64 getDeferDelay(qint64 now) const;
+    // record a published message
+    void sent(qint64 now, const double *values, int count);
+
+private:
+    qint64 minInterval;
+    qint64 heartbeat;
+    double deadbandAbs[PUBLISHPOLICY_MAX_VALUES];
+    double deadbandRel[PUBLISHPOLICY_MAX_VALUES];
+    bool hasDeadband;
+    quint32 angleMask;
+    quint32 discreteMask;
+
+    bool hasSent;
+    qint64 lastSent;
+    double lastValues[PUBLISHPOLICY_MAX_VALUES];
+    int lastCount;
+
+    bool changed(const double *values, int count) const;
+
+};
+
+#endif // PUBLISHPOLICY_H
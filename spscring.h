@@ -0,0 +1,98 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+// Fixed capacity lock-free ring for exactly one producer and one consumer thread.
+// Capacity is rounded up to a power of two. Items that do not fit are dropped and counted.
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(int minCapacity) {
+        quint32 cap = 1;
+        while (cap < (quint32) minCapacity) {
+            cap <<= 1;
+        }
+
+        buffer = new T[cap];
+        mask = cap - 1;
+
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        resetStats();
+    }
+
+    ~SpscRing() {
+        delete[] buffer;
+    }
+
+    int getCapacity() const { return mask + 1; }
+    int getSize() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    // statistics, may be read from any thread
+    int getHighWater() const { return highWater.load(std::memory_order_relaxed); }
+    quint64 getOverflowCount() const { return overflowCount.load(std::memory_order_relaxed); }
+    void resetStats() {
+        highWater.store(0, std::memory_order_relaxed);
+        overflowCount.store(0, std::memory_order_relaxed);
+    }
+
+    // producer side, returns number of items stored
+    int push(const T *items, int count) {
+        quint32 h = head.load(std::memory_order_relaxed);
+        quint32 t = tail.load(std::memory_order_acquire);
+
+        quint32 space = (mask + 1) - (h - t);
+        int n = ((quint32) count > space) ? (int) space : count;
+        for (int i = 0; i < n; i++) {
+            buffer[(h + i) & mask] = items[i];
+        }
+        head.store(h + n, std::memory_order_release);
+
+        if (n < count) {
+            overflowCount.fetch_add(count - n, std::memory_order_relaxed);
+        }
+
+        int used = h + n - t;
+        if (used > highWater.load(std::memory_order_relaxed)) {
+            highWater.store(used, std::memory_order_relaxed);
+        }
+
+        return n;
+    }
+
+    // consumer side, returns number of items fetched
+    int pop(T *items, int max) {
+        quint32 t = tail.load(std::memory_order_relaxed);
+        quint32 h = head.load(std::memory_order_acquire);
+
+        quint32 avail = h - t;
+        int n = ((quint32) max > avail) ? (int) avail : max;
+        for (int i = 0; i < n; i++) {
+            items[i] = buffer[(t + i) & mask];
+        }
+        tail.store(t + n, std::memory_order_release);
+
+        return n;
+    }
+
+private:
+    Q_DISABLE_COPY(SpscRing)
+
+    T *buffer;
+    quint32 mask;
+
+    // keep producer and consumer index on separate cache lines
+    std::atomic<quint32> head;
+    char headPad[64 - sizeof(std::atomic<quint32>)];
+    std::atomic<quint32> tail;
+    char tailPad[64 - sizeof(std::atomic<quint32>)];
+
+    std::atomic<int> highWater;
+    std::atomic<quint64> overflowCount;
+};
+
+#endif // SPSCRING_H
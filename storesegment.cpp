@@ -0,0 +1,371 @@
+#include "storesegment.h"
+
+#include <QtGlobal>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HEADER_SIZE 64
+#define MINUTES_OFFSET HEADER_SIZE
+// page aligned, the records start on their own page
+#define RECORDS_OFFSET 49152
+
+static const char SEGMENT_MAGIC[4] = { 'M', 'S', 'E', 'G' };
+
+struct StoreSegment::Header {
+    char magic[4];
+    quint32 version;
+    quint32 recordSize;
+    quint32 capacity;
+    qint64 dayStart;
+    quint32 count;
+    quint32 channels;
+    quint32 circularMask;
+    char reserved[28];
+};
+
+StoreSegment::StoreSegment()
+{
+    Q_STATIC_ASSERT(sizeof(Header) == HEADER_SIZE);
+    Q_STATIC_ASSERT(sizeof(StoreRecord) == 16);
+    Q_STATIC_ASSERT(MINUTES_OFFSET + STORESEGMENT_MINUTES * sizeof(StoreMinute) <= RECORDS_OFFSET);
+
+    fd = -1;
+    map = NULL;
+    mapSize = 0;
+    writable = false;
+
+    header = NULL;
+    minutes = NULL;
+    records = NULL;
+
+    dayStart = 0;
+    capacity = 0;
+    count = 0;
+    channels = 0;
+    circularMask = 0;
+
+    openMinute = -1;
+    syncedCount = 0;
+    indexDirty = false;
+}
+
+StoreSegment::~StoreSegment()
+{
+    close();
+}
+
+int StoreSegment::mapFile(const QString &path, bool write, qint64 size) {
+    int err = STORESEGMENT_ERR_OK;
+    struct stat st;
+
+    if ((fd = ::open(path.toLocal8Bit().constData(), write ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644)) < 0) {
+        err = STORESEGMENT_ERR_OPEN;
+        goto fail0;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        err = STORESEGMENT_ERR_OPEN;
+        goto fail1;
+    }
+
+    // new file at full size; allocated up front, a full disk would otherwise hit the
+    // mapping as SIGBUS (ext4 only reserves the blocks, nothing is written)
+    if (st.st_size == 0 && write) {
+        if (posix_fallocate(fd, 0, size) != 0) {
+            err = STORESEGMENT_ERR_OPEN;
+            goto fail1;
+        }
+        st.st_size = size;
+    }
+
+    if (st.st_size < RECORDS_OFFSET) {
+        err = STORESEGMENT_ERR_FORMAT;
+        goto fail1;
+    }
+
+    mapSize = st.st_size;
+    map = (uchar *) mmap(NULL, mapSize, write ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        err = STORESEGMENT_ERR_MAP;
+        goto fail1;
+    }
+
+    writable = write;
+    header = (Header *) map;
+    minutes = (StoreMinute *) (map + MINUTES_OFFSET);
+    records = (StoreRecord *) (map + RECORDS_OFFSET);
+
+    // the mapping stays valid, only the writer needs the descriptor for writeback
+    if (!write) {
+        ::close(fd);
+        fd = -1;
+    }
+
+    return STORESEGMENT_ERR_OK;
+
+fail1:
+    ::close(fd);
+    fd = -1;
+fail0:
+    return err;
+}
+
+bool StoreSegment::checkHeader() {
+    if (memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+            header->version != STORESEGMENT_VERSION ||
+            header->recordSize != sizeof(StoreRecord) ||
+            header->channels < 1 || header->channels > STORESEGMENT_CHANNELS ||
+            RECORDS_OFFSET + (qint64) header->capacity * (qint64) sizeof(StoreRecord) > mapSize) {
+        return false;
+    }
+
+    dayStart = header->dayStart;
+    capacity = header->capacity;
+    count = qMin(header->count, capacity);
+    channels = header->channels;
+    circularMask = header->circularMask;
+    return true;
+}
+
+int StoreSegment::create(const QString &path, qint64 dayStart, quint32 capacity, int channels, quint32 circularMask) {
+    close();
+
+    qint64 size = RECORDS_OFFSET + (qint64) capacity * (qint64) sizeof(StoreRecord);
+    int err = mapFile(path, true, size);
+    if (err != STORESEGMENT_ERR_OK) {
+        return err;
+    }
+
+    // fresh file reads as zeros
+    if (memcmp(header->magic, "\0\0\0\0", 4) == 0) {
+        memcpy(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+        header->version = STORESEGMENT_VERSION;
+        header->recordSize = sizeof(StoreRecord);
+        header->capacity = capacity;
+        header->dayStart = dayStart;
+        header->count = 0;
+        header->channels = channels;
+        header->circularMask = circularMask;
+    }
+
+    // an existing file keeps its own capacity
+    if (!checkHeader() || header->dayStart != dayStart || header->channels != (quint32) channels) {
+        close();
+        return STORESEGMENT_ERR_FORMAT;
+    }
+
+    recover();
+    return STORESEGMENT_ERR_OK;
+}
+
+int StoreSegment::open(const QString &path) {
+    close();
+
+    int err = mapFile(path, false, 0);
+    if (err != STORESEGMENT_ERR_OK) {
+        return err;
+    }
+
+    if (!checkHeader()) {
+        close();
+        return STORESEGMENT_ERR_FORMAT;
+    }
+
+    // written but not yet counted, see recover()
+    while (count < capacity && records[count].timestamp != 0) {
+        count++;
+    }
+
+    return STORESEGMENT_ERR_OK;
+}
+
+void StoreSegment::close() {
+    if (map != NULL) {
+        if (writable) {
+            // the open minute is only summarized here, a reopen rebuilds it
+            summarizeMinute();
+            header->count = count;
+            indexDirty = true;
+            sync();
+        }
+        munmap(map, mapSize);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    fd = -1;
+    map = NULL;
+    mapSize = 0;
+    writable = false;
+    header = NULL;
+    minutes = NULL;
+    records = NULL;
+
+    count = 0;
+    capacity = 0;
+    openMinute = -1;
+    syncedCount = 0;
+    indexDirty = false;
+}
+
+// records are written before the count, a crash can leave some behind it; the summaries
+// of the last minute and of anything after it are rebuilt
+void StoreSegment::recover() {
+    while (count < capacity && records[count].timestamp != 0) {
+        count++;
+    }
+
+    int last = STORESEGMENT_MINUTES - 1;
+    while (last >= 0 && minutes[last].count == 0) {
+        last--;
+    }
+    quint32 start = 0;
+    if (last >= 0) {
+        start = minutes[last].first;
+    } else {
+        last = 0;
+    }
+    memset(&minutes[last], 0, (STORESEGMENT_MINUTES - last) * sizeof(StoreMinute));
+
+    openMinute = -1;
+    for (quint32 i = start; i < count; i++) {
+        index(i);
+    }
+    syncedCount = start;
+}
+
+// adds record i to the summary of its minute
+void StoreSegment::index(quint32 i) {
+    const StoreRecord &record = records[i];
+
+    int minute = (int) ((record.timestamp - dayStart) / STORESEGMENT_MINUTE_MS);
+    minute = qBound(0, minute, STORESEGMENT_MINUTES - 1);
+    if (minute != openMinute) {
+        // the only time the header and index pages are touched, the count covers
+        // the completed minute
+        summarizeMinute();
+        header->count = i;
+        indexDirty = true;
+        openMinute = minute;
+        minutes[minute].first = i;
+        for (int c = 0; c < channels; c++) {
+            openBuckets[c].count = 0;
+        }
+    }
+
+    for (int c = 0; c < channels; c++) {
+        HistoryBucket sample;
+        HistoryPyramid::sampleBucket(record.timestamp, record.values[c], isCircular(c), &sample);
+        if (openBuckets[c].count == 0) {
+            openBuckets[c] = sample;
+        } else {
+            HistoryPyramid::mergeBucket(&openBuckets[c], sample, isCircular(c));
+        }
+    }
+}
+
+void StoreSegment::summarizeMinute() {
+    if (openMinute < 0 || openBuckets[0].count == 0) {
+        return;
+    }
+
+    StoreMinute &m = minutes[openMinute];
+    for (int c = 0; c < channels; c++) {
+        HistoryPoint point;
+        HistoryPyramid::bucketToPoint(openBuckets[c], isCircular(c), &point);
+        m.min[c] = (float) point.min;
+        m.max[c] = (float) point.max;
+        m.mean[c] = (float) point.mean;
+    }
+    // last, a non-zero count marks the summary valid
+    m.count = openBuckets[0].count;
+}
+
+quint32 StoreSegment::findFirst(qint64 timestamp) {
+    if (count == 0 || timestamp <= dayStart) {
+        return 0;
+    }
+
+    int minute = (int) ((timestamp - dayStart) / STORESEGMENT_MINUTE_MS);
+    quint32 i = count;
+    for (int m = minute; m < STORESEGMENT_MINUTES; m++) {
+        if (minutes[m].count > 0) {
+            i = minutes[m].first;
+            break;
+        }
+    }
+
+    // not summarized yet (recovered by a reader), search the records
+    if (i == count) {
+        quint32 lo = 0;
+        quint32 hi = count;
+        while (lo < hi) {
+            quint32 mid = lo + (hi - lo) / 2;
+            if (records[mid].timestamp < timestamp) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // at most one minute of records
+    while (i < count && records[i].timestamp < timestamp) {
+        i++;
+    }
+    return i;
+}
+
+int StoreSegment::append(const StoreRecord &record) {
+    if (!writable) {
+        return STORESEGMENT_ERR_NOT_OPEN;
+    }
+    if (count >= capacity) {
+        return STORESEGMENT_ERR_FULL;
+    }
+
+    StoreRecord &r = records[count];
+    r = record;
+    // records stay in time order, 0 marks the end
+    if (count > 0 && r.timestamp < records[count - 1].timestamp) {
+        r.timestamp = records[count - 1].timestamp;
+    }
+    if (r.timestamp <= 0) {
+        r.timestamp = 1;
+    }
+
+    index(count);
+    count++;
+    return STORESEGMENT_ERR_OK;
+}
+
+void StoreSegment::sync() {
+    if (!writable || map == NULL) {
+        return;
+    }
+
+    // header and index pages only after a minute was completed
+    if (indexDirty) {
+        msync(map, RECORDS_OFFSET, MS_ASYNC);
+        sync_file_range(fd, 0, RECORDS_OFFSET, SYNC_FILE_RANGE_WRITE);
+        indexDirty = false;
+    }
+
+    if (count == syncedCount) {
+        return;
+    }
+
+    // one sequential write of the new records
+    qint64 offset = RECORDS_OFFSET + (qint64) syncedCount * (qint64) sizeof(StoreRecord);
+    qint64 len = (qint64) (count - syncedCount) * (qint64) sizeof(StoreRecord);
+    sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WRITE);
+
+    syncedCount = count;
+}
@@ -0,0 +1,108 @@
+#ifndef STORESEGMENT_H
+#define STORESEGMENT_H
+
+#include <QString>
+
+#include "historypyramid.h"
+
+#define STORESEGMENT_ERR_OK 0
+#define STORESEGMENT_ERR_OPEN -1
+#define STORESEGMENT_ERR_MAP -2
+#define STORESEGMENT_ERR_FORMAT -3
+#define STORESEGMENT_ERR_FULL -4
+#define STORESEGMENT_ERR_NOT_OPEN -5
+
+#define STORESEGMENT_VERSION 1
+#define STORESEGMENT_CHANNELS 2
+#define STORESEGMENT_DAY_MS 86400000LL
+#define STORESEGMENT_MINUTE_MS 60000LL
+#define STORESEGMENT_MINUTES 1440
+
+class StoreRecord {
+public:
+    // msec since epoch
+    qint64 timestamp;
+    float values[STORESEGMENT_CHANNELS];
+};
+
+// summary of the records of one minute, the index of a segment
+class StoreMinute {
+public:
+    quint32 first;
+    quint32 count;
+    float min[STORESEGMENT_CHANNELS];
+    float max[STORESEGMENT_CHANNELS];
+    // circular mean for circular channels, min/max unwrapped around it
+    float mean[STORESEGMENT_CHANNELS];
+};
+
+// One day of one stream in a memory-mapped file of fixed size:
+//   64 byte header (magic "MSEG", version, record size, capacity, day start, count, channels,
+//   circular channel mask), 1440 minute summaries, then fixed 16 byte records in time order.
+// The file is preallocated at full size, records are only ever appended. Writeback of the
+// appended range is started by sync(). The stored count and the minute summaries are only
+// written when a minute is complete and on close(), so most syncs do not touch the header and
+// index pages. Records behind the stored count are found by open(), the minute summaries are
+// rebuilt from the last complete one.
+class StoreSegment
+{
+public:
+    StoreSegment();
+    ~StoreSegment();
+
+    // writable, the file is created if missing
+    int create(const QString &path, qint64 dayStart, quint32 capacity, int channels, quint32 circularMask);
+    // read only
+    int open(const QString &path);
+    void close();
+    bool isOpen() { return map != NULL; }
+
+    qint64 getDayStart() { return dayStart; }
+    quint32 getCount() { return count; }
+    int getChannels() { return channels; }
+    bool isCircular(int channel) { return (circularMask & (1U << channel)) != 0; }
+
+    const StoreRecord &getRecord(quint32 i) { return records[i]; }
+    const StoreMinute &getMinute(int minute) { return minutes[minute]; }
+    // first record at or after timestamp, by the minute index
+    quint32 findFirst(qint64 timestamp);
+
+    // timestamps going back are clamped to the last record
+    int append(const StoreRecord &record);
+    // start writeback of the new records, and of the index if a minute was completed since
+    void sync();
+
+private:
+    struct Header;
+
+    int fd;
+    uchar *map;
+    qint64 mapSize;
+    bool writable;
+
+    Header *header;
+    StoreMinute *minutes;
+    StoreRecord *records;
+
+    qint64 dayStart;
+    quint32 capacity;
+    quint32 count;
+    int channels;
+    quint32 circularMask;
+
+    // writer: minute being summarized and its statistics
+    int openMinute;
+    HistoryBucket openBuckets[STORESEGMENT_CHANNELS];
+    // first record not yet handed to writeback
+    quint32 syncedCount;
+    // header count or minute summaries changed since the last sync
+    bool indexDirty;
+
+    int mapFile(const QString &path, bool write, qint64 size);
+    bool checkHeader();
+    void recover();
+    void index(quint32 i);
+    void summarizeMinute();
+};
+
+#endif // STORESEGMENT_H
@@ -0,0 +1,94 @@
+#include "windavgwindow.h"
+
+WindAvgWindow::WindAvgWindow(qint64 window, int maxRate) : window(window)
+{
+    qint64 capacity = window * maxRate / 1000 + 1;
+    quint32 cap = 1;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+    mask = cap - 1;
+
+    items.resize(cap);
+    peakSeq.resize(cap);
+
+    overflowCount = 0;
+
+    clear();
+}
+
+void WindAvgWindow::clear() {
+    first = 0;
+    next = 0;
+    peakFirst = 0;
+    peakNext = 0;
+
+    dirSinSum = 0.0;
+    dirCosSum = 0.0;
+    resumCountdown = WIND_AVG_RESUM_INTERVAL;
+}
+
+void WindAvgWindow::add(const MeteoWindAvgItem &item) {
+    // remove old items
+    qint64 timeout = item.timestamp - window;
+    while (first != next && items[first & mask].timestamp <= timeout) {
+        expireFirst();
+    }
+
+    // ring full, drop oldest
+    if (next - first > mask) {
+        expireFirst();
+        overflowCount++;
+    }
+
+    // smaller velocities can never become the peak again
+    while (peakFirst != peakNext && items[peakSeq[(peakNext - 1) & mask] & mask].velo <= item.velo) {
+        peakNext--;
+    }
+    peakSeq[peakNext & mask] = next;
+    peakNext++;
+
+    items[next & mask] = item;
+    next++;
+
+    dirSinSum += item.dirSin * item.velo;
+    dirCosSum += item.dirCos * item.velo;
+
+    // bound floating point drift of the running sums
+    if (--resumCountdown <= 0) {
+        resum();
+    }
+}
+
+double WindAvgWindow::getVeloPeak() {
+    if (peakFirst == peakNext) {
+        return 0.0;
+    }
+    return items[peakSeq[peakFirst & mask] & mask].velo;
+}
+
+void WindAvgWindow::expireFirst() {
+    const MeteoWindAvgItem &item = items[first & mask];
+    dirSinSum -= item.dirSin * item.velo;
+    dirCosSum -= item.dirCos * item.velo;
+
+    if (peakFirst != peakNext && peakSeq[peakFirst & mask] == first) {
+        peakFirst++;
+    }
+
+    first++;
+}
+
+void WindAvgWindow::resum() {
+    double sinSum = 0.0;
+    double cosSum = 0.0;
+    for (quint64 seq = first; seq != next; seq++) {
+        const MeteoWindAvgItem &item = items[seq & mask];
+        sinSum += item.dirSin * item.velo;
+        cosSum += item.dirCos * item.velo;
+    }
+
+    dirSinSum = sinSum;
+    dirCosSum = cosSum;
+    resumCountdown = WIND_AVG_RESUM_INTERVAL;
+}
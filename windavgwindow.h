@@ -0,0 +1,64 @@
+#ifndef WINDAVGWINDOW_H
+#define WINDAVGWINDOW_H
+
+#include <QtGlobal>
+#include <QVector>
+
+// highest sample rate in Hz the window holds completely, sizes the rings
+#define WIND_AVG_MAX_RATE       50
+#define WIND_AVG_RESUM_INTERVAL 4096
+
+class MeteoWindAvgItem {
+public:
+    qint64 timestamp;
+    double dirSin;
+    double dirCos;
+    double velo;
+};
+
+// Sliding time window over wind samples with amortised O(1) updates:
+// running velocity weighted sin/cos sums and a monotonic deque for the peak,
+// all kept in preallocated rings sized for window at maxRate. If more samples
+// fall into the window the oldest ones are dropped early and counted.
+class WindAvgWindow
+{
+public:
+    // window in msec, maxRate in Hz
+    explicit WindAvgWindow(qint64 window, int maxRate = WIND_AVG_MAX_RATE);
+
+    // add sample, samples older than window relative to it are expired
+    void add(const MeteoWindAvgItem &item);
+    void clear();
+
+    int getCount() { return next - first; }
+    double getDirSinSum() { return dirSinSum; }
+    double getDirCosSum() { return dirCosSum; }
+    double getVeloPeak();
+    int getCapacity() { return (int) mask + 1; }
+    // samples dropped before leaving the window because the ring was full
+    quint64 getOverflowCount() { return overflowCount; }
+
+private:
+    qint64 window;
+    quint32 mask;
+
+    // samples by sequence number, seq & mask is the ring index
+    QVector<MeteoWindAvgItem> items;
+    quint64 first;
+    quint64 next;
+
+    // sequence numbers of decreasing velocity
+    QVector<quint64> peakSeq;
+    quint64 peakFirst;
+    quint64 peakNext;
+
+    double dirSinSum;
+    double dirCosSum;
+    int resumCountdown;
+    quint64 overflowCount;
+
+    void expireFirst();
+    void resum();
+};
+
+#endif // WINDAVGWINDOW_H